@@ -3,253 +3,10465 @@
 #include <limits> 
 #include <string> 
 #include <iomanip>
+#ifdef _WIN32
 #include <Windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 #include <cfloat> 
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <queue>
+#include <functional>
+#include <memory>
+#include <exception>
+#include <cstdlib>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <utility>
+#include <filesystem>
 
-// Функция для определения ранга матрицы
-int findRank(std::vector<std::vector<double>>& matrix) {
-    int rank = 0; // Инициализация переменной rank для хранения ранга матрицы
-    int rows = static_cast<int>(matrix.size()); // Получение количества строк в матрице с помощью static_cast
-    int cols = static_cast<int>(matrix[0].size()); // Получение количества столбцов в матрице с помощью static_cast
-
-    for (int col = 0; col < cols; col++) { // Проход по каждому столбцу матрицы
-        for (int row = rank; row < rows; row++) {
-            if (matrix[row][col] != 0) { // Поиск ненулевого элемента в столбце начиная с текущей строки ранга
-                std::swap(matrix[row], matrix[rank]); // Перестановка строк, чтобы ненулевой элемент стал ведущим элементом
-                for (int i = rank + 1; i < rows; i++) {
-                    double factor = matrix[i][col] / matrix[rank][col]; // Вычисление коэффициента для обнуления элемента
-                    for (int j = col; j < cols; j++) {
-                        matrix[i][j] -= factor * matrix[rank][j]; // Преобразование строки для обнуления элемента
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define P2_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define P2_X86 0
+#endif
+
+// Функции с SIMD-ядрами компилируются под расширенный набор инструкций, а вызываются только после проверки процессора.
+// MSVC разрешает встроенные функции AVX без отдельных атрибутов.
+#if P2_X86 && (defined(__GNUC__) || defined(__clang__))
+#define P2_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define P2_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define P2_TARGET_AVX2
+#define P2_TARGET_AVX512
+#endif
+
+// Ядра, написанные один раз как шаблоны над типом SIMD-значения, встраивают все вызовы в функцию-обёртку
+// с атрибутом целевого набора инструкций: иначе операции над регистрами остались бы вызовами функций.
+#if defined(__GNUC__) || defined(__clang__)
+#define P2_FLATTEN __attribute__((flatten))
+#else
+#define P2_FLATTEN
+#endif
+
+// Выравнивание буфера матрицы: строка кэша и ширина регистра AVX-512
+constexpr std::size_t MatrixAlignment = 64;
+
+// Счётчики выделений через allocateAligned (буферы матриц, рабочих областей и упаковки) для замеров
+struct AllocationCounters {
+    std::atomic<std::uint64_t> count{ 0 };
+    std::atomic<std::uint64_t> bytes{ 0 };
+};
+
+AllocationCounters& allocationCounters() {
+    static AllocationCounters counters;
+    return counters;
+}
+
+// Число байт, выделенных через allocateAligned текущим потоком (для профилирования этапов)
+std::uint64_t& threadAllocatedBytes() {
+    thread_local std::uint64_t bytes = 0;
+    return bytes;
+}
+
+// Функция выделения выровненного буфера под count элементов double
+double* allocateAligned(std::size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+    AllocationCounters& counters = allocationCounters();
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(count * sizeof(double), std::memory_order_relaxed);
+    threadAllocatedBytes() += count * sizeof(double);
+    return static_cast<double*>(::operator new(count * sizeof(double), std::align_val_t(MatrixAlignment)));
+}
+
+// Функция освобождения буфера, выделенного allocateAligned
+void freeAligned(double* data) {
+    if (data != nullptr) {
+        ::operator delete(data, std::align_val_t(MatrixAlignment));
+    }
+}
+
+// Профилирование этапов обработки: время по стене, операции с плавающей точкой, выделенная память
+// и, если доступны, аппаратные счётчики. Выключенное профилирование стоит одной проверки флага
+// на этап; при сборке с P2_PROFILING=0 этапы не компилируются вовсе.
+#ifndef P2_PROFILING
+#define P2_PROFILING 1
+#endif
+
+// Вид отчёта профилирования
+enum class ProfileOutput {
+    Off,
+    Summary, // Сводная таблица по этапам
+    Trace // Chrome trace-event JSON (chrome://tracing, Perfetto)
+};
+
+// Завершённый этап одного потока
+struct ProfileEvent {
+    const char* name;
+    std::uint64_t start; // нс от начала профилирования
+    std::uint64_t duration; // нс
+    double flops;
+    std::uint64_t allocatedBytes;
+    std::uint64_t cycles;
+    std::uint64_t instructions;
+};
+
+// Аппаратные счётчики циклов и инструкций текущего потока (perf_event_open, только Linux)
+class HardwareCounters {
+public:
+    HardwareCounters() {
+#ifdef __linux__
+        leader_ = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (leader_ >= 0) {
+            member_ = openCounter(PERF_COUNT_HW_INSTRUCTIONS, leader_);
+            if (member_ < 0) {
+                close(leader_);
+                leader_ = -1;
+            }
+        }
+#endif
+    }
+
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+    ~HardwareCounters() {
+#ifdef __linux__
+        if (member_ >= 0) {
+            close(member_);
+        }
+        if (leader_ >= 0) {
+            close(leader_);
+        }
+#endif
+    }
+
+    bool available() const { return leader_ >= 0; }
+
+    // Текущие значения счётчиков; false, если счётчики недоступны
+    bool read(std::uint64_t& cycles, std::uint64_t& instructions) const {
+#ifdef __linux__
+        std::uint64_t values[3] = {};
+        if (leader_ >= 0 && ::read(leader_, values, sizeof(values)) == static_cast<ssize_t>(sizeof(values))) {
+            cycles = values[1];
+            instructions = values[2];
+            return true;
+        }
+#else
+        (void)cycles;
+        (void)instructions;
+#endif
+        return false;
+    }
+
+    static HardwareCounters& forThread() {
+        thread_local HardwareCounters counters;
+        return counters;
+    }
+
+private:
+#ifdef __linux__
+    static int openCounter(std::uint64_t config, int group) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+#endif
+
+    int leader_ = -1;
+    int member_ = -1;
+};
+
+// Пиковый объём резидентной памяти процесса (в байтах; 0, если неизвестен)
+std::uint64_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Сборщик этапов: каждый поток пишет в собственный буфер без блокировок, отчёт строится по окончании работы
+class Profiler {
+public:
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    bool hardwareCounters() const { return hardwareCounters_; }
+
+    // Включение профилирования; path - файл отчёта (пусто - стандартный поток ошибок)
+    void start(ProfileOutput output, const std::string& path) {
+        output_ = output;
+        path_ = path;
+        origin_ = std::chrono::steady_clock::now();
+        hardwareCounters_ = HardwareCounters::forThread().available();
+        enabled_.store(output != ProfileOutput::Off, std::memory_order_relaxed);
+    }
+
+    std::uint64_t now() const {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin_).count());
+    }
+
+    void record(const ProfileEvent& event) { threadBuffer().events.push_back(event); }
+
+    // Запись отчёта; вызывается, когда все потоки закончили работу
+    void report();
+
+private:
+    struct ThreadBuffer {
+        int thread;
+        std::vector<ProfileEvent> events;
+    };
+
+    ThreadBuffer& threadBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer{ static_cast<int>(buffers_.size()), {} }));
+            buffer = buffers_.back().get();
+        }
+        return *buffer;
+    }
+
+    void writeSummary(std::ostream& out);
+    void writeTrace(std::ostream& out);
+
+    std::atomic<bool> enabled_{ false };
+    bool hardwareCounters_ = false;
+    ProfileOutput output_ = ProfileOutput::Off;
+    std::string path_;
+    std::chrono::steady_clock::time_point origin_ = std::chrono::steady_clock::now();
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+void Profiler::writeSummary(std::ostream& out) {
+    struct Total {
+        std::string name;
+        std::uint64_t calls = 0;
+        std::uint64_t duration = 0;
+        double flops = 0.0;
+        std::uint64_t allocatedBytes = 0;
+        std::uint64_t cycles = 0;
+        std::uint64_t instructions = 0;
+    };
+    std::vector<Total> totals;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers_) {
+        for (const ProfileEvent& event : buffer->events) {
+            auto found = std::find_if(totals.begin(), totals.end(), [&](const Total& total) { return total.name == event.name; });
+            if (found == totals.end()) {
+                totals.push_back(Total());
+                totals.back().name = event.name;
+                found = totals.end() - 1;
+            }
+            found->calls++;
+            found->duration += event.duration;
+            found->flops += event.flops;
+            found->allocatedBytes += event.allocatedBytes;
+            found->cycles += event.cycles;
+            found->instructions += event.instructions;
+        }
+    }
+    std::sort(totals.begin(), totals.end(), [](const Total& a, const Total& b) { return a.duration > b.duration; });
+
+    double wall = now() * 1e-9;
+    out << "Профиль: " << std::setprecision(4) << wall << " с по стене, пиковая резидентная память "
+        << peakResidentBytes() / (1024.0 * 1024.0) << " МБ (вложенные этапы входят во внешние)\n";
+    out << std::left << std::setw(16) << "stage" << std::right << std::setw(10) << "calls" << std::setw(12) << "total ms"
+        << std::setw(12) << "mean us" << std::setw(9) << "%" << std::setw(10) << "GFLOP/s" << std::setw(12) << "alloc MB";
+    if (hardwareCounters_) {
+        out << std::setw(14) << "Mcycles" << std::setw(14) << "Minstr" << std::setw(7) << "IPC";
+    }
+    out << '\n';
+    for (const Total& total : totals) {
+        double seconds = total.duration * 1e-9;
+        out << std::fixed << std::setprecision(2) << std::left << std::setw(16) << total.name << std::right << std::setw(10) << total.calls
+            << std::setw(12) << seconds * 1e3 << std::setw(12) << seconds * 1e6 / total.calls
+            << std::setw(9) << (wall > 0.0 ? 100.0 * seconds / wall : 0.0)
+            << std::setw(10) << (seconds > 0.0 ? total.flops / seconds * 1e-9 : 0.0)
+            << std::setw(12) << total.allocatedBytes / (1024.0 * 1024.0);
+        if (hardwareCounters_) {
+            out << std::setw(14) << total.cycles * 1e-6 << std::setw(14) << total.instructions * 1e-6
+                << std::setw(7) << (total.cycles > 0 ? static_cast<double>(total.instructions) / total.cycles : 0.0);
+        }
+        out << '\n';
+    }
+}
+
+void Profiler::writeTrace(std::ostream& out) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"peak_rss_bytes\": " << peakResidentBytes() << "}, \"traceEvents\": [\n";
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers_) {
+        for (const ProfileEvent& event : buffer->events) {
+            out << (first ? "" : ",\n") << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->thread
+                << ", \"ts\": " << event.start * 1e-3 << ", \"dur\": " << event.duration * 1e-3
+                << ", \"args\": {\"flops\": " << event.flops << ", \"allocated_bytes\": " << event.allocatedBytes;
+            if (hardwareCounters_) {
+                out << ", \"cycles\": " << event.cycles << ", \"instructions\": " << event.instructions;
+            }
+            out << "}}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+}
+
+void Profiler::report() {
+    if (!enabled()) {
+        return;
+    }
+    enabled_.store(false, std::memory_order_relaxed);
+
+    std::ofstream file;
+    if (!path_.empty() && path_ != "-") {
+        file.open(path_, std::ios::binary);
+        if (!file) {
+            std::cerr << "Ошибка: не удалось открыть файл " << path_ << '\n';
+            return;
+        }
+    }
+    std::ostream& out = file.is_open() ? static_cast<std::ostream&>(file) : std::cerr;
+    if (output_ == ProfileOutput::Trace) {
+        writeTrace(out);
+    }
+    else {
+        writeSummary(out);
+    }
+    out.flush();
+}
+
+#if P2_PROFILING
+// Этап профилирования в пределах области видимости. Пока профилирование выключено,
+// конструктор и деструктор сводятся к проверке флага.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) {
+        if (Profiler::instance().enabled()) {
+            begin(name);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        if (name_ != nullptr) {
+            end();
+        }
+    }
+
+    // Учёт операций с плавающей точкой, выполненных на этапе
+    void addFlops(double flops) { flops_ += flops; }
+
+private:
+    void begin(const char* name) {
+        name_ = name;
+        allocatedBytes_ = threadAllocatedBytes();
+        if (Profiler::instance().hardwareCounters()) {
+            HardwareCounters::forThread().read(cycles_, instructions_);
+        }
+        start_ = Profiler::instance().now();
+    }
+
+    void end() {
+        Profiler& profiler = Profiler::instance();
+        ProfileEvent event = { name_, start_, profiler.now() - start_, flops_, threadAllocatedBytes() - allocatedBytes_, 0, 0 };
+        std::uint64_t cycles = 0;
+        std::uint64_t instructions = 0;
+        if (profiler.hardwareCounters() && HardwareCounters::forThread().read(cycles, instructions)) {
+            event.cycles = cycles - cycles_;
+            event.instructions = instructions - instructions_;
+        }
+        profiler.record(event);
+    }
+
+    const char* name_ = nullptr;
+    double flops_ = 0.0;
+    std::uint64_t start_ = 0;
+    std::uint64_t allocatedBytes_ = 0;
+    std::uint64_t cycles_ = 0;
+    std::uint64_t instructions_ = 0;
+};
+#else
+class ProfileScope {
+public:
+    explicit ProfileScope(const char*) {}
+    void addFlops(double) {}
+};
+#endif
+
+// Невладеющее представление матрицы с произвольными шагами по строкам и столбцам.
+// Через шаги выражаются строка, столбец, подматрица и транспонированная матрица без копирования данных.
+template <typename T>
+class BasicMatrixView {
+public:
+    BasicMatrixView() = default;
+    BasicMatrixView(T* data, int rows, int cols, std::ptrdiff_t rowStride, std::ptrdiff_t colStride = 1)
+        : data_(data), rows_(rows), cols_(cols), rowStride_(rowStride), colStride_(colStride) {}
+
+    // Неконстантное представление неявно приводится к константному
+    template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+    BasicMatrixView(const BasicMatrixView<U>& other)
+        : data_(other.data()), rows_(other.rows()), cols_(other.cols()), rowStride_(other.rowStride()), colStride_(other.colStride()) {}
+
+    T* data() const { return data_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    std::ptrdiff_t rowStride() const { return rowStride_; }
+    std::ptrdiff_t colStride() const { return colStride_; }
+    bool empty() const { return rows_ == 0 || cols_ == 0; }
+
+    // Элементы строки лежат в памяти подряд
+    bool hasContiguousRows() const { return colStride_ == 1; }
+
+    T& operator()(int i, int j) const { return data_[i * rowStride_ + j * colStride_]; }
+
+    // Указатель на начало строки i (при hasContiguousRows() строка читается как обычный массив)
+    T* rowData(int i) const { return data_ + i * rowStride_; }
+
+    BasicMatrixView row(int i) const { return BasicMatrixView(data_ + i * rowStride_, 1, cols_, rowStride_, colStride_); }
+    BasicMatrixView column(int j) const { return BasicMatrixView(data_ + j * colStride_, rows_, 1, rowStride_, colStride_); }
+    BasicMatrixView transposed() const { return BasicMatrixView(data_, cols_, rows_, colStride_, rowStride_); }
+
+    BasicMatrixView submatrix(int row, int col, int rows, int cols) const {
+        if (row < 0 || col < 0 || rows < 0 || cols < 0 || row + rows > rows_ || col + cols > cols_) {
+            throw std::out_of_range("Подматрица выходит за границы матрицы");
+        }
+        return BasicMatrixView(data_ + row * rowStride_ + col * colStride_, rows, cols, rowStride_, colStride_);
+    }
+
+private:
+    T* data_ = nullptr;
+    int rows_ = 0;
+    int cols_ = 0;
+    std::ptrdiff_t rowStride_ = 0;
+    std::ptrdiff_t colStride_ = 1;
+};
+
+using MatrixView = BasicMatrixView<double>;
+using ConstMatrixView = BasicMatrixView<const double>;
+
+// Плотная матрица rows x cols, хранящаяся по строкам в одном буфере, выровненном по 64 байтам.
+// Основной тип - Matrix (элементы double); с элементами float, long double и std::int64_t - та же матрица
+// для операций с другой точностью: float вдвое экономнее по памяти и пропускной способности, long double
+// точнее для плохо обусловленных матриц, целые числа дают точный ранг и определитель.
+template <typename T>
+class BasicMatrix {
+    static_assert(std::is_trivially_copyable<T>::value && alignof(T) <= MatrixAlignment, "Неподдерживаемый тип элементов матрицы");
+
+public:
+    BasicMatrix() = default;
+
+    BasicMatrix(int rows, int cols, T value = T()) : rows_(checkDimension(rows)), cols_(checkDimension(cols)), data_(allocate(size())) {
+        std::fill(data_, data_ + size(), value);
+    }
+
+    // Копирование содержимого произвольного представления в новую плотную матрицу
+    explicit BasicMatrix(BasicMatrixView<const T> view) : rows_(view.rows()), cols_(view.cols()), data_(allocate(size())) {
+        for (int i = 0; i < rows_; i++) {
+            T* dst = rowData(i);
+            if (view.hasContiguousRows()) {
+                std::copy(view.rowData(i), view.rowData(i) + cols_, dst);
+            }
+            else {
+                for (int j = 0; j < cols_; j++) {
+                    dst[j] = view(i, j);
+                }
+            }
+        }
+    }
+
+    BasicMatrix(const BasicMatrix& other) : rows_(other.rows_), cols_(other.cols_), data_(allocate(other.size())) {
+        std::copy(other.data_, other.data_ + size(), data_);
+    }
+
+    BasicMatrix(BasicMatrix&& other) noexcept : rows_(other.rows_), cols_(other.cols_), data_(other.data_) {
+        other.rows_ = 0;
+        other.cols_ = 0;
+        other.data_ = nullptr;
+    }
+
+    BasicMatrix& operator=(const BasicMatrix& other) {
+        if (this != &other) {
+            BasicMatrix copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    BasicMatrix& operator=(BasicMatrix&& other) noexcept {
+        BasicMatrix moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~BasicMatrix() { freeAligned(reinterpret_cast<double*>(data_)); }
+
+    void swap(BasicMatrix& other) noexcept {
+        std::swap(rows_, other.rows_);
+        std::swap(cols_, other.cols_);
+        std::swap(data_, other.data_);
+    }
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    std::size_t size() const { return static_cast<std::size_t>(rows_) * static_cast<std::size_t>(cols_); }
+    bool empty() const { return size() == 0; }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    T* rowData(int i) { return data_ + static_cast<std::size_t>(i) * cols_; }
+    const T* rowData(int i) const { return data_ + static_cast<std::size_t>(i) * cols_; }
+
+    T& operator()(int i, int j) { return data_[static_cast<std::size_t>(i) * cols_ + j]; }
+    T operator()(int i, int j) const { return data_[static_cast<std::size_t>(i) * cols_ + j]; }
+
+    BasicMatrixView<T> view() { return BasicMatrixView<T>(data_, rows_, cols_, cols_); }
+    BasicMatrixView<const T> view() const { return BasicMatrixView<const T>(data_, rows_, cols_, cols_); }
+    operator BasicMatrixView<T>() { return view(); }
+    operator BasicMatrixView<const T>() const { return view(); }
+
+    BasicMatrixView<T> row(int i) { return view().row(i); }
+    BasicMatrixView<const T> row(int i) const { return view().row(i); }
+    BasicMatrixView<T> column(int j) { return view().column(j); }
+    BasicMatrixView<const T> column(int j) const { return view().column(j); }
+    BasicMatrixView<T> transposed() { return view().transposed(); }
+    BasicMatrixView<const T> transposed() const { return view().transposed(); }
+    BasicMatrixView<T> submatrix(int row, int col, int rows, int cols) { return view().submatrix(row, col, rows, cols); }
+    BasicMatrixView<const T> submatrix(int row, int col, int rows, int cols) const { return view().submatrix(row, col, rows, cols); }
+
+    // Обмен двух строк матрицы местами
+    void swapRows(int i, int k) {
+        if (i != k) {
+            std::swap_ranges(rowData(i), rowData(i) + cols_, rowData(k));
+        }
+    }
+
+    // Изменение формы без перемещения данных (общее число элементов сохраняется)
+    void reshape(int rows, int cols) {
+        if (static_cast<std::size_t>(checkDimension(rows)) * static_cast<std::size_t>(checkDimension(cols)) != size()) {
+            throw std::invalid_argument("Новая форма матрицы должна содержать то же число элементов");
+        }
+        rows_ = rows;
+        cols_ = cols;
+    }
+
+    static BasicMatrix identity(int n) {
+        BasicMatrix result(n, n);
+        for (int i = 0; i < n; i++) {
+            result(i, i) = T(1);
+        }
+        return result;
+    }
+
+private:
+    // Буфер выделяется через allocateAligned (в числах double), чтобы попадать в общие счётчики выделений
+    static T* allocate(std::size_t count) {
+        return reinterpret_cast<T*>(allocateAligned((count * sizeof(T) + sizeof(double) - 1) / sizeof(double)));
+    }
+
+    static int checkDimension(int value) {
+        if (value < 0) {
+            throw std::invalid_argument("Размеры матрицы не могут быть отрицательными");
+        }
+        return value;
+    }
+
+    int rows_ = 0;
+    int cols_ = 0;
+    T* data_ = nullptr;
+};
+
+using Matrix = BasicMatrix<double>;
+using FloatMatrix = BasicMatrix<float>;
+using LongDoubleMatrix = BasicMatrix<long double>;
+using IntegerMatrix = BasicMatrix<std::int64_t>;
+
+// Условие для шаблонных операций над BasicMatrix<T> с элементами другого типа, чем double:
+// для Matrix действуют основные функции над представлениями, которые сообщают об ошибках по-своему
+template <typename T>
+using EnableIfOtherElement = typename std::enable_if<!std::is_same<T, double>::value, int>::type;
+
+// Функция преобразования матрицы из вложенных векторов в плотную матрицу Matrix
+Matrix toMatrix(const std::vector<std::vector<double>>& matrix) {
+    int rows = static_cast<int>(matrix.size());
+    int cols = rows == 0 ? 0 : static_cast<int>(matrix[0].size());
+
+    Matrix result(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        if (static_cast<int>(matrix[i].size()) != cols) {
+            throw std::invalid_argument("Строки матрицы содержат разное количество элементов");
+        }
+        std::copy(matrix[i].begin(), matrix[i].end(), result.rowData(i));
+    }
+    return result;
+}
+
+// Функция преобразования матрицы (или её представления) во вложенные векторы
+std::vector<std::vector<double>> toNestedVector(ConstMatrixView matrix) {
+    std::vector<std::vector<double>> result(matrix.rows(), std::vector<double>(matrix.cols()));
+    for (int i = 0; i < matrix.rows(); i++) {
+        for (int j = 0; j < matrix.cols(); j++) {
+            result[i][j] = matrix(i, j);
+        }
+    }
+    return result;
+}
+
+// Возможности процессора, определяемые один раз при первом обращении
+struct CpuFeatures {
+    bool avx2 = false;
+    bool fma = false;
+    bool avx512f = false;
+};
+
+// Функция определения поддерживаемых процессором и ОС наборов инструкций
+const CpuFeatures& cpuFeatures() {
+    static const CpuFeatures features = [] {
+        CpuFeatures result;
+#if P2_X86 && defined(_MSC_VER)
+        int info[4] = {};
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        result.fma = (info[2] & (1 << 12)) != 0;
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        bool ymmEnabled = (xcr0 & 0x6) == 0x6; // ОС сохраняет регистры XMM и YMM
+        bool zmmEnabled = (xcr0 & 0xE6) == 0xE6; // ОС сохраняет также регистры ZMM и маски
+        if (maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            result.avx2 = ymmEnabled && (info[1] & (1 << 5)) != 0;
+            result.avx512f = zmmEnabled && (info[1] & (1 << 16)) != 0;
+        }
+        result.fma = result.fma && ymmEnabled;
+#elif P2_X86 && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        result.avx2 = __builtin_cpu_supports("avx2") != 0;
+        result.fma = __builtin_cpu_supports("fma") != 0;
+        result.avx512f = __builtin_cpu_supports("avx512f") != 0;
+#endif
+        return result;
+    }();
+    return features;
+}
+
+// Пул потоков с собственной очередью задач у каждого потока и кражей работы.
+// Поток берёт свои задачи с конца очереди (последние добавленные, ещё горячие в кэше),
+// а при пустой очереди забирает задачи с начала очередей других потоков.
+class ThreadPool {
+public:
+    // threads - общее число потоков вместе с вызывающим; 0 - по числу аппаратных потоков
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0) {
+            threads = static_cast<int>(std::thread::hardware_concurrency());
+        }
+        threads = (std::max)(threads, 1);
+
+        // Очередь 0 принадлежит внешним (не рабочим) потокам
+        for (int i = 0; i < threads; i++) {
+            queues_.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (int i = 1; i < threads; i++) {
+            workers_.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // Общее число потоков, выполняющих задачи (рабочие потоки и вызывающий поток)
+    int size() const { return static_cast<int>(queues_.size()); }
+
+    // Постановка задачи в очередь: из рабочего потока - в его собственную, извне - по кругу
+    void submit(std::function<void()> task) {
+        int index = currentWorker() == this ? currentWorkerIndex() : static_cast<int>(nextQueue_++ % queues_.size());
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            pending_++;
+        }
+        wake_.notify_one();
+    }
+
+    // Выполнение одной ожидающей задачи в текущем потоке; false, если задач нет
+    bool runPendingTask() {
+        int self = currentWorker() == this ? currentWorkerIndex() : 0;
+        std::function<void()> task;
+        if (!takeTask(self, task)) {
+            return false;
+        }
+        task();
+        return true;
+    }
+
+    // Параллельный цикл: body(first, last) вызывается для отрезков [begin, end) длиной не больше grain.
+    // Вызывающий поток сам выполняет задачи, пока цикл не завершится, поэтому вложенные вызовы не блокируют пул.
+    // Первое исключение из тела цикла пробрасывается вызывающему после завершения всех отрезков.
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body) {
+        if (end <= begin) {
+            return;
+        }
+        grain = (std::max)(grain, 1);
+        int chunks = (end - begin + grain - 1) / grain;
+        if (chunks == 1 || size() == 1) {
+            body(begin, end);
+            return;
+        }
+
+        struct Loop {
+            const std::function<void(int, int)>* body;
+            std::atomic<int> remaining;
+            std::mutex errorMutex;
+            std::exception_ptr error;
+        } loop;
+        loop.body = &body;
+        loop.remaining = chunks;
+
+        Loop* shared = &loop;
+        for (int first = begin; first < end; first += grain) {
+            int last = (std::min)(end, first + grain);
+            submit([shared, first, last] {
+                try {
+                    (*shared->body)(first, last);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(shared->errorMutex);
+                    if (!shared->error) {
+                        shared->error = std::current_exception();
                     }
                 }
-                rank++; // Увеличение ранга после обработки строки
-                break; // Переход к следующему столбцу
+                shared->remaining.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
+
+        while (loop.remaining.load(std::memory_order_acquire) > 0) {
+            if (!runPendingTask()) {
+                std::this_thread::yield();
+            }
+        }
+
+        if (loop.error) {
+            std::rethrow_exception(loop.error);
+        }
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    static ThreadPool*& currentWorker() {
+        thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& currentWorkerIndex() {
+        thread_local int index = 0;
+        return index;
+    }
+
+    // Своя очередь - с конца, чужие - с начала
+    bool takeTask(int self, std::function<void()>& task) {
+        int count = static_cast<int>(queues_.size());
+        for (int offset = 0; offset < count; offset++) {
+            WorkerQueue& queue = *queues_[(self + offset) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (offset == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            std::lock_guard<std::mutex> wakeLock(wakeMutex_);
+            pending_--;
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int index) {
+        currentWorker() = this;
+        currentWorkerIndex() = index;
+        while (true) {
+            std::function<void()> task;
+            if (takeTask(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+            if (stopping_ && pending_ == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    int pending_ = 0; // Число задач во всех очередях (защищено wakeMutex_)
+    bool stopping_ = false;
+    std::atomic<unsigned> nextQueue_{ 0 };
+};
+
+// Число потоков общего пула: задаётся setThreadCount() или переменной окружения P2V1_THREADS
+int& configuredThreadCount() {
+    static int count = [] {
+        const char* value = std::getenv("P2V1_THREADS");
+        return value != nullptr ? std::atoi(value) : 0;
+    }();
+    return count;
+}
+
+std::unique_ptr<ThreadPool>& threadPoolInstance() {
+    static std::unique_ptr<ThreadPool> pool;
+    return pool;
+}
+
+// Общий пул потоков для матричных операций (создаётся при первом обращении)
+ThreadPool& threadPool() {
+    std::unique_ptr<ThreadPool>& pool = threadPoolInstance();
+    if (!pool) {
+        pool = std::make_unique<ThreadPool>(configuredThreadCount());
+    }
+    return *pool;
+}
+
+// Функция задания числа потоков общего пула (0 - по числу аппаратных потоков).
+// Вызывается до начала вычислений: существующий пул пересоздаётся.
+void setThreadCount(int threads) {
+    configuredThreadCount() = threads;
+    threadPoolInstance().reset();
+}
+
+// Граф задач: узлы - операции, рёбра - зависимости по промежуточным результатам (например, одно
+// LU-разложение питает определитель и обратную матрицу). Готовые к выполнению узлы ставятся в очередь
+// пула и выполняются параллельно; вызывающий поток участвует в работе, поэтому граф можно запускать
+// и изнутри задачи пула. Время каждого узла запоминается для отчёта о критическом пути.
+class TaskGraph {
+public:
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    // Добавление узла name с телом body; dependencies - номера ранее добавленных узлов.
+    // Возвращает номер узла. name должно жить до конца работы с графом (обычно строковый литерал).
+    int add(const char* name, std::function<void()> body, std::initializer_list<int> dependencies = {}) {
+        int index = static_cast<int>(nodes_.size());
+        nodes_.push_back(std::make_unique<Node>());
+        Node& node = *nodes_.back();
+        node.name = name;
+        node.body = std::move(body);
+        for (int dependency : dependencies) {
+            if (dependency < 0 || dependency >= index) {
+                throw std::invalid_argument("Зависимость узла графа должна быть добавлена раньше него");
+            }
+            node.dependencies.push_back(dependency);
+            nodes_[dependency]->dependents.push_back(index);
+        }
+        return index;
+    }
+
+    int size() const { return static_cast<int>(nodes_.size()); }
+
+    // Выполнение всех узлов. Если узел выбросил исключение, зависящие от него узлы пропускаются,
+    // а первое исключение пробрасывается после завершения остальных узлов.
+    void run(ThreadPool& pool) {
+        ProfileScope profile("task graph");
+        origin_ = std::chrono::steady_clock::now();
+        for (auto& node : nodes_) {
+            node->waiting.store(static_cast<int>(node->dependencies.size()), std::memory_order_relaxed);
+            node->failed = false;
+        }
+        remaining_.store(size(), std::memory_order_relaxed);
+        error_ = nullptr;
+
+        if (pool.size() == 1) {
+            // Порядок добавления - топологический: зависимости всегда добавлены раньше
+            for (int i = 0; i < size(); i++) {
+                execute(i, nullptr);
+            }
+        }
+        else {
+            for (int i = 0; i < size(); i++) {
+                if (nodes_[i]->dependencies.empty()) {
+                    pool.submit([this, i, &pool] { execute(i, &pool); });
+                }
+            }
+            while (remaining_.load(std::memory_order_acquire) > 0) {
+                if (!pool.runPendingTask()) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        wall_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin_).count();
+
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // Критический путь последнего запуска: цепочка зависимых узлов с наибольшим суммарным временем
+    std::vector<int> criticalPath() const {
+        std::vector<double> finish(nodes_.size(), 0.0);
+        std::vector<int> previous(nodes_.size(), -1);
+        int last = -1;
+        for (int i = 0; i < size(); i++) {
+            const Node& node = *nodes_[i];
+            for (int dependency : node.dependencies) {
+                if (finish[dependency] > finish[i]) {
+                    finish[i] = finish[dependency];
+                    previous[i] = dependency;
+                }
             }
+            finish[i] += node.duration;
+            if (last < 0 || finish[i] > finish[last]) {
+                last = i;
+            }
+        }
+        std::vector<int> path;
+        for (int i = last; i >= 0; i = previous[i]) {
+            path.push_back(i);
+        }
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
+    // Отчёт о последнем запуске: начало и длительность каждого узла (узлы критического пути отмечены '*'),
+    // время по стене, суммарное время работы и длина критического пути
+    void writeTimeline(std::ostream& out) const {
+        std::vector<int> path = criticalPath();
+        std::vector<bool> critical(nodes_.size(), false);
+        double pathTime = 0.0;
+        double work = 0.0;
+        for (int i : path) {
+            critical[i] = true;
+            pathTime += nodes_[i]->duration;
+        }
+        for (const auto& node : nodes_) {
+            work += node->duration;
+        }
+
+        out << std::fixed << std::setprecision(3);
+        out << "Граф задач: " << size() << " узлов, по стене " << wall_ * 1e3 << " мс, работа " << work * 1e3
+            << " мс, критический путь " << pathTime * 1e3 << " мс\n";
+        for (int i = 0; i < size(); i++) {
+            const Node& node = *nodes_[i];
+            out << (critical[i] ? "  * " : "    ") << std::left << std::setw(20) << node.name << std::right
+                << " начало " << std::setw(10) << node.start * 1e3 << " мс, длительность " << std::setw(10) << node.duration * 1e3 << " мс"
+                << (node.failed ? " (ошибка)" : "") << '\n';
+        }
+        out << std::defaultfloat;
+    }
+
+private:
+    struct Node {
+        const char* name = "";
+        std::function<void()> body;
+        std::vector<int> dependencies;
+        std::vector<int> dependents;
+        std::atomic<int> waiting{ 0 }; // Число ещё не выполненных зависимостей
+        bool failed = false;
+        double start = 0.0; // с от начала запуска
+        double duration = 0.0;
+    };
+
+    void execute(int index, ThreadPool* pool) {
+        Node& node = *nodes_[index];
+        for (int dependency : node.dependencies) {
+            node.failed = node.failed || nodes_[dependency]->failed;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!node.failed) {
+            try {
+                ProfileScope profile(node.name);
+                node.body();
+            }
+            catch (...) {
+                node.failed = true;
+                std::lock_guard<std::mutex> lock(errorMutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        node.start = std::chrono::duration<double>(start - origin_).count();
+        node.duration = std::chrono::duration<double>(end - start).count();
+
+        // Последняя выполненная зависимость ставит узел в очередь; acq_rel упорядочивает запись результатов
+        if (pool != nullptr) {
+            for (int dependent : node.dependents) {
+                if (nodes_[dependent]->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    pool->submit([this, dependent, pool] { execute(dependent, pool); });
+                }
+            }
+        }
+        remaining_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::atomic<int> remaining_{ 0 };
+    std::mutex errorMutex_;
+    std::exception_ptr error_;
+    std::chrono::steady_clock::time_point origin_;
+    double wall_ = 0.0;
+};
+
+// Порог работы (в элементах), ниже которого операция выполняется в одном потоке
+constexpr std::size_t ParallelMinElements = 1 << 16;
+
+// Рабочая область для временных буферов операций.
+// Память берётся из крупных выровненных блоков сдвигом указателя и возвращается целиком
+// при выходе из области WorkspaceScope, поэтому повторные вызовы операций не обращаются к куче.
+class Workspace {
+public:
+    Workspace() = default;
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    ~Workspace() {
+        for (Chunk& chunk : chunks_) {
+            freeAligned(chunk.data);
+        }
+    }
+
+    // Выделение буфера под count элементов типа T с выравниванием MatrixAlignment
+    template <typename T>
+    T* allocate(std::size_t count) {
+        static_assert(alignof(T) <= MatrixAlignment, "Тип требует выравнивания больше MatrixAlignment");
+        std::size_t slots = (count * sizeof(T) + MatrixAlignment - 1) / MatrixAlignment * (MatrixAlignment / sizeof(double));
+        while (current_ < chunks_.size() && chunks_[current_].used + slots > chunks_[current_].capacity) {
+            current_++;
+        }
+        if (current_ == chunks_.size()) {
+            std::size_t capacity = (std::max)(slots, chunks_.empty() ? MinChunkSize : chunks_.back().capacity * 2);
+            chunks_.push_back(Chunk{ allocateAligned(capacity), capacity, 0 });
+        }
+        Chunk& chunk = chunks_[current_];
+        double* result = chunk.data + chunk.used;
+        chunk.used += slots;
+        return reinterpret_cast<T*>(result);
+    }
+
+    // Временная матрица rows x cols (строки подряд), живущая до выхода из текущей области
+    template <typename T = double>
+    BasicMatrixView<T> allocateMatrix(int rows, int cols) {
+        return BasicMatrixView<T>(allocate<T>(static_cast<std::size_t>(rows) * cols), rows, cols, cols);
+    }
+
+    // Позиция вершины рабочей области для последующего отката
+    struct Mark {
+        std::size_t chunk;
+        std::size_t used;
+    };
+
+    Mark mark() const {
+        return Mark{ current_, current_ < chunks_.size() ? chunks_[current_].used : 0 };
+    }
+
+    void release(Mark mark) {
+        for (std::size_t i = mark.chunk + 1; i < chunks_.size(); i++) {
+            chunks_[i].used = 0;
+        }
+        if (mark.chunk < chunks_.size()) {
+            chunks_[mark.chunk].used = mark.used;
+        }
+        current_ = mark.chunk;
+    }
+
+    // Освобождение всех буферов; занятая память остаётся за рабочей областью
+    void reset() { release(Mark{ 0, 0 }); }
+
+    // Общий объём памяти, принадлежащей рабочей области (в байтах)
+    std::size_t capacityBytes() const {
+        std::size_t total = 0;
+        for (const Chunk& chunk : chunks_) {
+            total += chunk.capacity * sizeof(double);
+        }
+        return total;
+    }
+
+private:
+    static constexpr std::size_t MinChunkSize = 1 << 16; // 512 КБ
+
+    struct Chunk {
+        double* data;
+        std::size_t capacity; // В элементах double
+        std::size_t used;
+    };
+
+    std::vector<Chunk> chunks_;
+    std::size_t current_ = 0;
+};
+
+// Область использования рабочей области: всё выделенное внутри неё освобождается в деструкторе.
+// Области вкладываются друг в друга как стек, поэтому поток, выполняющий чужую задачу во время
+// ожидания параллельного цикла, может пользоваться той же рабочей областью.
+class WorkspaceScope {
+public:
+    explicit WorkspaceScope(Workspace& workspace) : workspace_(workspace), mark_(workspace.mark()) {}
+    WorkspaceScope(const WorkspaceScope&) = delete;
+    WorkspaceScope& operator=(const WorkspaceScope&) = delete;
+    ~WorkspaceScope() { workspace_.release(mark_); }
+
+private:
+    Workspace& workspace_;
+    Workspace::Mark mark_;
+};
+
+// Рабочая область текущего потока
+Workspace& threadWorkspace() {
+    thread_local Workspace workspace;
+    return workspace;
+}
+
+// Проверка результатов на переполнение без ветвлений во внутренних циклах вычислений: ядра работают
+// на полной скорости SIMD, а затем один векторизуемый проход ищет в результате бесконечности и NaN
+// (показатель степени из одних единиц). Флаги FE_OVERFLOW/FE_INVALID из <cfenv> для этого не подходят:
+// они свои у каждого потока пула, а без поддержки FENV_ACCESS компилятор может переставлять операции
+// относительно их сброса и проверки.
+
+// Признак бесконечного или NaN элемента в массиве: сравнение показателя степени без ветвлений
+bool anyNonFiniteScalar(const double* values, std::size_t count) {
+    constexpr std::uint64_t ExponentMask = 0x7FF0000000000000ull;
+    std::uint64_t nonFinite = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        std::uint64_t bits;
+        std::memcpy(&bits, values + i, sizeof(bits));
+        nonFinite |= static_cast<std::uint64_t>((bits & ExponentMask) == ExponentMask);
+    }
+    return nonFinite != 0;
+}
+
+#if P2_X86
+P2_TARGET_AVX2
+bool anyNonFiniteAvx2(const double* values, std::size_t count) {
+    const __m256d infinity = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d flags = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d magnitude = _mm256_andnot_pd(signMask, _mm256_loadu_pd(values + i));
+        flags = _mm256_or_pd(flags, _mm256_cmp_pd(magnitude, infinity, _CMP_NLT_UQ)); // |x| >= inf или NaN
+    }
+    return _mm256_movemask_pd(flags) != 0 || anyNonFiniteScalar(values + i, count - i);
+}
+#endif
+
+// Функция выбора ядра поиска неконечных элементов по возможностям процессора
+using NonFiniteScan = bool (*)(const double* values, std::size_t count);
+
+NonFiniteScan nonFiniteScan() {
+    static const NonFiniteScan scan = [] {
+#if P2_X86
+        if (cpuFeatures().avx2) {
+            return static_cast<NonFiniteScan>(anyNonFiniteAvx2);
+        }
+#endif
+        return static_cast<NonFiniteScan>(anyNonFiniteScalar);
+    }();
+    return scan;
+}
+
+// Номер первого бесконечного или NaN элемента массива; count, если все элементы конечны.
+// Массив просматривается блоками, поэлементный поиск идёт только внутри блока с находкой.
+std::size_t findNonFinite(const double* values, std::size_t count) {
+    constexpr std::size_t Block = 512;
+    NonFiniteScan scan = nonFiniteScan();
+    for (std::size_t start = 0; start < count; start += Block) {
+        std::size_t length = (std::min)(Block, count - start);
+        if (!scan(values + start, length)) {
+            continue;
+        }
+        for (std::size_t i = start; i < start + length; i++) {
+            if (!std::isfinite(values[i])) {
+                return i;
+            }
+        }
+    }
+    return count;
+}
+
+// Исключение переполнения с положением первого неконечного элемента результата
+[[noreturn]] void throwOverflow(const char* message, int row, int col) {
+    throw std::overflow_error(std::string(message) + " в элементе [" + std::to_string(row) + "][" + std::to_string(col) + "]");
+}
+
+// Проверка строк [rowBegin, rowEnd) результата; при бесконечности или NaN - overflow_error с сообщением message
+void checkFiniteRows(ConstMatrixView result, int rowBegin, int rowEnd, const char* message) {
+    for (int i = rowBegin; i < rowEnd; i++) {
+        if (result.hasContiguousRows()) {
+            std::size_t j = findNonFinite(result.rowData(i), static_cast<std::size_t>(result.cols()));
+            if (j < static_cast<std::size_t>(result.cols())) {
+                throwOverflow(message, i, static_cast<int>(j));
+            }
+            continue;
+        }
+        for (int j = 0; j < result.cols(); j++) {
+            if (!std::isfinite(result(i, j))) {
+                throwOverflow(message, i, j);
+            }
+        }
+    }
+}
+
+// Параметры блочного умножения: блок A (GemmMC x GemmKC) помещается в L2, панель B (GemmKC x GemmNC) - в L3
+constexpr int GemmMC = 96;
+constexpr int GemmKC = 256;
+constexpr int GemmNC = 2048;
+
+// Ширина плитки C, обрабатываемой одной задачей в параллельном режиме (кратна nr всех микроядер)
+constexpr int GemmTileNC = 256;
+
+// Выше этого числа умножений-сложений произведение делится на плитки между потоками
+constexpr double GemmParallelWork = 128.0 * 128.0 * 128.0;
+
+// Ниже этого числа умножений-сложений упаковка не окупается и используется простой цикл
+constexpr double GemmSmallWork = 32.0 * 32.0 * 32.0;
+
+// Микроядро: C[mr x nr] += A_packed[mr x kc] * B_packed[kc x nr]
+using GemmMicroKernel = void (*)(int kc, const double* a, const double* b, double* c, std::ptrdiff_t ldc);
+
+struct GemmKernel {
+    int mr; // Число строк блока C, считаемых микроядром
+    int nr; // Число столбцов блока C, считаемых микроядром
+    GemmMicroKernel compute;
+    const char* name;
+};
+
+// Переносимое микроядро 4x4 без явных SIMD-инструкций
+void gemmKernelScalar(int kc, const double* a, const double* b, double* c, std::ptrdiff_t ldc) {
+    double acc[4][4] = {};
+    for (int k = 0; k < kc; k++) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += 4;
+        b += 4;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            c[i * ldc + j] += acc[i][j];
+        }
+    }
+}
+
+#if P2_X86
+// Микроядро AVX2/FMA 6x8: 12 регистров-аккумуляторов, 2 регистра под строку B
+P2_TARGET_AVX2
+void gemmKernelAvx2(int kc, const double* a, const double* b, double* c, std::ptrdiff_t ldc) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for (int k = 0; k < kc; k++) {
+        __m256d b0 = _mm256_load_pd(b);
+        __m256d b1 = _mm256_load_pd(b + 4);
+        __m256d ai = _mm256_broadcast_sd(a);
+        c00 = _mm256_fmadd_pd(ai, b0, c00);
+        c01 = _mm256_fmadd_pd(ai, b1, c01);
+        ai = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(ai, b0, c10);
+        c11 = _mm256_fmadd_pd(ai, b1, c11);
+        ai = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(ai, b0, c20);
+        c21 = _mm256_fmadd_pd(ai, b1, c21);
+        ai = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(ai, b0, c30);
+        c31 = _mm256_fmadd_pd(ai, b1, c31);
+        ai = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_fmadd_pd(ai, b0, c40);
+        c41 = _mm256_fmadd_pd(ai, b1, c41);
+        ai = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_fmadd_pd(ai, b0, c50);
+        c51 = _mm256_fmadd_pd(ai, b1, c51);
+        a += 6;
+        b += 8;
+    }
+
+    double* row = c;
+    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c00));
+    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c01));
+    row += ldc;
+    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c10));
+    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c11));
+    row += ldc;
+    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c20));
+    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c21));
+    row += ldc;
+    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c30));
+    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c31));
+    row += ldc;
+    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c40));
+    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c41));
+    row += ldc;
+    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), c50));
+    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), c51));
+}
+
+// Микроядро AVX-512 8x16: 16 регистров-аккумуляторов, 2 регистра под строку B
+P2_TARGET_AVX512
+void gemmKernelAvx512(int kc, const double* a, const double* b, double* c, std::ptrdiff_t ldc) {
+    __m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+    __m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+    __m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+    __m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+    __m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+    __m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+    __m512d c60 = _mm512_setzero_pd(), c61 = _mm512_setzero_pd();
+    __m512d c70 = _mm512_setzero_pd(), c71 = _mm512_setzero_pd();
+
+    for (int k = 0; k < kc; k++) {
+        __m512d b0 = _mm512_load_pd(b);
+        __m512d b1 = _mm512_load_pd(b + 8);
+        __m512d ai = _mm512_set1_pd(a[0]);
+        c00 = _mm512_fmadd_pd(ai, b0, c00);
+        c01 = _mm512_fmadd_pd(ai, b1, c01);
+        ai = _mm512_set1_pd(a[1]);
+        c10 = _mm512_fmadd_pd(ai, b0, c10);
+        c11 = _mm512_fmadd_pd(ai, b1, c11);
+        ai = _mm512_set1_pd(a[2]);
+        c20 = _mm512_fmadd_pd(ai, b0, c20);
+        c21 = _mm512_fmadd_pd(ai, b1, c21);
+        ai = _mm512_set1_pd(a[3]);
+        c30 = _mm512_fmadd_pd(ai, b0, c30);
+        c31 = _mm512_fmadd_pd(ai, b1, c31);
+        ai = _mm512_set1_pd(a[4]);
+        c40 = _mm512_fmadd_pd(ai, b0, c40);
+        c41 = _mm512_fmadd_pd(ai, b1, c41);
+        ai = _mm512_set1_pd(a[5]);
+        c50 = _mm512_fmadd_pd(ai, b0, c50);
+        c51 = _mm512_fmadd_pd(ai, b1, c51);
+        ai = _mm512_set1_pd(a[6]);
+        c60 = _mm512_fmadd_pd(ai, b0, c60);
+        c61 = _mm512_fmadd_pd(ai, b1, c61);
+        ai = _mm512_set1_pd(a[7]);
+        c70 = _mm512_fmadd_pd(ai, b0, c70);
+        c71 = _mm512_fmadd_pd(ai, b1, c71);
+        a += 8;
+        b += 16;
+    }
+
+    double* row = c;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c00));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c01));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c10));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c11));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c20));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c21));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c30));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c31));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c40));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c41));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c50));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c51));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c60));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c61));
+    row += ldc;
+    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), c70));
+    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), c71));
+}
+#endif
+
+// Функция выбора микроядра по возможностям процессора (выбор выполняется один раз)
+const GemmKernel& gemmKernel() {
+    static const GemmKernel kernel = [] {
+#if P2_X86
+        const CpuFeatures& features = cpuFeatures();
+        if (features.avx512f) {
+            return GemmKernel{ 8, 16, gemmKernelAvx512, "avx512" };
+        }
+        if (features.avx2 && features.fma) {
+            return GemmKernel{ 6, 8, gemmKernelAvx2, "avx2-fma" };
+        }
+#endif
+        return GemmKernel{ 4, 4, gemmKernelScalar, "scalar" };
+    }();
+    return kernel;
+}
+
+// Буфер упакованных данных, переиспользуемый между вызовами в пределах потока
+struct PackBuffer {
+    double* data = nullptr;
+    std::size_t capacity = 0;
+
+    PackBuffer() = default;
+    PackBuffer(const PackBuffer&) = delete;
+    PackBuffer& operator=(const PackBuffer&) = delete;
+    ~PackBuffer() { freeAligned(data); }
+
+    double* reserve(std::size_t count) {
+        if (count > capacity) {
+            freeAligned(data);
+            data = allocateAligned(count);
+            capacity = count;
+        }
+        return data;
+    }
+};
+
+// Буфер упаковки B, выдаваемый на время одного умножения. Поток, ожидающий параллельный цикл,
+// может взять задачу другого умножения, поэтому единственный thread_local буфер здесь не подходит.
+class PackBufferLease {
+public:
+    PackBufferLease() {
+        std::vector<std::unique_ptr<PackBuffer>>& freeBuffers = freeList();
+        if (freeBuffers.empty()) {
+            buffer_ = std::make_unique<PackBuffer>();
+        }
+        else {
+            buffer_ = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+
+    PackBufferLease(const PackBufferLease&) = delete;
+    PackBufferLease& operator=(const PackBufferLease&) = delete;
+    ~PackBufferLease() { freeList().push_back(std::move(buffer_)); }
+
+    PackBuffer* operator->() { return buffer_.get(); }
+
+private:
+    static std::vector<std::unique_ptr<PackBuffer>>& freeList() {
+        thread_local std::vector<std::unique_ptr<PackBuffer>> buffers;
+        return buffers;
+    }
+
+    std::unique_ptr<PackBuffer> buffer_;
+};
+
+// Упаковка блока A[mc x kc] в полосы по mr строк: внутри полосы элементы идут по k, затем по строкам.
+// Недостающие строки последней полосы дополняются нулями, чтобы микроядро всегда работало с полным блоком.
+// Элементы при упаковке умножаются на alpha.
+void packA(ConstMatrixView a, int mc, int kc, int mr, double alpha, double* packed) {
+    for (int ir = 0; ir < mc; ir += mr) {
+        int rowsInPanel = (std::min)(mr, mc - ir);
+        for (int k = 0; k < kc; k++) {
+            for (int r = 0; r < rowsInPanel; r++) {
+                packed[r] = alpha * a(ir + r, k);
+            }
+            for (int r = rowsInPanel; r < mr; r++) {
+                packed[r] = 0.0;
+            }
+            packed += mr;
+        }
+    }
+}
+
+// Упаковка блока B[kc x nc] в полосы по nr столбцов: строка полосы из nr элементов лежит подряд
+void packB(ConstMatrixView b, int kc, int nc, int nr, double* packed) {
+    for (int jr = 0; jr < nc; jr += nr) {
+        int colsInPanel = (std::min)(nr, nc - jr);
+        for (int k = 0; k < kc; k++) {
+            if (b.hasContiguousRows()) {
+                const double* source = b.rowData(k) + jr;
+                std::copy(source, source + colsInPanel, packed);
+            }
+            else {
+                for (int j = 0; j < colsInPanel; j++) {
+                    packed[j] = b(k, jr + j);
+                }
+            }
+            for (int j = colsInPanel; j < nr; j++) {
+                packed[j] = 0.0;
+            }
+            packed += nr;
+        }
+    }
+}
+
+// Макроядро: проход микроядром по упакованным блокам A[mc x kc] и B[kc x nc]; C += A * B
+void gemmMacroKernel(const GemmKernel& kernel, int mc, int nc, int kc, const double* packedA, const double* packedB, double* c, std::ptrdiff_t ldc) {
+    alignas(MatrixAlignment) double edge[16 * 16]; // Временный блок для неполных краевых блоков C
+    for (int jr = 0; jr < nc; jr += kernel.nr) {
+        int cols = (std::min)(kernel.nr, nc - jr);
+        const double* panelB = packedB + static_cast<std::size_t>(jr) * kc;
+        for (int ir = 0; ir < mc; ir += kernel.mr) {
+            int rows = (std::min)(kernel.mr, mc - ir);
+            const double* panelA = packedA + static_cast<std::size_t>(ir) * kc;
+            double* block = c + ir * ldc + jr;
+            if (rows == kernel.mr && cols == kernel.nr) {
+                kernel.compute(kc, panelA, panelB, block, ldc);
+            }
+            else {
+                std::fill(edge, edge + kernel.mr * kernel.nr, 0.0);
+                kernel.compute(kc, panelA, panelB, edge, kernel.nr);
+                for (int i = 0; i < rows; i++) {
+                    for (int j = 0; j < cols; j++) {
+                        block[i * ldc + j] += edge[i * kernel.nr + j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Функция матричного умножения C += alpha * A * B с упаковкой операндов и блочным разбиением под кэш.
+// Множитель alpha применяется при упаковке A. Матрица C должна хранить строки подряд;
+// размеры операндов должны быть согласованы.
+void gemmAccumulate(ConstMatrixView a, ConstMatrixView b, MatrixView c, double alpha = 1.0) {
+    int m = a.rows();
+    int k = a.cols();
+    int n = b.cols();
+    if (m == 0 || n == 0 || k == 0) {
+        return;
+    }
+
+    // Малые произведения: простой цикл i-k-j без упаковки
+    if (static_cast<double>(m) * n * k <= GemmSmallWork) {
+        for (int i = 0; i < m; i++) {
+            double* cRow = c.rowData(i);
+            for (int p = 0; p < k; p++) {
+                double aValue = alpha * a(i, p);
+                for (int j = 0; j < n; j++) {
+                    cRow[j] += aValue * b(p, j);
+                }
+            }
+        }
+        return;
+    }
+
+    const GemmKernel& kernel = gemmKernel();
+    PackBufferLease bufferB;
+    double* packedB = bufferB->reserve(static_cast<std::size_t>(GemmNC + kernel.nr) * GemmKC);
+
+    ThreadPool& pool = threadPool();
+    bool parallel = pool.size() > 1 && static_cast<double>(m) * n * k > GemmParallelWork;
+
+    for (int jc = 0; jc < n; jc += GemmNC) {
+        int nc = (std::min)(GemmNC, n - jc);
+        int panelsB = (nc + kernel.nr - 1) / kernel.nr;
+        int rowBlocks = (m + GemmMC - 1) / GemmMC;
+        int colBlocks = (nc + GemmTileNC - 1) / GemmTileNC;
+
+        for (int pc = 0; pc < k; pc += GemmKC) {
+            int kc = (std::min)(GemmKC, k - pc);
+
+            // Упаковка панели B: полосы по nr столбцов независимы
+            auto packPanels = [&](int first, int last) {
+                int col = first * kernel.nr;
+                int width = (std::min)(nc, last * kernel.nr) - col;
+                packB(b.submatrix(pc, jc + col, kc, width), kc, width, kernel.nr, packedB + static_cast<std::size_t>(col) * kc);
+            };
+
+            // Плитка C[GemmMC x GemmTileNC]: упаковка своего блока A и проход макроядром.
+            // Плитки не пересекаются, а порядок суммирования по k внутри элемента фиксирован,
+            // поэтому результат не зависит от числа потоков и распределения плиток.
+            auto computeTiles = [&](int first, int last) {
+                thread_local PackBuffer bufferA;
+                double* packedA = bufferA.reserve(static_cast<std::size_t>(GemmMC + kernel.mr) * GemmKC);
+                for (int tile = first; tile < last; tile++) {
+                    int ic = (tile / colBlocks) * GemmMC;
+                    int jt = (tile % colBlocks) * GemmTileNC;
+                    int mc = (std::min)(GemmMC, m - ic);
+                    int width = (std::min)(GemmTileNC, nc - jt);
+                    packA(a.submatrix(ic, pc, mc, kc), mc, kc, kernel.mr, alpha, packedA);
+                    gemmMacroKernel(kernel, mc, width, kc, packedA, packedB + static_cast<std::size_t>(jt) * kc,
+                        c.rowData(ic) + jc + jt, c.rowStride());
+                }
+            };
+
+            if (parallel) {
+                pool.parallelFor(0, panelsB, (std::max)(1, panelsB / (4 * pool.size())), packPanels);
+                pool.parallelFor(0, rowBlocks * colBlocks, 1, computeTiles);
+            }
+            else {
+                packPanels(0, panelsB);
+                computeTiles(0, rowBlocks * colBlocks);
+            }
+        }
+    }
+}
+
+// Сторона блока, на котором рекурсивное транспонирование переходит к прямому копированию.
+// Блок источника и блок результата (2 x 32 x 32 x 8 байт = 16 КБ) вместе помещаются в L1.
+constexpr int TransposeLeafSize = 32;
+
+// Транспонирование блока 4x4 в регистрах: src - строки по 4 элемента с шагом lds, dst - с шагом ldd
+void transposeBlock4Scalar(const double* src, std::ptrdiff_t lds, double* dst, std::ptrdiff_t ldd) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            dst[j * ldd + i] = src[i * lds + j];
+        }
+    }
+}
+
+#if P2_X86
+P2_TARGET_AVX2
+void transposeBlock4Avx(const double* src, std::ptrdiff_t lds, double* dst, std::ptrdiff_t ldd) {
+    __m256d r0 = _mm256_loadu_pd(src);
+    __m256d r1 = _mm256_loadu_pd(src + lds);
+    __m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+    __m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1); // r0[0] r1[0] r0[2] r1[2]
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1); // r0[1] r1[1] r0[3] r1[3]
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+// Транспонирование блока 8x8 в регистрах AVX-512
+P2_TARGET_AVX512
+void transposeBlock8Avx512(const double* src, std::ptrdiff_t lds, double* dst, std::ptrdiff_t ldd) {
+    __m512d r0 = _mm512_loadu_pd(src);
+    __m512d r1 = _mm512_loadu_pd(src + lds);
+    __m512d r2 = _mm512_loadu_pd(src + 2 * lds);
+    __m512d r3 = _mm512_loadu_pd(src + 3 * lds);
+    __m512d r4 = _mm512_loadu_pd(src + 4 * lds);
+    __m512d r5 = _mm512_loadu_pd(src + 5 * lds);
+    __m512d r6 = _mm512_loadu_pd(src + 6 * lds);
+    __m512d r7 = _mm512_loadu_pd(src + 7 * lds);
+
+    // Все перестановки выполняются одной инструкцией vpermt2pd с двумя источниками
+    const __m512i evenColumns = _mm512_set_epi64(14, 6, 12, 4, 10, 2, 8, 0);
+    const __m512i oddColumns = _mm512_set_epi64(15, 7, 13, 5, 11, 3, 9, 1);
+    const __m512i lowPairs = _mm512_set_epi64(13, 12, 5, 4, 9, 8, 1, 0);
+    const __m512i highPairs = _mm512_set_epi64(15, 14, 7, 6, 11, 10, 3, 2);
+    const __m512i lowHalves = _mm512_set_epi64(11, 10, 9, 8, 3, 2, 1, 0);
+    const __m512i highHalves = _mm512_set_epi64(15, 14, 13, 12, 7, 6, 5, 4);
+
+    // Пары строк: чётные и нечётные столбцы
+    __m512d t0 = _mm512_permutex2var_pd(r0, evenColumns, r1);
+    __m512d t1 = _mm512_permutex2var_pd(r0, oddColumns, r1);
+    __m512d t2 = _mm512_permutex2var_pd(r2, evenColumns, r3);
+    __m512d t3 = _mm512_permutex2var_pd(r2, oddColumns, r3);
+    __m512d t4 = _mm512_permutex2var_pd(r4, evenColumns, r5);
+    __m512d t5 = _mm512_permutex2var_pd(r4, oddColumns, r5);
+    __m512d t6 = _mm512_permutex2var_pd(r6, evenColumns, r7);
+    __m512d t7 = _mm512_permutex2var_pd(r6, oddColumns, r7);
+
+    // Четвёрки строк: столбцы j и j + 4 в двух половинах регистра
+    __m512d u0 = _mm512_permutex2var_pd(t0, lowPairs, t2);  // столбцы 0 и 4, строки 0-3
+    __m512d u1 = _mm512_permutex2var_pd(t0, highPairs, t2); // столбцы 2 и 6
+    __m512d u2 = _mm512_permutex2var_pd(t1, lowPairs, t3);  // столбцы 1 и 5
+    __m512d u3 = _mm512_permutex2var_pd(t1, highPairs, t3); // столбцы 3 и 7
+    __m512d u4 = _mm512_permutex2var_pd(t4, lowPairs, t6);  // столбцы 0 и 4, строки 4-7
+    __m512d u5 = _mm512_permutex2var_pd(t4, highPairs, t6);
+    __m512d u6 = _mm512_permutex2var_pd(t5, lowPairs, t7);
+    __m512d u7 = _mm512_permutex2var_pd(t5, highPairs, t7);
+
+    // Соединение половин строк 0-3 и 4-7
+    _mm512_storeu_pd(dst, _mm512_permutex2var_pd(u0, lowHalves, u4));
+    _mm512_storeu_pd(dst + ldd, _mm512_permutex2var_pd(u2, lowHalves, u6));
+    _mm512_storeu_pd(dst + 2 * ldd, _mm512_permutex2var_pd(u1, lowHalves, u5));
+    _mm512_storeu_pd(dst + 3 * ldd, _mm512_permutex2var_pd(u3, lowHalves, u7));
+    _mm512_storeu_pd(dst + 4 * ldd, _mm512_permutex2var_pd(u0, highHalves, u4));
+    _mm512_storeu_pd(dst + 5 * ldd, _mm512_permutex2var_pd(u2, highHalves, u6));
+    _mm512_storeu_pd(dst + 6 * ldd, _mm512_permutex2var_pd(u1, highHalves, u5));
+    _mm512_storeu_pd(dst + 7 * ldd, _mm512_permutex2var_pd(u3, highHalves, u7));
+}
+#endif
+
+// Микроядро транспонирования квадратного блока size x size в регистрах
+struct TransposeKernel {
+    int size;
+    void (*compute)(const double* src, std::ptrdiff_t lds, double* dst, std::ptrdiff_t ldd);
+};
+
+// Функция выбора микроядра транспонирования по возможностям процессора
+const TransposeKernel& transposeKernel() {
+    static const TransposeKernel kernel = [] {
+#if P2_X86
+        const CpuFeatures& features = cpuFeatures();
+        if (features.avx512f) {
+            return TransposeKernel{ 8, transposeBlock8Avx512 };
+        }
+        if (features.avx2) {
+            return TransposeKernel{ 4, transposeBlock4Avx };
+        }
+#endif
+        return TransposeKernel{ 4, transposeBlock4Scalar };
+    }();
+    return kernel;
+}
+
+// Транспонирование листового блока: целые блоки микроядром, остаток - поэлементно
+void transposeLeaf(ConstMatrixView src, MatrixView dst) {
+    int rows = src.rows();
+    int cols = src.cols();
+    if (!src.hasContiguousRows() || !dst.hasContiguousRows()) {
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                dst(j, i) = src(i, j);
+            }
+        }
+        return;
+    }
+
+    const TransposeKernel& kernel = transposeKernel();
+    int fullRows = rows - rows % kernel.size;
+    int fullCols = cols - cols % kernel.size;
+    for (int i = 0; i < fullRows; i += kernel.size) {
+        for (int j = 0; j < fullCols; j += kernel.size) {
+            kernel.compute(src.rowData(i) + j, src.rowStride(), dst.rowData(j) + i, dst.rowStride());
+        }
+    }
+    for (int i = 0; i < rows; i++) {
+        const double* srcRow = src.rowData(i);
+        int firstCol = i < fullRows ? fullCols : 0;
+        for (int j = firstCol; j < cols; j++) {
+            dst(j, i) = srcRow[j];
+        }
+    }
+}
+
+// Кэш-независимое транспонирование: большая сторона делится пополам, пока блок не станет листовым.
+// На каждом уровне рекурсии блоки источника и результата уменьшаются вдвое, поэтому
+// начиная с некоторого уровня они помещаются в кэш любого размера.
+void transposeRecursive(ConstMatrixView src, MatrixView dst) {
+    int rows = src.rows();
+    int cols = src.cols();
+    if (rows <= TransposeLeafSize && cols <= TransposeLeafSize) {
+        transposeLeaf(src, dst);
+        return;
+    }
+    if (rows >= cols) {
+        int half = (rows / 2 + 7) / 8 * 8; // Граница кратна 8, чтобы листья делились на целые блоки микроядра
+        transposeRecursive(src.submatrix(0, 0, half, cols), dst.submatrix(0, 0, cols, half));
+        transposeRecursive(src.submatrix(half, 0, rows - half, cols), dst.submatrix(0, half, cols, rows - half));
+    }
+    else {
+        int half = (cols / 2 + 7) / 8 * 8;
+        transposeRecursive(src.submatrix(0, 0, rows, half), dst.submatrix(0, 0, half, rows));
+        transposeRecursive(src.submatrix(0, half, rows, cols - half), dst.submatrix(half, 0, cols - half, rows));
+    }
+}
+
+// Функция транспонирования матрицы src в заранее выделенную матрицу dst (dst имеет размер cols x rows)
+void transposeInto(ConstMatrixView src, MatrixView dst) {
+    if (dst.rows() != src.cols() || dst.cols() != src.rows()) {
+        throw std::invalid_argument("Размер результата транспонирования не совпадает с транспонированным размером матрицы");
+    }
+
+    std::size_t elements = static_cast<std::size_t>(src.rows()) * static_cast<std::size_t>(src.cols());
+    ThreadPool& pool = threadPool();
+    if (elements < ParallelMinElements || pool.size() == 1) {
+        transposeRecursive(src, dst);
+        return;
+    }
+
+    // Полосы строк источника (полосы столбцов результата) независимы и делятся между потоками
+    int bandRows = TransposeLeafSize * 2;
+    int bands = (src.rows() + bandRows - 1) / bandRows;
+    pool.parallelFor(0, bands, 1, [&](int first, int last) {
+        for (int band = first; band < last; band++) {
+            int row = band * bandRows;
+            int height = (std::min)(bandRows, src.rows() - row);
+            transposeRecursive(src.submatrix(row, 0, height, src.cols()), dst.submatrix(0, row, src.cols(), height));
+        }
+    });
+}
+
+// Функция копирования матрицы src в заранее выделенную матрицу dst того же размера
+void copyInto(ConstMatrixView src, MatrixView dst) {
+    if (dst.rows() != src.rows() || dst.cols() != src.cols()) {
+        throw std::invalid_argument("Размер копии не совпадает с размером матрицы");
+    }
+    for (int i = 0; i < src.rows(); i++) {
+        if (src.hasContiguousRows() && dst.hasContiguousRows()) {
+            std::copy(src.rowData(i), src.rowData(i) + src.cols(), dst.rowData(i));
+        }
+        else {
+            for (int j = 0; j < src.cols(); j++) {
+                dst(i, j) = src(i, j);
+            }
+        }
+    }
+}
+
+// Функция для транспонирования матрицы
+Matrix transposeMatrix(ConstMatrixView matrix) {
+    ProfileScope profile("transpose");
+    // Создание новой матрицы для результата транспонирования
+    Matrix transposed(matrix.cols(), matrix.rows());
+    transposeInto(matrix, transposed);
+    return transposed;
+}
+
+// Функция транспонирования квадратной матрицы на месте.
+// Диагональные блоки транспонируются сами в себя, симметричные внедиагональные пары блоков меняются местами.
+void transposeInPlace(MatrixView matrix) {
+    if (matrix.rows() != matrix.cols()) {
+        throw std::invalid_argument("Транспонирование представления на месте возможно только для квадратной матрицы");
+    }
+
+    int n = matrix.rows();
+    int blocks = (n + TransposeLeafSize - 1) / TransposeLeafSize;
+
+    // Блочная строка bi обрабатывает пары (bi, bj) при bj >= bi; пары разных строк не пересекаются
+    auto transposeBlockRows = [&](int first, int last) {
+        alignas(MatrixAlignment) double buffer[TransposeLeafSize * TransposeLeafSize];
+        for (int bi = first; bi < last; bi++) {
+            int row = bi * TransposeLeafSize;
+            int height = (std::min)(TransposeLeafSize, n - row);
+            for (int bj = bi; bj < blocks; bj++) {
+                int col = bj * TransposeLeafSize;
+                int width = (std::min)(TransposeLeafSize, n - col);
+                MatrixView upper = matrix.submatrix(row, col, height, width);
+                MatrixView lower = matrix.submatrix(col, row, width, height);
+                MatrixView saved(buffer, height, width, width);
+
+                // Блок копируется во временный буфер, после чего оба блока пишутся транспонированными
+                for (int i = 0; i < height; i++) {
+                    for (int j = 0; j < width; j++) {
+                        saved(i, j) = upper(i, j);
+                    }
+                }
+                if (bj != bi) {
+                    transposeLeaf(lower, upper);
+                }
+                transposeLeaf(saved, lower);
+            }
+        }
+    };
+
+    if (static_cast<std::size_t>(n) * n >= ParallelMinElements) {
+        threadPool().parallelFor(0, blocks, 1, transposeBlockRows);
+    }
+    else {
+        transposeBlockRows(0, blocks);
+    }
+}
+
+// Функция транспонирования плотной матрицы на месте без второго буфера размера матрицы.
+// Квадратная матрица транспонируется поблочно, прямоугольная - следованием по циклам перестановки:
+// элемент с индексом k = i * cols + j переходит на место j * rows + i. Пройденные позиции отмечаются
+// в битовом массиве, поэтому дополнительная память - один бит на элемент.
+void transposeInPlace(Matrix& matrix) {
+    int rows = matrix.rows();
+    int cols = matrix.cols();
+    if (rows == cols) {
+        transposeInPlace(matrix.view());
+        return;
+    }
+
+    std::size_t total = matrix.size();
+    if (rows > 1 && cols > 1) {
+        double* data = matrix.data();
+        std::vector<bool> visited(total, false);
+        for (std::size_t start = 1; start + 1 < total; start++) {
+            if (visited[start]) {
+                continue;
+            }
+            double carried = data[start];
+            std::size_t current = start;
+            do {
+                std::size_t next = (current % cols) * rows + current / cols;
+                std::swap(carried, data[next]);
+                visited[next] = true;
+                current = next;
+            } while (current != start);
+        }
+    }
+    matrix.reshape(cols, rows);
+}
+
+// Метод вычисления ранга
+enum class RankMethod {
+    Elimination, // Исключение Гаусса с частичным выбором ведущего элемента
+    HouseholderQR // QR-разложение отражениями Хаусхолдера с выбором ведущего столбца
+};
+
+// Параметры вычисления ранга
+struct RankOptions {
+    RankMethod method = RankMethod::Elimination;
+
+    // Относительный порог: ведущий элемент считается нулевым, если он не больше tolerance * масштаб,
+    // где масштаб - максимальный модуль элемента (исключение) или наибольшая норма столбца (QR).
+    // Отрицательное значение означает порог по умолчанию (см. rankThreshold).
+    double tolerance = -1.0;
+
+    // Ширина панели блочного алгоритма (для исключения - ширина листовой панели рекурсии)
+    int blockSize = 32;
+};
+
+// Функция вычисления абсолютного порога по параметрам и масштабу матрицы
+// По умолчанию - max(rows, cols) * eps для обоих методов: тот же порог, что у проверки вырожденности LU,
+// поэтому ранг по умолчанию не расходится с определителем и обратной матрицей.
+// epsilon - машинная точность типа элементов (для float и long double - своя).
+double rankThreshold(const RankOptions& options, int rows, int cols, double scale, double epsilon = std::numeric_limits<double>::epsilon()) {
+    double tolerance = options.tolerance;
+    if (tolerance < 0.0) {
+        tolerance = (std::max)(rows, cols) * epsilon;
+    }
+    return tolerance * scale;
+}
+
+// Запас, в пределах которого наименьший принятый ведущий элемент исключения считается неотличимым от шума:
+// при исключении матриц неполного ранга погрешность в зависимых столбцах копится и иногда поднимается выше
+// порога. У матриц полного ранга без сильной обусловленности ведущие элементы на много порядков больше порога,
+// а при меньшем запасе ранг по умолчанию перепроверяется QR-разложением с выбором ведущего столбца
+constexpr double RankVerifyMargin = 1e6;
+
+// C += A * B для элементов типа T: для double - упакованный GEMM, для остальных типов - построчные
+// обновления (строки B и C должны лежать в памяти подряд)
+template <typename T>
+void accumulateProduct(BasicMatrixView<const T> a, BasicMatrixView<const T> b, BasicMatrixView<T> c) {
+    if constexpr (std::is_same<T, double>::value) {
+        gemmAccumulate(a, b, c);
+    }
+    else {
+        for (int i = 0; i < c.rows(); i++) {
+            T* target = c.rowData(i);
+            for (int k = 0; k < a.cols(); k++) {
+                T factor = a(i, k);
+                const T* source = b.rowData(k);
+                for (int j = 0; j < c.cols(); j++) {
+                    target[j] += factor * source[j];
+                }
+            }
+        }
+    }
+}
+
+// Обновление столбцов [colBegin, colEnd) после исключения по ведущим строкам [firstPivot, rank):
+// U12 = L11^-1 * A12 для строк ведущих элементов и A22 -= L21 * U12 для строк ниже.
+// Множители L лежат в столбцах pivotCols (по одному на ведущую строку).
+template <typename T>
+void updateEliminatedColumns(BasicMatrixView<T> a, int firstPivot, int rank, const int* pivotCols, int colBegin, int colEnd, Workspace& workspace) {
+    int pivots = rank - firstPivot;
+    int width = colEnd - colBegin;
+    if (pivots == 0 || width == 0) {
+        return;
+    }
+
+    // Строки [rowBegin, rowEnd) -= L(строки, ведущие столбцы [pivotBegin, pivotEnd)) * U(строки pivotBegin..pivotEnd).
+    // Множители собираются в плотный блок со знаком минус, дальше работает GEMM.
+    auto subtractProduct = [&](int rowBegin, int rowEnd, int pivotBegin, int pivotEnd) {
+        int height = rowEnd - rowBegin;
+        int depth = pivotEnd - pivotBegin;
+        if (height <= 0 || depth <= 0) {
+            return;
+        }
+        WorkspaceScope scope(workspace);
+        BasicMatrixView<T> negL = workspace.allocateMatrix<T>(height, depth);
+        for (int i = 0; i < height; i++) {
+            const T* row = a.rowData(rowBegin + i);
+            for (int t = 0; t < depth; t++) {
+                negL(i, t) = -row[pivotCols[pivotBegin + t]];
+            }
+        }
+        accumulateProduct<T>(negL, a.submatrix(firstPivot + pivotBegin, colBegin, depth, width), a.submatrix(rowBegin, colBegin, height, width));
+    };
+
+    // Блочная прямая подстановка по строкам ведущих элементов: внутри блока поэлементно,
+    // на строки следующих блоков - через GEMM
+    constexpr int SolveBlock = 32;
+    for (int blockBegin = 0; blockBegin < pivots; blockBegin += SolveBlock) {
+        int blockEnd = (std::min)(pivots, blockBegin + SolveBlock);
+        for (int i = blockBegin + 1; i < blockEnd; i++) {
+            T* target = a.rowData(firstPivot + i) + colBegin;
+            for (int t = blockBegin; t < i; t++) {
+                T factor = a(firstPivot + i, pivotCols[t]);
+                const T* source = a.rowData(firstPivot + t) + colBegin;
+                for (int j = 0; j < width; j++) {
+                    target[j] -= factor * source[j];
+                }
+            }
+        }
+        subtractProduct(firstPivot + blockEnd, rank, blockBegin, blockEnd);
+    }
+
+    subtractProduct(rank, a.rows(), 0, pivots);
+}
+
+// Рекурсивное исключение Гаусса в столбцах [colBegin, colEnd) для строк начиная с rank.
+// Левая половина столбцов исключается рекурсивно, правая обновляется через GEMM и исключается следом,
+// поэтому основная работа и на высоких матрицах идёт в матричном умножении.
+// Поэлементно исключаются только узкие листовые панели шириной не больше blockSize.
+// pivotCols[r] - столбец ведущего элемента строки r (заполняются первые rank элементов).
+template <typename T>
+void eliminateColumns(BasicMatrixView<T> a, int colBegin, int colEnd, double threshold, int blockSize, int& rank, int* pivotCols, Workspace& workspace) {
+    int rows = a.rows();
+    if (rank >= rows || colBegin >= colEnd) {
+        return;
+    }
+
+    if (colEnd - colBegin > blockSize) {
+        int middle = colBegin + (colEnd - colBegin) / 2;
+        int firstPivot = rank;
+        eliminateColumns(a, colBegin, middle, threshold, blockSize, rank, pivotCols, workspace);
+        updateEliminatedColumns(a, firstPivot, rank, pivotCols + firstPivot, middle, colEnd, workspace);
+        eliminateColumns(a, middle, colEnd, threshold, blockSize, rank, pivotCols, workspace);
+        return;
+    }
+
+    int cols = a.cols();
+    for (int col = colBegin; col < colEnd && rank < rows; col++) {
+        // Поиск максимального по модулю элемента в столбце начиная с текущей строки ранга
+        int pivotRow = rank;
+        for (int i = rank + 1; i < rows; i++) {
+            if (std::fabs(a(i, col)) > std::fabs(a(pivotRow, col))) {
+                pivotRow = i;
+            }
+        }
+        if (std::fabs(a(pivotRow, col)) <= threshold) {
+            continue; // Столбец линейно зависим от предыдущих (с точностью до порога)
+        }
+
+        if (pivotRow != rank) {
+            std::swap_ranges(a.rowData(pivotRow), a.rowData(pivotRow) + cols, a.rowData(rank));
+        }
+
+        const T* pivotValues = a.rowData(rank);
+        for (int i = rank + 1; i < rows; i++) {
+            T* current = a.rowData(i);
+            T factor = current[col] / pivotValues[col];
+            current[col] = factor; // Множитель сохраняется для отложенного обновления остальных столбцов
+            for (int j = col + 1; j < colEnd; j++) {
+                current[j] -= factor * pivotValues[j];
+            }
+        }
+        pivotCols[rank] = col;
+        rank++;
+    }
+}
+
+// Ранг блочным исключением Гаусса на месте (матрица a разрушается). В smallestPivot, если он задан,
+// записывается наименьший модуль принятого ведущего элемента (ведущие элементы после исключения не меняются)
+template <typename T>
+int rankByElimination(BasicMatrixView<T> a, double threshold, int blockSize, Workspace& workspace, double* smallestPivot = nullptr) {
+    WorkspaceScope scope(workspace);
+    int rank = 0;
+    int* pivotCols = workspace.allocate<int>((std::min)(a.rows(), a.cols()));
+    eliminateColumns(a, 0, a.cols(), threshold, blockSize, rank, pivotCols, workspace);
+    if (smallestPivot != nullptr) {
+        *smallestPivot = std::numeric_limits<double>::infinity();
+        for (int r = 0; r < rank; r++) {
+            *smallestPivot = (std::min)(*smallestPivot, static_cast<double>(std::fabs(a(r, pivotCols[r]))));
+        }
+    }
+    return rank;
+}
+
+// Ранг QR-разложением с выбором ведущего столбца (блочный вариант в духе LAPACK xLAQPS).
+// Работает с транспонированной копией at = A^T, чтобы столбцы A лежали в памяти подряд.
+// Внутри панели отражения накапливаются в матрице F, и остаток матрицы обновляется
+// одним умножением A22 -= V * F^T; для выбора ведущего столбца поддерживаются частичные нормы столбцов.
+// threshold - абсолютный порог диагонали R; отрицательный - rankThreshold от наибольшей нормы столбца.
+template <typename T>
+int rankByHouseholderQR(BasicMatrixView<T> at, const RankOptions& options, Workspace& workspace, double threshold = -1.0) {
+    int n = at.rows(); // Число столбцов A
+    int m = at.cols(); // Число строк A
+    int steps = (std::min)(m, n);
+    int blockSize = (std::max)(1, options.blockSize);
+
+    WorkspaceScope scope(workspace);
+    T* norms = workspace.allocate<T>(n);         // Частичные нормы столбцов
+    T* exactNorms = workspace.allocate<T>(n);    // Нормы на момент последнего полного пересчёта
+    BasicMatrixView<T> v = workspace.allocateMatrix<T>(blockSize, m); // Векторы Хаусхолдера панели (по строкам)
+    BasicMatrixView<T> f = workspace.allocateMatrix<T>(n, blockSize); // Накопленное произведение F = A^T * V * T
+    T* correction = workspace.allocate<T>(blockSize);
+    int* recompute = workspace.allocate<int>(n);           // Столбцы, нормы которых пересчитываются точно
+    int recomputeCount = 0;
+
+    T maxNorm = 0;
+    for (int j = 0; j < n; j++) {
+        const T* column = at.rowData(j);
+        T sum = 0;
+        for (int i = 0; i < m; i++) {
+            sum += column[i] * column[i];
+        }
+        norms[j] = exactNorms[j] = std::sqrt(sum);
+        maxNorm = (std::max)(maxNorm, norms[j]);
+    }
+
+    if (threshold < 0.0) {
+        threshold = rankThreshold(options, m, n, static_cast<double>(maxNorm), static_cast<double>(std::numeric_limits<T>::epsilon()));
+    }
+    T normTolerance = std::sqrt(std::numeric_limits<T>::epsilon());
+    int rank = 0;
+
+    while (rank < steps) {
+        int offset = rank;
+        int panelSize = 0;
+        bool finished = false;
+        recomputeCount = 0;
+
+        for (int jj = 0; jj < blockSize && offset + jj < steps; jj++) {
+            int k = offset + jj; // Номер текущего отражения и столбца
+
+            // Выбор столбца с наибольшей частичной нормой
+            int pivot = k;
+            for (int j = k + 1; j < n; j++) {
+                if (norms[j] > norms[pivot]) {
+                    pivot = j;
+                }
+            }
+            if (pivot != k) {
+                std::swap_ranges(at.rowData(pivot), at.rowData(pivot) + m, at.rowData(k));
+                std::swap_ranges(f.rowData(pivot), f.rowData(pivot) + jj, f.rowData(k));
+                std::swap(norms[pivot], norms[k]);
+                std::swap(exactNorms[pivot], exactNorms[k]);
+            }
+
+            // Применение отражений панели к столбцу k (строки k..m-1)
+            T* column = at.rowData(k);
+            for (int t = 0; t < jj; t++) {
+                T factor = f(k, t);
+                const T* vt = v.rowData(t);
+                for (int i = k; i < m; i++) {
+                    column[i] -= vt[i] * factor;
+                }
+            }
+
+            // Построение отражения Хаусхолдера для column[k..m-1]
+            T sum = 0;
+            for (int i = k; i < m; i++) {
+                sum += column[i] * column[i];
+            }
+            T norm = std::sqrt(sum);
+            if (norm <= threshold) {
+                finished = true; // Оставшиеся столбцы пренебрежимо малы: ранг найден
+                break;
+            }
+
+            T alpha = column[k];
+            T beta = alpha >= 0 ? -norm : norm;
+            T tau = (beta - alpha) / beta;
+            T scale = T(1) / (alpha - beta);
+            T* vk = v.rowData(jj);
+            std::fill(vk, vk + k, T(0));
+            vk[k] = 1;
+            for (int i = k + 1; i < m; i++) {
+                vk[i] = column[i] * scale;
+            }
+            column[k] = beta; // Диагональный элемент R
+            rank++;
+            panelSize = jj + 1;
+
+            // F(j, jj) = tau * A(k:m, j)^T * v - tau * F(j, 0:jj) * (V(k:m, 0:jj)^T * v) для j > k
+            for (int t = 0; t < jj; t++) {
+                const T* vt = v.rowData(t);
+                T dot = 0;
+                for (int i = k; i < m; i++) {
+                    dot += vt[i] * vk[i];
+                }
+                correction[t] = -tau * dot;
+            }
+            auto updateF = [&](int first, int last) {
+                for (int j = first; j < last; j++) {
+                    const T* aj = at.rowData(j);
+                    T dot = 0;
+                    for (int i = k; i < m; i++) {
+                        dot += aj[i] * vk[i];
+                    }
+                    T value = tau * dot;
+                    for (int t = 0; t < jj; t++) {
+                        value += f(j, t) * correction[t];
+                    }
+                    f(j, jj) = value;
+                }
+            };
+            if (static_cast<std::size_t>(n - k - 1) * static_cast<std::size_t>(m - k) >= ParallelMinElements) {
+                int grain = (std::max)(1, static_cast<int>(ParallelMinElements / 4 / (m - k)));
+                threadPool().parallelFor(k + 1, n, grain, updateF);
+            }
+            else {
+                updateF(k + 1, n);
+            }
+
+            // Обновление строки k остатка: A(k, j) -= V(k, 0:jj+1) * F(j, 0:jj+1)^T
+            for (int j = k + 1; j < n; j++) {
+                T value = 0;
+                for (int t = 0; t <= jj; t++) {
+                    value += v(t, k) * f(j, t);
+                }
+                at(j, k) -= value;
+            }
+
+            // Понижение частичных норм; при сильном сокращении норма пересчитывается после панели
+            for (int j = k + 1; j < n; j++) {
+                if (norms[j] == 0) {
+                    continue;
+                }
+                T ratio = std::fabs(at(j, k)) / norms[j];
+                T remaining = (std::max)(T(0), (T(1) + ratio) * (T(1) - ratio));
+                T drift = remaining * (norms[j] / exactNorms[j]) * (norms[j] / exactNorms[j]);
+                if (drift <= normTolerance) {
+                    recompute[recomputeCount++] = j;
+                }
+                else {
+                    norms[j] *= std::sqrt(remaining);
+                }
+            }
+            if (recomputeCount > 0) {
+                break; // Как в xLAQPS: панель завершается досрочно, нормы пересчитываются точно
+            }
+        }
+
+        if (finished || rank >= steps) {
+            break;
+        }
+
+        // Обновление остатка: A(rank:m, rank:n) -= V(rank:m, 0:panelSize) * F(rank:n, 0:panelSize)^T,
+        // в транспонированном виде at(rank:n, rank:m) -= F * V
+        int trailingCols = n - rank;
+        int trailingRows = m - rank;
+        if (panelSize > 0 && trailingCols > 0 && trailingRows > 0) {
+            BasicMatrixView<T> negF = f.submatrix(rank, 0, trailingCols, panelSize);
+            for (int j = 0; j < trailingCols; j++) {
+                for (int t = 0; t < panelSize; t++) {
+                    negF(j, t) = -negF(j, t);
+                }
+            }
+            accumulateProduct<T>(negF, v.submatrix(0, rank, panelSize, trailingRows), at.submatrix(rank, rank, trailingCols, trailingRows));
+        }
+
+        for (int t = 0; t < recomputeCount; t++) {
+            int j = recompute[t];
+            const T* columnJ = at.rowData(j);
+            T sum = 0;
+            for (int i = rank; i < m; i++) {
+                sum += columnJ[i] * columnJ[i];
+            }
+            norms[j] = exactNorms[j] = std::sqrt(sum);
+        }
+    }
+
+    return rank;
+}
+
+// Доля ненулевых элементов, при которой операции переходят на разреженный путь
+constexpr double SparseDensityThreshold = 0.05;
+
+// Наименьшее число элементов матрицы, начиная с которого проверяется её плотность
+constexpr std::size_t SparseMinElements = 1 << 14;
+
+// Порог выбора ведущего элемента в разреженном исключении: кандидат должен быть не меньше
+// этой доли максимального модуля в столбце
+constexpr double SparsePivotThreshold = 0.1;
+
+// Формат хранения разреженной матрицы
+enum class SparseFormat {
+    Csr, // Сжатые строки: offsets по строкам, indices - номера столбцов
+    Csc // Сжатые столбцы: offsets по столбцам, indices - номера строк
+};
+
+// Разреженная матрица в формате CSR или CSC. Элементы i-й строки (CSR) или i-го столбца (CSC) лежат
+// в values[offsets[i] ... offsets[i + 1]) с возрастающими номерами indices, поэтому память
+// и время операций пропорциональны числу ненулевых элементов, а не rows x cols.
+class SparseMatrix {
+public:
+    SparseMatrix() : offsets_(1, 0) {}
+
+    // Матрица из готовых массивов; структура проверяется
+    SparseMatrix(SparseFormat format, int rows, int cols, std::vector<std::size_t> offsets, std::vector<int> indices, std::vector<double> values)
+        : format_(format), rows_(rows), cols_(cols), offsets_(std::move(offsets)), indices_(std::move(indices)), values_(std::move(values)) {
+        validate();
+    }
+
+    // Ненулевые элементы плотной матрицы
+    static SparseMatrix fromDense(ConstMatrixView matrix, SparseFormat format = SparseFormat::Csr) {
+        SparseMatrix result;
+        result.format_ = SparseFormat::Csr;
+        result.rows_ = matrix.rows();
+        result.cols_ = matrix.cols();
+        result.offsets_.assign(static_cast<std::size_t>(matrix.rows()) + 1, 0);
+        for (int i = 0; i < matrix.rows(); i++) {
+            for (int j = 0; j < matrix.cols(); j++) {
+                double value = matrix(i, j);
+                if (value != 0.0) {
+                    result.indices_.push_back(j);
+                    result.values_.push_back(value);
+                }
+            }
+            result.offsets_[i + 1] = result.values_.size();
+        }
+        return format == SparseFormat::Csr ? result : result.toFormat(format);
+    }
+
+    Matrix toDense() const {
+        Matrix result(rows_, cols_);
+        toDense(result);
+        return result;
+    }
+
+    // Раскладка в заранее выделенную матрицу rows x cols (например, из рабочей области)
+    void toDense(MatrixView result) const {
+        for (int i = 0; i < rows_; i++) {
+            for (int j = 0; j < cols_; j++) {
+                result(i, j) = 0.0;
+            }
+        }
+        for (int i = 0; i < majorSize(); i++) {
+            for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; k++) {
+                if (format_ == SparseFormat::Csr) {
+                    result(i, indices_[k]) = values_[k];
+                }
+                else {
+                    result(indices_[k], i) = values_[k];
+                }
+            }
+        }
+    }
+
+    // Та же матрица в другом формате (перестановка подсчётом за O(rows + cols + ненулевые))
+    SparseMatrix toFormat(SparseFormat format) const;
+
+    SparseFormat format() const { return format_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    std::size_t nonZeros() const { return values_.size(); }
+    double density() const {
+        double size = static_cast<double>(rows_) * cols_;
+        return size > 0.0 ? nonZeros() / size : 0.0;
+    }
+
+    // Число сжатых строк (CSR) или столбцов (CSC) и размер другого измерения
+    int majorSize() const { return format_ == SparseFormat::Csr ? rows_ : cols_; }
+    int minorSize() const { return format_ == SparseFormat::Csr ? cols_ : rows_; }
+
+    const std::vector<std::size_t>& offsets() const { return offsets_; }
+    const std::vector<int>& indices() const { return indices_; }
+    const std::vector<double>& values() const { return values_; }
+
+    // Элемент (i, j) двоичным поиском в сжатой строке или столбце
+    double operator()(int i, int j) const {
+        int major = format_ == SparseFormat::Csr ? i : j;
+        int minor = format_ == SparseFormat::Csr ? j : i;
+        const int* begin = indices_.data() + offsets_[major];
+        const int* end = indices_.data() + offsets_[major + 1];
+        const int* found = std::lower_bound(begin, end, minor);
+        return found != end && *found == minor ? values_[found - indices_.data()] : 0.0;
+    }
+
+private:
+    friend SparseMatrix transposeSparse(const SparseMatrix& matrix);
+
+    void validate() const {
+        if (rows_ < 0 || cols_ < 0) {
+            throw std::invalid_argument("Размеры матрицы не могут быть отрицательными");
+        }
+        if (offsets_.size() != static_cast<std::size_t>(majorSize()) + 1 || offsets_.front() != 0
+            || offsets_.back() != indices_.size() || indices_.size() != values_.size()) {
+            throw std::invalid_argument("Неверная структура разреженной матрицы");
+        }
+        for (int i = 0; i < majorSize(); i++) {
+            if (offsets_[i] > offsets_[i + 1]) {
+                throw std::invalid_argument("Неверная структура разреженной матрицы");
+            }
+            for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; k++) {
+                if (indices_[k] < 0 || indices_[k] >= minorSize() || (k > offsets_[i] && indices_[k] <= indices_[k - 1])) {
+                    throw std::invalid_argument("Номера элементов разреженной матрицы должны возрастать и не выходить за её размеры");
+                }
+            }
+        }
+    }
+
+    SparseFormat format_ = SparseFormat::Csr;
+    int rows_ = 0;
+    int cols_ = 0;
+    std::vector<std::size_t> offsets_;
+    std::vector<int> indices_;
+    std::vector<double> values_;
+};
+
+// Перестановка сжатых массивов подсчётом: из сжатых строк получаются сжатые столбцы той же матрицы.
+// Это одновременно смена формата (CSR <-> CSC) и транспонирование при сохранении формата.
+void transposeCompressed(int majorSize, int minorSize, const std::vector<std::size_t>& offsets, const std::vector<int>& indices, const std::vector<double>& values,
+    std::vector<std::size_t>& resultOffsets, std::vector<int>& resultIndices, std::vector<double>& resultValues) {
+    resultOffsets.assign(static_cast<std::size_t>(minorSize) + 1, 0);
+    resultIndices.resize(indices.size());
+    resultValues.resize(values.size());
+    for (int index : indices) {
+        resultOffsets[index + 1]++;
+    }
+    for (int j = 0; j < minorSize; j++) {
+        resultOffsets[j + 1] += resultOffsets[j];
+    }
+    std::vector<std::size_t> next(resultOffsets.begin(), resultOffsets.end() - 1);
+    for (int i = 0; i < majorSize; i++) {
+        for (std::size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+            std::size_t position = next[indices[k]]++;
+            resultIndices[position] = i;
+            resultValues[position] = values[k];
+        }
+    }
+}
+
+SparseMatrix SparseMatrix::toFormat(SparseFormat format) const {
+    if (format == format_) {
+        return *this;
+    }
+    SparseMatrix result;
+    result.format_ = format;
+    result.rows_ = rows_;
+    result.cols_ = cols_;
+    transposeCompressed(majorSize(), minorSize(), offsets_, indices_, values_, result.offsets_, result.indices_, result.values_);
+    return result;
+}
+
+// Проверка сжатых массивов результата на переполнение (см. findNonFinite)
+void checkFiniteCompressed(SparseFormat format, const std::vector<std::size_t>& offsets, const std::vector<int>& indices, const std::vector<double>& values, const char* message) {
+    std::size_t position = findNonFinite(values.data(), values.size());
+    if (position == values.size()) {
+        return;
+    }
+    int major = static_cast<int>(std::upper_bound(offsets.begin(), offsets.end(), position) - offsets.begin()) - 1;
+    if (format == SparseFormat::Csr) {
+        throwOverflow(message, major, indices[position]);
+    }
+    throwOverflow(message, indices[position], major);
+}
+
+// Функция транспонирования разреженной матрицы (формат результата тот же, что у исходной)
+SparseMatrix transposeSparse(const SparseMatrix& matrix) {
+    ProfileScope profile("sparse transpose");
+    SparseMatrix result;
+    result.format_ = matrix.format();
+    result.rows_ = matrix.cols();
+    result.cols_ = matrix.rows();
+    transposeCompressed(matrix.majorSize(), matrix.minorSize(), matrix.offsets(), matrix.indices(), matrix.values(),
+        result.offsets_, result.indices_, result.values_);
+    return result;
+}
+
+// Матрица в нужном формате: сама матрица или её преобразованная копия в storage
+const SparseMatrix& sparseInFormat(const SparseMatrix& matrix, SparseFormat format, SparseMatrix& storage) {
+    if (matrix.format() == format) {
+        return matrix;
+    }
+    storage = matrix.toFormat(format);
+    return storage;
+}
+
+// Функция проверки, что разреженный путь выгоднее плотного: матрица достаточно велика,
+// а доля ненулевых элементов не больше SparseDensityThreshold (подсчёт прекращается, как только порог превышен)
+bool preferSparse(ConstMatrixView matrix) {
+    std::size_t size = static_cast<std::size_t>(matrix.rows()) * static_cast<std::size_t>(matrix.cols());
+    if (size < SparseMinElements) {
+        return false;
+    }
+    std::size_t limit = static_cast<std::size_t>(SparseDensityThreshold * size);
+    std::size_t count = 0;
+    for (int i = 0; i < matrix.rows(); i++) {
+        for (int j = 0; j < matrix.cols(); j++) {
+            count += matrix(i, j) != 0.0 ? 1 : 0;
+        }
+        if (count > limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Функция сложения разреженных матриц слиянием сжатых строк (формат результата - формат первой матрицы)
+SparseMatrix addSparse(const SparseMatrix& matrix1, const SparseMatrix& other) {
+    if (matrix1.rows() != other.rows() || matrix1.cols() != other.cols()) {
+        throw std::invalid_argument("Матрицы должны иметь одинаковое количество строк и столбцов");
+    }
+    ProfileScope profile("sparse add");
+    profile.addFlops(static_cast<double>(matrix1.nonZeros() + other.nonZeros()));
+
+    SparseMatrix converted;
+    const SparseMatrix& matrix2 = sparseInFormat(other, matrix1.format(), converted);
+    std::vector<std::size_t> offsets(static_cast<std::size_t>(matrix1.majorSize()) + 1, 0);
+    std::vector<int> indices;
+    std::vector<double> values;
+    indices.reserve(matrix1.nonZeros() + matrix2.nonZeros());
+    values.reserve(matrix1.nonZeros() + matrix2.nonZeros());
+
+    const std::vector<int>& indices1 = matrix1.indices();
+    const std::vector<int>& indices2 = matrix2.indices();
+    for (int i = 0; i < matrix1.majorSize(); i++) {
+        std::size_t k1 = matrix1.offsets()[i];
+        std::size_t k2 = matrix2.offsets()[i];
+        std::size_t end1 = matrix1.offsets()[i + 1];
+        std::size_t end2 = matrix2.offsets()[i + 1];
+        while (k1 < end1 || k2 < end2) {
+            if (k2 == end2 || (k1 < end1 && indices1[k1] < indices2[k2])) {
+                indices.push_back(indices1[k1]);
+                values.push_back(matrix1.values()[k1++]);
+            }
+            else if (k1 == end1 || indices2[k2] < indices1[k1]) {
+                indices.push_back(indices2[k2]);
+                values.push_back(matrix2.values()[k2++]);
+            }
+            else {
+                indices.push_back(indices1[k1]);
+                values.push_back(matrix1.values()[k1++] + matrix2.values()[k2++]);
+            }
+        }
+        offsets[i + 1] = values.size();
+    }
+
+    checkFiniteCompressed(matrix1.format(), offsets, indices, values, "Переполнение при сложении элементов матриц");
+    return SparseMatrix(matrix1.format(), matrix1.rows(), matrix1.cols(), std::move(offsets), std::move(indices), std::move(values));
+}
+
+// Функция умножения разреженной матрицы на вектор (SpMV). Строки CSR считаются параллельно,
+// столбцы CSC раскладываются в результат по очереди.
+std::vector<double> multiplySparseVector(const SparseMatrix& matrix, const std::vector<double>& vector) {
+    if (static_cast<int>(vector.size()) != matrix.cols()) {
+        throw std::invalid_argument("Размер вектора должен быть равен количеству столбцов матрицы");
+    }
+    ProfileScope profile("sparse spmv");
+    profile.addFlops(2.0 * matrix.nonZeros());
+
+    std::vector<double> result(matrix.rows(), 0.0);
+    const std::vector<std::size_t>& offsets = matrix.offsets();
+    const std::vector<int>& indices = matrix.indices();
+    const std::vector<double>& values = matrix.values();
+    if (matrix.format() == SparseFormat::Csc) {
+        for (int j = 0; j < matrix.cols(); j++) {
+            double x = vector[j];
+            for (std::size_t k = offsets[j]; k < offsets[j + 1]; k++) {
+                result[indices[k]] += values[k] * x;
+            }
+        }
+        return result;
+    }
+
+    auto multiplyRows = [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            double sum = 0.0;
+            for (std::size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+                sum += values[k] * vector[indices[k]];
+            }
+            result[i] = sum;
+        }
+    };
+    if (matrix.nonZeros() >= ParallelMinElements && matrix.rows() > 1) {
+        int grain = (std::max)(1, static_cast<int>(static_cast<double>(matrix.rows()) * (ParallelMinElements / 4) / matrix.nonZeros()));
+        threadPool().parallelFor(0, matrix.rows(), grain, multiplyRows);
+    }
+    else {
+        multiplyRows(0, matrix.rows());
+    }
+    return result;
+}
+
+// Функция умножения разреженных матриц (SpGEMM, алгоритм Густавсона) с результатом в CSR.
+// Первый проход считает число ненулевых в строках результата, второй заполняет строки;
+// строки накапливаются в плотном массиве длины cols, по одному на поток, и считаются параллельно.
+SparseMatrix multiplySparse(const SparseMatrix& left, const SparseMatrix& right) {
+    if (left.cols() != right.rows()) {
+        throw std::invalid_argument("Количество столбцов в первой матрице должно быть равно количеству строк во второй матрице");
+    }
+    SparseMatrix leftStorage;
+    SparseMatrix rightStorage;
+    const SparseMatrix& a = sparseInFormat(left, SparseFormat::Csr, leftStorage);
+    const SparseMatrix& b = sparseInFormat(right, SparseFormat::Csr, rightStorage);
+    int rows = a.rows();
+    int cols = b.cols();
+
+    double products = 0.0;
+    for (std::size_t k = 0; k < a.nonZeros(); k++) {
+        int j = a.indices()[k];
+        products += static_cast<double>(b.offsets()[j + 1] - b.offsets()[j]);
+    }
+    ProfileScope profile("sparse multiply");
+    profile.addFlops(2.0 * products);
+
+    std::vector<std::size_t> offsets(static_cast<std::size_t>(rows) + 1, 0);
+    std::vector<int> indices;
+    std::vector<double> values;
+
+    auto forRows = [&](const std::function<void(int, int)>& body) {
+        if (products >= ParallelMinElements && rows > 1) {
+            int grain = (std::max)(1, static_cast<int>(rows * (ParallelMinElements / 4) / products));
+            threadPool().parallelFor(0, rows, grain, body);
+        }
+        else {
+            body(0, rows);
+        }
+    };
+
+    forRows([&](int first, int last) {
+        std::vector<int> marker(cols, -1);
+        for (int i = first; i < last; i++) {
+            std::size_t count = 0;
+            for (std::size_t ka = a.offsets()[i]; ka < a.offsets()[i + 1]; ka++) {
+                int k = a.indices()[ka];
+                for (std::size_t kb = b.offsets()[k]; kb < b.offsets()[k + 1]; kb++) {
+                    int j = b.indices()[kb];
+                    if (marker[j] != i) {
+                        marker[j] = i;
+                        count++;
+                    }
+                }
+            }
+            offsets[i + 1] = count;
+        }
+    });
+    for (int i = 0; i < rows; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    indices.resize(offsets[rows]);
+    values.resize(offsets[rows]);
+
+    forRows([&](int first, int last) {
+        std::vector<double> accumulator(cols, 0.0);
+        std::vector<char> touched(cols, 0);
+        for (int i = first; i < last; i++) {
+            int* rowIndices = indices.data() + offsets[i];
+            std::size_t count = 0;
+            for (std::size_t ka = a.offsets()[i]; ka < a.offsets()[i + 1]; ka++) {
+                int k = a.indices()[ka];
+                double aValue = a.values()[ka];
+                for (std::size_t kb = b.offsets()[k]; kb < b.offsets()[k + 1]; kb++) {
+                    int j = b.indices()[kb];
+                    if (!touched[j]) {
+                        touched[j] = 1;
+                        rowIndices[count++] = j;
+                    }
+                    accumulator[j] += aValue * b.values()[kb];
+                }
+            }
+            std::sort(rowIndices, rowIndices + count);
+            double* rowValues = values.data() + offsets[i];
+            for (std::size_t t = 0; t < count; t++) {
+                int j = rowIndices[t];
+                rowValues[t] = accumulator[j];
+                accumulator[j] = 0.0;
+                touched[j] = 0;
+            }
+        }
+    });
+
+    checkFiniteCompressed(SparseFormat::Csr, offsets, indices, values, "Переполнение при умножении матриц");
+    return SparseMatrix(SparseFormat::Csr, rows, cols, std::move(offsets), std::move(indices), std::move(values));
+}
+
+// Результат разреженного исключения Гаусса
+struct SparseElimination {
+    int rank = 0;
+    double determinant = 0.0; // Для квадратной матрицы: произведение ведущих элементов со знаком перестановок
+    double pivotMargin = std::numeric_limits<double>::infinity(); // Наименьшее отношение ведущего элемента к его порогу
+};
+
+// Знак перестановки (+1 или -1) по числу циклов
+int permutationSign(const std::vector<int>& permutation) {
+    std::vector<char> visited(permutation.size(), 0);
+    int sign = 1;
+    for (std::size_t start = 0; start < permutation.size(); start++) {
+        if (visited[start]) {
+            continue;
+        }
+        std::size_t length = 0;
+        for (std::size_t i = start; !visited[i]; i = permutation[i]) {
+            visited[i] = 1;
+            length++;
+        }
+        if (length % 2 == 0) {
+            sign = -sign;
+        }
+    }
+    return sign;
+}
+
+// Элемент строки при разреженном исключении: bound - накопленная сумма модулей слагаемых,
+// из которых получено значение (оценка его погрешности округления - bound * eps на шаг)
+struct SparseEliminationEntry {
+    int col;
+    double value;
+    double bound;
+};
+
+// Разреженное исключение Гаусса с упорядочением, уменьшающим заполнение (вариант правила Марковица):
+// на каждом шаге берётся активный столбец с наименьшим числом ненулевых (очередь с приоритетом,
+// счётчики обновляются лениво), а в нём - самая короткая строка среди тех, чей элемент не меньше
+// SparsePivotThreshold * max|столбца|. Элемент считается нулевым, если его модуль не больше
+// tolerance * max(max|a|, bound): кроме порога плотного исключения учитывается накопленная оценка
+// погрешности, иначе остатки сокращений после длинных цепочек вычитаний принимаются за ненулевые.
+// Возвращает false, если число ненулевых превысило fillLimit: тогда выгоднее плотный алгоритм.
+bool eliminateSparse(const SparseMatrix& matrix, double tolerance, std::size_t fillLimit, SparseElimination& result) {
+    using SparseRow = std::vector<SparseEliminationEntry>;
+    SparseMatrix storage;
+    const SparseMatrix& csr = sparseInFormat(matrix, SparseFormat::Csr, storage);
+    int rows = csr.rows();
+    int cols = csr.cols();
+
+    double scale = 0.0;
+    for (double value : csr.values()) {
+        scale = (std::max)(scale, std::fabs(value));
+    }
+    auto negligible = [&](const SparseEliminationEntry& entry) {
+        return std::fabs(entry.value) <= tolerance * (std::max)(scale, entry.bound);
+    };
+
+    std::vector<SparseRow> rowEntries(rows);
+    std::vector<std::vector<int>> columnRows(cols);
+    for (int i = 0; i < rows; i++) {
+        for (std::size_t k = csr.offsets()[i]; k < csr.offsets()[i + 1]; k++) {
+            SparseEliminationEntry entry = { csr.indices()[k], csr.values()[k], std::fabs(csr.values()[k]) };
+            if (entry.value != 0.0 && !negligible(entry)) {
+                rowEntries[i].push_back(entry);
+                columnRows[entry.col].push_back(i);
+            }
+        }
+    }
+
+    auto entryAt = [](const SparseRow& row, int col) -> const SparseEliminationEntry* {
+        auto found = std::lower_bound(row.begin(), row.end(), col, [](const SparseEliminationEntry& entry, int c) { return entry.col < c; });
+        return found != row.end() && found->col == col ? &*found : nullptr;
+    };
+
+    using Candidate = std::pair<std::size_t, int>; // (число ненулевых в столбце, столбец)
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+    for (int j = 0; j < cols; j++) {
+        queue.emplace(columnRows[j].size(), j);
+    }
+
+    std::vector<char> rowDone(rows, 0);
+    std::vector<char> columnDone(cols, 0);
+    std::vector<int> pivotRows;
+    std::vector<int> pivotCols;
+    std::vector<const SparseEliminationEntry*> columnEntries;
+    SparseRow merged;
+    std::size_t nonZeros = csr.nonZeros();
+    double product = 1.0;
+
+    while (!queue.empty() && static_cast<int>(pivotRows.size()) < rows) {
+        int col = queue.top().second;
+        std::size_t expected = queue.top().first;
+        queue.pop();
+        if (columnDone[col]) {
+            continue;
+        }
+
+        // Ленивая очистка списка строк столбца: выбывшие строки и сократившиеся до нуля элементы
+        std::vector<int>& candidates = columnRows[col];
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+            [&](int r) { return rowDone[r] || entryAt(rowEntries[r], col) == nullptr; }), candidates.end());
+        if (candidates.size() != expected) {
+            queue.emplace(candidates.size(), col);
+            continue;
+        }
+        columnDone[col] = 1;
+        if (candidates.empty()) {
+            continue; // Столбец линейно зависим от уже исключённых (с точностью до порога)
+        }
+
+        double columnMax = 0.0;
+        columnEntries.resize(candidates.size());
+        for (std::size_t t = 0; t < candidates.size(); t++) {
+            columnEntries[t] = entryAt(rowEntries[candidates[t]], col);
+            columnMax = (std::max)(columnMax, std::fabs(columnEntries[t]->value));
+        }
+
+        std::size_t pivot = candidates.size();
+        for (std::size_t t = 0; t < candidates.size(); t++) {
+            if (std::fabs(columnEntries[t]->value) < SparsePivotThreshold * columnMax) {
+                continue;
+            }
+            if (pivot == candidates.size() || rowEntries[candidates[t]].size() < rowEntries[candidates[pivot]].size()
+                || (rowEntries[candidates[t]].size() == rowEntries[candidates[pivot]].size()
+                    && std::fabs(columnEntries[t]->value) > std::fabs(columnEntries[pivot]->value))) {
+                pivot = t;
+            }
+        }
+        int pivotRow = candidates[pivot];
+        double pivotValue = columnEntries[pivot]->value;
+        if (tolerance > 0.0) {
+            result.pivotMargin = (std::min)(result.pivotMargin, std::fabs(pivotValue) / (tolerance * (std::max)(scale, columnEntries[pivot]->bound)));
+        }
+        const SparseRow& pivotEntries = rowEntries[pivotRow];
+
+        // Вычитание ведущей строки из остальных строк столбца; новые ненулевые попадают в списки своих столбцов
+        for (std::size_t t = 0; t < candidates.size(); t++) {
+            int r = candidates[t];
+            if (r == pivotRow) {
+                continue;
+            }
+            double factor = columnEntries[t]->value / pivotValue;
+            const SparseRow& target = rowEntries[r];
+            merged.clear();
+            std::size_t a = 0;
+            std::size_t b = 0;
+            while (a < target.size() || b < pivotEntries.size()) {
+                if (b == pivotEntries.size() || (a < target.size() && target[a].col < pivotEntries[b].col)) {
+                    merged.push_back(target[a++]);
+                    continue;
+                }
+                SparseEliminationEntry entry = { pivotEntries[b].col, -factor * pivotEntries[b].value, std::fabs(factor) * pivotEntries[b].bound };
+                if (a < target.size() && target[a].col == entry.col) {
+                    entry.value += target[a].value;
+                    entry.bound += target[a].bound;
+                    a++;
+                }
+                else if (!columnDone[entry.col]) {
+                    columnRows[entry.col].push_back(r);
+                }
+                b++;
+                if (entry.col != col && entry.value != 0.0 && !negligible(entry)) {
+                    merged.push_back(entry);
+                }
+            }
+            nonZeros += merged.size();
+            nonZeros -= target.size();
+            rowEntries[r].swap(merged);
+        }
+        if (nonZeros > fillLimit) {
+            return false;
+        }
+
+        for (const SparseEliminationEntry& entry : pivotEntries) {
+            if (!columnDone[entry.col]) {
+                queue.emplace(columnRows[entry.col].size(), entry.col);
+            }
+        }
+        rowDone[pivotRow] = 1;
+        pivotRows.push_back(pivotRow);
+        pivotCols.push_back(col);
+        product *= pivotValue;
+    }
+
+    result.rank = static_cast<int>(pivotRows.size());
+    result.determinant = 0.0;
+    if (rows == cols && result.rank == rows) {
+        result.determinant = product * permutationSign(pivotRows) * permutationSign(pivotCols);
+    }
+    return true;
+}
+
+// Предельное число ненулевых при разреженном исключении: при большем заполнении плотный алгоритм быстрее
+std::size_t sparseFillLimit(const SparseMatrix& matrix) {
+    double limit = SparseDensityThreshold * matrix.rows() * matrix.cols();
+    return (std::max)(2 * matrix.nonZeros(), static_cast<std::size_t>(limit));
+}
+
+// Ранг разреженной матрицы исключением Гаусса (относительный порог - как у плотного исключения);
+// false, если заполнение оказалось слишком большим или ранг по умолчанию нужно перепроверить плотным
+// алгоритмом: ведущий элемент в пределах RankVerifyMargin от порога может оказаться шумом округления
+bool rankBySparseElimination(const SparseMatrix& matrix, const RankOptions& options, int& rank) {
+    ProfileScope profile("sparse rank");
+    SparseElimination elimination;
+    if (!eliminateSparse(matrix, rankThreshold(options, matrix.rows(), matrix.cols(), 1.0), sparseFillLimit(matrix), elimination)) {
+        return false;
+    }
+    if (options.tolerance < 0.0 && elimination.pivotMargin <= RankVerifyMargin) {
+        return false;
+    }
+    rank = elimination.rank;
+    return true;
+}
+
+// Ранг плотной матрицы с элементами double, float или long double (порог по машинной точности T);
+// исходная матрица не изменяется: исключение выполняется в копии, взятой из рабочей области
+template <typename T>
+int findDenseRank(BasicMatrixView<const T> source, const RankOptions& options, Workspace& workspace) {
+    // Оценка трудоёмкости полного исключения (для QR с отражениями - вдвое больше)
+    ProfileScope profile("rank");
+    double m = source.rows();
+    double n = source.cols();
+    double k = (std::min)(m, n);
+    profile.addFlops((options.method == RankMethod::HouseholderQR ? 2.0 : 1.0) * (2.0 * m * n * k - (m + n) * k * k + 2.0 / 3.0 * k * k * k));
+
+    WorkspaceScope scope(workspace);
+    // QR работает с транспонированной копией: столбцы исходной матрицы лежат в памяти подряд
+    auto transposedCopy = [&]() {
+        BasicMatrixView<T> at = workspace.allocateMatrix<T>(source.cols(), source.rows());
+        if constexpr (std::is_same<T, double>::value) {
+            transposeInto(source, at);
+        }
+        else {
+            for (int i = 0; i < source.rows(); i++) {
+                for (int j = 0; j < source.cols(); j++) {
+                    at(j, i) = source(i, j);
+                }
+            }
+        }
+        return at;
+    };
+    if (options.method == RankMethod::HouseholderQR) {
+        return rankByHouseholderQR(transposedCopy(), options, workspace);
+    }
+
+    BasicMatrixView<T> a = workspace.allocateMatrix<T>(source.rows(), source.cols());
+    T maxElement = 0;
+    for (int i = 0; i < source.rows(); i++) {
+        T* row = a.rowData(i);
+        for (int j = 0; j < source.cols(); j++) {
+            row[j] = source(i, j);
+            maxElement = (std::max)(maxElement, std::fabs(row[j]));
+        }
+    }
+    double threshold = rankThreshold(options, source.rows(), source.cols(), static_cast<double>(maxElement),
+        static_cast<double>(std::numeric_limits<T>::epsilon()));
+    double smallestPivot = 0.0;
+    int rank = rankByElimination(a, threshold, (std::max)(1, options.blockSize), workspace, &smallestPivot);
+    if (options.tolerance >= 0.0 || smallestPivot > RankVerifyMargin * threshold) {
+        return rank;
+    }
+
+    // Ведущий элемент близко к порогу может оказаться шумом округления: ранг по умолчанию перепроверяется QR
+    // с тем же абсолютным порогом (по максимальному элементу, как у LU), а не с порогом по нормам столбцов
+    profile.addFlops(2.0 * (2.0 * m * n * k - (m + n) * k * k + 2.0 / 3.0 * k * k * k));
+    return rankByHouseholderQR(transposedCopy(), options, workspace, threshold);
+}
+
+// Функция для определения ранга матрицы.
+// Матрицы, почти все элементы которых нулевые, обрабатываются разреженным исключением, пока заполнение невелико.
+int findRank(ConstMatrixView source, const RankOptions& options, Workspace& workspace) {
+    if (source.empty()) {
+        return 0;
+    }
+    if (options.method == RankMethod::Elimination && preferSparse(source)) {
+        int rank = 0;
+        if (rankBySparseElimination(SparseMatrix::fromDense(source), options, rank)) {
+            return rank;
+        }
+    }
+    return findDenseRank<double>(source, options, workspace);
+}
+
+int findRank(ConstMatrixView source, const RankOptions& options = RankOptions()) {
+    return findRank(source, options, threadWorkspace());
+}
+
+// Функция для определения ранга разреженной матрицы (при большом заполнении - плотным алгоритмом)
+int findRank(const SparseMatrix& matrix, const RankOptions& options = RankOptions()) {
+    if (matrix.nonZeros() == 0) {
+        return 0;
+    }
+    int rank = 0;
+    if (options.method == RankMethod::Elimination && rankBySparseElimination(matrix, options, rank)) {
+        return rank;
+    }
+    return findDenseRank<double>(matrix.toDense(), options, threadWorkspace());
+}
+
+// Функция проверяет, является ли матрица квадратной (одинаковое количество строк и столбцов)
+bool isSquareMatrix(ConstMatrixView matrix) {
+    return matrix.rows() == 0 ? false : matrix.rows() == matrix.cols();
+}
+
+// Функция для вычисления следа матрицы (суммы элементов на главной диагонали матрицы)
+double trace(ConstMatrixView matrix) {
+    // Проверяем, что главная диагональ не выходит за пределы столбцов
+    if (matrix.rows() > matrix.cols()) {
+        throw std::out_of_range("Индекс главной диагонали превышает размер матрицы");
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < matrix.rows(); i++) {
+        sum += matrix(i, i);
+    }
+
+    if (sum > DBL_MAX) {
+        throw std::overflow_error("Сумма элементов на главной диагонали больше максимального значения диапазона double");
+    }
+
+    return sum;
+}
+
+// Наибольший размер матриц с отдельными ядрами фиксированного размера
+constexpr int FixedMaxSize = 8;
+
+// Развёртка цикла по 0 ... N-1 при компиляции: тело вызывается с индексом std::integral_constant
+template <typename Body, std::size_t... I>
+void unrollLoop(Body&& body, std::index_sequence<I...>) {
+    (body(std::integral_constant<int, static_cast<int>(I)>()), ...);
+}
+
+template <int N, typename Body>
+void unrollLoop(Body&& body) {
+    unrollLoop(body, std::make_index_sequence<N>());
+}
+
+// Признак конструктора без обнуления элементов (все элементы будут сразу перезаписаны)
+struct UninitializedTag {};
+
+// Явные формулы определителя и присоединённой матрицы для размеров 1 ... 4. Элементы берутся через a(i, j),
+// а тип значения T - это double или набор SIMD-лан (одна и та же формула считает сразу несколько матриц).
+template <int N, typename T, typename Source>
+T determinantFormula(const Source& a) {
+    static_assert(N >= 1 && N <= 4, "Явные формулы есть только для размеров от 1 до 4");
+    if constexpr (N == 1) {
+        return a(0, 0);
+    }
+    else if constexpr (N == 2) {
+        return a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0);
+    }
+    else if constexpr (N == 3) {
+        return a(0, 0) * (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1))
+            - a(0, 1) * (a(1, 0) * a(2, 2) - a(1, 2) * a(2, 0))
+            + a(0, 2) * (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0));
+    }
+    else {
+        // Разложение Лапласа по минорам 2x2 первых двух и последних двух строк
+        T s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+        T s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+        T s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+        T s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+        T s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+        T s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
+        T c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+        T c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+        T c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+        T c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+        T c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+        T c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
+        return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    }
+}
+
+// Присоединённая матрица (по строкам в adjugate[N * N]); возвращает определитель,
+// посчитанный из тех же алгебраических дополнений
+template <int N, typename T, typename Source>
+T adjugateFormula(const Source& a, T* adjugate) {
+    static_assert(N >= 1 && N <= 4, "Явные формулы есть только для размеров от 1 до 4");
+    if constexpr (N == 1) {
+        adjugate[0] = T(1.0);
+        return a(0, 0);
+    }
+    else if constexpr (N == 2) {
+        adjugate[0] = a(1, 1);
+        adjugate[1] = -a(0, 1);
+        adjugate[2] = -a(1, 0);
+        adjugate[3] = a(0, 0);
+        return a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0);
+    }
+    else if constexpr (N == 3) {
+        adjugate[0] = a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1);
+        adjugate[1] = a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2);
+        adjugate[2] = a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1);
+        adjugate[3] = a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2);
+        adjugate[4] = a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0);
+        adjugate[5] = a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2);
+        adjugate[6] = a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0);
+        adjugate[7] = a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1);
+        adjugate[8] = a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0);
+        return a(0, 0) * adjugate[0] + a(0, 1) * adjugate[3] + a(0, 2) * adjugate[6];
+    }
+    else {
+        T s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+        T s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+        T s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+        T s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+        T s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+        T s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
+        T c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+        T c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+        T c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+        T c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+        T c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+        T c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
+        adjugate[0] = a(1, 1) * c5 - a(1, 2) * c4 + a(1, 3) * c3;
+        adjugate[1] = a(0, 2) * c4 - a(0, 1) * c5 - a(0, 3) * c3;
+        adjugate[2] = a(3, 1) * s5 - a(3, 2) * s4 + a(3, 3) * s3;
+        adjugate[3] = a(2, 2) * s4 - a(2, 1) * s5 - a(2, 3) * s3;
+        adjugate[4] = a(1, 2) * c2 - a(1, 0) * c5 - a(1, 3) * c1;
+        adjugate[5] = a(0, 0) * c5 - a(0, 2) * c2 + a(0, 3) * c1;
+        adjugate[6] = a(3, 2) * s2 - a(3, 0) * s5 - a(3, 3) * s1;
+        adjugate[7] = a(2, 0) * s5 - a(2, 2) * s2 + a(2, 3) * s1;
+        adjugate[8] = a(1, 0) * c4 - a(1, 1) * c2 + a(1, 3) * c0;
+        adjugate[9] = a(0, 1) * c2 - a(0, 0) * c4 - a(0, 3) * c0;
+        adjugate[10] = a(3, 0) * s4 - a(3, 1) * s2 + a(3, 3) * s0;
+        adjugate[11] = a(2, 1) * s2 - a(2, 0) * s4 - a(2, 3) * s0;
+        adjugate[12] = a(1, 1) * c1 - a(1, 0) * c3 - a(1, 2) * c0;
+        adjugate[13] = a(0, 0) * c3 - a(0, 1) * c1 + a(0, 2) * c0;
+        adjugate[14] = a(3, 1) * s1 - a(3, 0) * s3 - a(3, 2) * s0;
+        adjugate[15] = a(2, 0) * s3 - a(2, 1) * s1 + a(2, 2) * s0;
+        return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    }
+}
+
+// Матрица фиксированного размера R x C на стеке (для матриц 2x2 ... 8x8).
+// Размеры известны при компиляции, поэтому циклы разворачиваются, а для 2x2 - 4x4 определитель
+// и обратная матрица считаются по явным формулам.
+template <int R, int C>
+class FixedMatrix {
+public:
+    static_assert(R >= 1 && C >= 1 && R <= FixedMaxSize && C <= FixedMaxSize, "FixedMatrix рассчитана на размеры от 1 до 8");
+
+    static constexpr int Rows = R;
+    static constexpr int Cols = C;
+
+    FixedMatrix() : data_() {}
+    explicit FixedMatrix(UninitializedTag) {}
+
+    static constexpr int rows() { return R; }
+    static constexpr int cols() { return C; }
+
+    double& operator()(int i, int j) { return data_[i * C + j]; }
+    double operator()(int i, int j) const { return data_[i * C + j]; }
+    double* data() { return data_; }
+    const double* data() const { return data_; }
+
+    MatrixView view() { return MatrixView(data_, R, C, C); }
+    ConstMatrixView view() const { return ConstMatrixView(data_, R, C, C); }
+    operator MatrixView() { return view(); }
+    operator ConstMatrixView() const { return view(); }
+
+    // Копия представления; размеры представления должны совпадать с R x C
+    static FixedMatrix fromView(ConstMatrixView source) {
+        if (source.rows() != R || source.cols() != C) {
+            throw std::invalid_argument("Размер матрицы не совпадает с размером FixedMatrix");
+        }
+        FixedMatrix result{ UninitializedTag() };
+        for (int i = 0; i < R; i++) {
+            if (source.colStride() == 1) {
+                std::memcpy(result.data_ + i * C, source.data() + i * source.rowStride(), C * sizeof(double));
+                continue;
+            }
+            for (int j = 0; j < C; j++) {
+                result.data_[i * C + j] = source(i, j);
+            }
+        }
+        return result;
+    }
+
+    static FixedMatrix identity() {
+        static_assert(R == C, "Единичная матрица должна быть квадратной");
+        FixedMatrix result;
+        for (int i = 0; i < R; i++) {
+            result(i, i) = 1.0;
+        }
+        return result;
+    }
+
+    FixedMatrix<C, R> transposed() const {
+        FixedMatrix<C, R> result;
+        for (int i = 0; i < R; i++) {
+            for (int j = 0; j < C; j++) {
+                result(j, i) = data_[i * C + j];
+            }
+        }
+        return result;
+    }
+
+    double trace() const {
+        static_assert(R == C, "След определён только для квадратной матрицы");
+        double sum = 0.0;
+        for (int i = 0; i < R; i++) {
+            sum += data_[i * C + i];
+        }
+        return sum;
+    }
+
+    double maxAbs() const {
+        double result = 0.0;
+        for (int i = 0; i < R * C; i++) {
+            result = (std::max)(result, std::fabs(data_[i]));
+        }
+        return result;
+    }
+
+    // Определитель: для 2x2 ... 4x4 - явная формула, для 5x5 ... 8x8 - произведение ведущих элементов,
+    // как у determinant больших матриц. Порогом вырожденности значение не обнуляется: порог
+    // N * eps * max|a| решает только, существует ли обратная
+    double determinant() const;
+
+    // Обратная матрица; false, если матрица вырожденная (тогда result не меняется)
+    bool inverse(FixedMatrix& result) const;
+
+private:
+    // LU-разложение на месте (для 5x5 ... 8x8) в том же порядке операций, что factorLUInPlace, поэтому
+    // ведущие элементы совпадают с decomposeLU. Возвращает знак перестановки строк или 0, если ведущий
+    // элемент не больше tolerance
+    int factorInPlace(int* permutation, double tolerance);
+
+    // Обратная матрица по разложению factorInPlace. Ведущий элемент не больше N * eps * max|a|
+    // считается нулевым, как в decomposeLU.
+    bool invertByElimination(FixedMatrix& result) const;
+
+    alignas(32) double data_[R * C];
+};
+
+template <int R, int C>
+double FixedMatrix<R, C>::determinant() const {
+    static_assert(R == C, "Определитель определён только для квадратной матрицы");
+    if constexpr (R <= 4) {
+        return determinantFormula<R, double>(*this);
+    }
+    else {
+        FixedMatrix work = *this;
+        int permutation[R];
+        int sign = work.factorInPlace(permutation, 0.0);
+        if (sign == 0) {
+            return 0.0; // Нулевой ведущий элемент: произведение всё равно нулевое
+        }
+        double det = sign;
+        for (int k = 0; k < R; k++) {
+            det *= work(k, k);
+        }
+        return det;
+    }
+}
+
+template <int R, int C>
+int FixedMatrix<R, C>::factorInPlace(int* permutation, double tolerance) {
+    int sign = 1;
+    for (int i = 0; i < R; i++) {
+        permutation[i] = i;
+    }
+    for (int k = 0; k < R; k++) {
+        int pivot = k;
+        for (int i = k + 1; i < R; i++) {
+            if (std::fabs((*this)(i, k)) > std::fabs((*this)(pivot, k))) {
+                pivot = i;
+            }
+        }
+        if (!(std::fabs((*this)(pivot, k)) > tolerance)) {
+            return 0;
+        }
+        if (pivot != k) {
+            for (int j = 0; j < C; j++) {
+                std::swap((*this)(k, j), (*this)(pivot, j));
+            }
+            std::swap(permutation[k], permutation[pivot]);
+            sign = -sign;
+        }
+        for (int i = k + 1; i < R; i++) {
+            double factor = (*this)(i, k) / (*this)(k, k);
+            (*this)(i, k) = factor;
+            for (int j = k + 1; j < C; j++) {
+                (*this)(i, j) += -factor * (*this)(k, j);
+            }
+        }
+    }
+    return sign;
+}
+
+template <int R, int C>
+bool FixedMatrix<R, C>::inverse(FixedMatrix& result) const {
+    static_assert(R == C, "Обратная матрица определена только для квадратной матрицы");
+    if constexpr (R >= 5) {
+        return invertByElimination(result);
+    }
+    else {
+        // Явные формулы через алгебраические дополнения. Определитель не больше N * eps * max|a|^N
+        // считается нулевым: это тот же масштаб, что и порог ведущего элемента в decomposeLU.
+        FixedMatrix b{ UninitializedTag() };
+        double det = adjugateFormula<R>(*this, b.data());
+        double tolerance = R * std::numeric_limits<double>::epsilon() * std::pow(maxAbs(), R);
+        if (!(std::fabs(det) > tolerance) || !std::isfinite(1.0 / det)) {
+            return false;
+        }
+        double inv = 1.0 / det;
+        for (int i = 0; i < R * C; i++) {
+            b.data_[i] *= inv;
+        }
+        result = b;
+        return true;
+    }
+}
+
+template <int R, int C>
+bool FixedMatrix<R, C>::invertByElimination(FixedMatrix& result) const {
+    FixedMatrix lu = *this;
+    int permutation[R];
+    if (lu.factorInPlace(permutation, R * std::numeric_limits<double>::epsilon() * maxAbs()) == 0) {
+        return false;
+    }
+
+    // Прямая подстановка L * Y = P * I и обратная U * X = Y над целыми строками, как в inverseFromLU
+    FixedMatrix x;
+    for (int i = 0; i < R; i++) {
+        x(i, permutation[i]) = 1.0;
+        for (int k = 0; k < i; k++) {
+            for (int j = 0; j < C; j++) {
+                x(i, j) += -lu(i, k) * x(k, j);
+            }
+        }
+    }
+    for (int i = R - 1; i >= 0; i--) {
+        for (int k = i + 1; k < R; k++) {
+            for (int j = 0; j < C; j++) {
+                x(i, j) += -lu(i, k) * x(k, j);
+            }
+        }
+        double invPivot = 1.0 / lu(i, i);
+        for (int j = 0; j < C; j++) {
+            x(i, j) *= invPivot;
+        }
+    }
+    if (!std::isfinite(x.maxAbs())) {
+        return false;
+    }
+    result = x;
+    return true;
+}
+
+#if P2_X86
+// Умножение малых матриц в регистрах AVX2: строки B (по C / 4 регистра) загружаются один раз,
+// строка результата накапливается в регистрах как линейная комбинация строк B
+template <int R, int K, int C>
+P2_TARGET_AVX2 void multiplyFixedAvx2(const double* a, const double* b, double* c) {
+    constexpr int V = C / 4;
+    __m256d rowsB[K][V];
+    for (int k = 0; k < K; k++) {
+        for (int v = 0; v < V; v++) {
+            rowsB[k][v] = _mm256_loadu_pd(b + k * C + 4 * v);
+        }
+    }
+    for (int i = 0; i < R; i++) {
+        __m256d sum[V];
+        for (int v = 0; v < V; v++) {
+            sum[v] = _mm256_mul_pd(_mm256_broadcast_sd(a + i * K), rowsB[0][v]);
+        }
+        for (int k = 1; k < K; k++) {
+            __m256d scalar = _mm256_broadcast_sd(a + i * K + k);
+            for (int v = 0; v < V; v++) {
+                sum[v] = _mm256_fmadd_pd(scalar, rowsB[k][v], sum[v]);
+            }
+        }
+        for (int v = 0; v < V; v++) {
+            _mm256_storeu_pd(c + i * C + 4 * v, sum[v]);
+        }
+    }
+}
+#endif
+
+template <int R, int K, int C>
+FixedMatrix<R, C> operator*(const FixedMatrix<R, K>& a, const FixedMatrix<K, C>& b) {
+    FixedMatrix<R, C> c{ UninitializedTag() };
+#if P2_X86
+    if constexpr (C % 4 == 0) {
+        const CpuFeatures& features = cpuFeatures();
+        if (features.avx2 && features.fma) {
+            multiplyFixedAvx2<R, K, C>(a.data(), b.data(), c.data());
+            return c;
+        }
+    }
+#endif
+    unrollLoop<R>([&](auto i) {
+        unrollLoop<C>([&](auto j) {
+            double sum = a(i, 0) * b(0, j);
+            unrollLoop<K - 1>([&](auto k) { sum += a(i, k + 1) * b(k + 1, j); });
+            c(i, j) = sum;
+        });
+    });
+    return c;
+}
+
+template <int R, int C>
+FixedMatrix<R, C> operator+(const FixedMatrix<R, C>& a, const FixedMatrix<R, C>& b) {
+    FixedMatrix<R, C> c{ UninitializedTag() };
+    for (int i = 0; i < R * C; i++) {
+        c.data()[i] = a.data()[i] + b.data()[i];
+    }
+    return c;
+}
+
+template <int R, int C>
+FixedMatrix<R, C> operator-(const FixedMatrix<R, C>& a, const FixedMatrix<R, C>& b) {
+    FixedMatrix<R, C> c{ UninitializedTag() };
+    for (int i = 0; i < R * C; i++) {
+        c.data()[i] = a.data()[i] - b.data()[i];
+    }
+    return c;
+}
+
+// Выбор ядра фиксированного размера по размеру квадратной матрицы во время выполнения
+template <template <int> class Kernel, typename... Args>
+auto dispatchFixedSize(int n, Args&&... args) -> decltype(Kernel<2>::run(std::forward<Args>(args)...)) {
+    switch (n) {
+    case 2: return Kernel<2>::run(std::forward<Args>(args)...);
+    case 3: return Kernel<3>::run(std::forward<Args>(args)...);
+    case 4: return Kernel<4>::run(std::forward<Args>(args)...);
+    case 5: return Kernel<5>::run(std::forward<Args>(args)...);
+    case 6: return Kernel<6>::run(std::forward<Args>(args)...);
+    case 7: return Kernel<7>::run(std::forward<Args>(args)...);
+    case 8: return Kernel<8>::run(std::forward<Args>(args)...);
+    default: throw std::invalid_argument("Для этого размера нет ядра фиксированного размера");
+    }
+}
+
+template <int N>
+struct FixedDeterminantKernel {
+    static double run(ConstMatrixView matrix) { return FixedMatrix<N, N>::fromView(matrix).determinant(); }
+};
+
+template <int N>
+struct FixedInverseKernel {
+    static bool run(ConstMatrixView matrix, MatrixView result) {
+        FixedMatrix<N, N> inverse{ UninitializedTag() };
+        if (!FixedMatrix<N, N>::fromView(matrix).inverse(inverse)) {
+            return false;
+        }
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) {
+                result(i, j) = inverse(i, j);
+            }
+        }
+        return true;
+    }
+};
+
+template <int N>
+struct FixedMultiplyKernel {
+    static void run(ConstMatrixView a, ConstMatrixView b, MatrixView c) {
+        FixedMatrix<N, N> product = FixedMatrix<N, N>::fromView(a) * FixedMatrix<N, N>::fromView(b);
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) {
+                c(i, j) = product(i, j);
+            }
+        }
+    }
+};
+
+// Квадратная матрица, для размера которой есть ядра фиксированного размера
+bool hasFixedSize(ConstMatrixView matrix) {
+    return matrix.rows() == matrix.cols() && matrix.rows() >= 2 && matrix.rows() <= FixedMaxSize;
+}
+
+// Определитель квадратной матрицы 2x2 ... 8x8 ядром фиксированного размера
+double fixedDeterminant(ConstMatrixView matrix) {
+    return dispatchFixedSize<FixedDeterminantKernel>(matrix.rows(), matrix);
+}
+
+// Обратная матрица 2x2 ... 8x8 в result; false, если матрица вырожденная
+bool fixedInverse(ConstMatrixView matrix, MatrixView result) {
+    return dispatchFixedSize<FixedInverseKernel>(matrix.rows(), matrix, result);
+}
+
+// Произведение двух квадратных матриц 2x2 ... 8x8 одного размера в c
+void fixedMultiply(ConstMatrixView a, ConstMatrixView b, MatrixView c) {
+    dispatchFixedSize<FixedMultiplyKernel>(a.rows(), a, b, c);
+}
+
+// Обновление строки y[0..n) += alpha * x[0..n) - внутренний цикл исключения и умножения для любого
+// типа элементов. Для double и long double - обычный цикл (результаты double не зависят от наличия FMA),
+// для float - ядра AVX2/AVX-512 с FMA: восемь или шестнадцать элементов за инструкцию.
+template <typename T>
+void rowUpdateScalar(int n, T alpha, const T* x, T* y) {
+    for (int j = 0; j < n; j++) {
+        y[j] += alpha * x[j];
+    }
+}
+
+#if P2_X86
+P2_TARGET_AVX2
+void rowUpdateFloatAvx2(int n, float alpha, const float* x, float* y) {
+    __m256 factor = _mm256_set1_ps(alpha);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        _mm256_storeu_ps(y + j, _mm256_fmadd_ps(factor, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+        _mm256_storeu_ps(y + j + 8, _mm256_fmadd_ps(factor, _mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(y + j + 8)));
+    }
+    for (; j + 8 <= n; j += 8) {
+        _mm256_storeu_ps(y + j, _mm256_fmadd_ps(factor, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+    }
+    rowUpdateScalar(n - j, alpha, x + j, y + j);
+}
+
+P2_TARGET_AVX512
+void rowUpdateFloatAvx512(int n, float alpha, const float* x, float* y) {
+    __m512 factor = _mm512_set1_ps(alpha);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        _mm512_storeu_ps(y + j, _mm512_fmadd_ps(factor, _mm512_loadu_ps(x + j), _mm512_loadu_ps(y + j)));
+    }
+    if (j < n) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - j)) - 1);
+        _mm512_mask_storeu_ps(y + j, mask, _mm512_fmadd_ps(factor, _mm512_maskz_loadu_ps(mask, x + j), _mm512_maskz_loadu_ps(mask, y + j)));
+    }
+}
+#endif
+
+using FloatRowUpdate = void (*)(int n, float alpha, const float* x, float* y);
+
+// Функция выбора ядра обновления строки float по возможностям процессора
+FloatRowUpdate floatRowUpdate() {
+    static const FloatRowUpdate kernel = [] {
+#if P2_X86
+        const CpuFeatures& features = cpuFeatures();
+        if (features.avx512f) {
+            return static_cast<FloatRowUpdate>(rowUpdateFloatAvx512);
+        }
+        if (features.avx2 && features.fma) {
+            return static_cast<FloatRowUpdate>(rowUpdateFloatAvx2);
+        }
+#endif
+        return static_cast<FloatRowUpdate>(rowUpdateScalar<float>);
+    }();
+    return kernel;
+}
+
+template <typename T>
+void rowUpdate(int n, T alpha, const T* x, T* y) {
+    if constexpr (std::is_same<T, float>::value) {
+        floatRowUpdate()(n, alpha, x, y);
+    }
+    else {
+        rowUpdateScalar(n, alpha, x, y);
+    }
+}
+
+// Обновление строки сразу четырьмя строками: y += alpha[0] * x[0] + ... + alpha[3] * x[3], где строки x
+// отстоят друг от друга на xStride элементов. Строка y читается и записывается один раз на четыре
+// слагаемых, поэтому умножение упирается в вычисления, а не в обмен с кэшем.
+template <typename T>
+void rowUpdate4Scalar(int n, const T* alpha, const T* x, std::ptrdiff_t xStride, T* y) {
+    const T* x0 = x;
+    const T* x1 = x + xStride;
+    const T* x2 = x + 2 * xStride;
+    const T* x3 = x + 3 * xStride;
+    for (int j = 0; j < n; j++) {
+        y[j] += alpha[0] * x0[j] + alpha[1] * x1[j] + alpha[2] * x2[j] + alpha[3] * x3[j];
+    }
+}
+
+#if P2_X86
+P2_TARGET_AVX2
+void rowUpdate4FloatAvx2(int n, const float* alpha, const float* x, std::ptrdiff_t xStride, float* y) {
+    __m256 a0 = _mm256_set1_ps(alpha[0]);
+    __m256 a1 = _mm256_set1_ps(alpha[1]);
+    __m256 a2 = _mm256_set1_ps(alpha[2]);
+    __m256 a3 = _mm256_set1_ps(alpha[3]);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256 sum = _mm256_fmadd_ps(a0, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j));
+        sum = _mm256_fmadd_ps(a1, _mm256_loadu_ps(x + xStride + j), sum);
+        sum = _mm256_fmadd_ps(a2, _mm256_loadu_ps(x + 2 * xStride + j), sum);
+        sum = _mm256_fmadd_ps(a3, _mm256_loadu_ps(x + 3 * xStride + j), sum);
+        _mm256_storeu_ps(y + j, sum);
+    }
+    rowUpdate4Scalar(n - j, alpha, x + j, xStride, y + j);
+}
+
+P2_TARGET_AVX512
+void rowUpdate4FloatAvx512(int n, const float* alpha, const float* x, std::ptrdiff_t xStride, float* y) {
+    __m512 a0 = _mm512_set1_ps(alpha[0]);
+    __m512 a1 = _mm512_set1_ps(alpha[1]);
+    __m512 a2 = _mm512_set1_ps(alpha[2]);
+    __m512 a3 = _mm512_set1_ps(alpha[3]);
+    for (int j = 0; j < n; j += 16) {
+        __mmask16 mask = n - j >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n - j)) - 1);
+        __m512 sum = _mm512_fmadd_ps(a0, _mm512_maskz_loadu_ps(mask, x + j), _mm512_maskz_loadu_ps(mask, y + j));
+        sum = _mm512_fmadd_ps(a1, _mm512_maskz_loadu_ps(mask, x + xStride + j), sum);
+        sum = _mm512_fmadd_ps(a2, _mm512_maskz_loadu_ps(mask, x + 2 * xStride + j), sum);
+        sum = _mm512_fmadd_ps(a3, _mm512_maskz_loadu_ps(mask, x + 3 * xStride + j), sum);
+        _mm512_mask_storeu_ps(y + j, mask, sum);
+    }
+}
+#endif
+
+using FloatRowUpdate4 = void (*)(int n, const float* alpha, const float* x, std::ptrdiff_t xStride, float* y);
+
+// Функция выбора ядра четырёхстрочного обновления float по возможностям процессора
+FloatRowUpdate4 floatRowUpdate4() {
+    static const FloatRowUpdate4 kernel = [] {
+#if P2_X86
+        const CpuFeatures& features = cpuFeatures();
+        if (features.avx512f) {
+            return static_cast<FloatRowUpdate4>(rowUpdate4FloatAvx512);
+        }
+        if (features.avx2 && features.fma) {
+            return static_cast<FloatRowUpdate4>(rowUpdate4FloatAvx2);
+        }
+#endif
+        return static_cast<FloatRowUpdate4>(rowUpdate4Scalar<float>);
+    }();
+    return kernel;
+}
+
+template <typename T>
+void rowUpdate4(int n, const T* alpha, const T* x, std::ptrdiff_t xStride, T* y) {
+    if constexpr (std::is_same<T, float>::value) {
+        floatRowUpdate4()(n, alpha, x, xStride, y);
+    }
+    else {
+        rowUpdate4Scalar(n, alpha, x, xStride, y);
+    }
+}
+
+// Результат LU-разложения на месте: знак перестановки строк, порог вырожденности и признак вырожденности
+struct LUFactorInfo {
+    int sign = 1;
+    double pivotTolerance = 0.0;
+    bool singular = false;
+};
+
+// LU-разложение квадратной матрицы на месте (метод Гаусса с частичным выбором ведущего элемента):
+// a заменяется множителями L под диагональю и элементами U, в permutation (n элементов) записывается
+// перестановка строк. Дополнительной памяти не требует, поэтому a может лежать в рабочей области.
+// Строки a должны лежать в памяти подряд. T - double, float или long double; порог вырожденности
+// берётся по машинной точности T.
+template <typename T>
+LUFactorInfo factorLUInPlace(BasicMatrixView<T> a, int* permutation) {
+    int n = a.rows();
+    ProfileScope profile("lu");
+    profile.addFlops(2.0 / 3.0 * n * n * n);
+
+    LUFactorInfo info;
+    for (int i = 0; i < n; i++) {
+        permutation[i] = i;
+    }
+
+    // Порог вырожденности масштабируется по максимальному элементу матрицы
+    T maxElement = 0;
+    for (int i = 0; i < n; i++) {
+        const T* row = a.rowData(i);
+        for (int j = 0; j < n; j++) {
+            maxElement = (std::max)(maxElement, std::fabs(row[j]));
+        }
+    }
+    T pivotTolerance = n * std::numeric_limits<T>::epsilon() * maxElement;
+    info.pivotTolerance = static_cast<double>(pivotTolerance);
+
+    for (int k = 0; k < n; k++) {
+        // Поиск максимального по модулю элемента в столбце k
+        int pivotRow = k;
+        for (int i = k + 1; i < n; i++) {
+            if (std::fabs(a(i, k)) > std::fabs(a(pivotRow, k))) {
+                pivotRow = i;
+            }
+        }
+
+        if (pivotRow != k) {
+            std::swap_ranges(a.rowData(pivotRow), a.rowData(pivotRow) + n, a.rowData(k));
+            std::swap(permutation[pivotRow], permutation[k]);
+            info.sign = -info.sign;
+        }
+
+        T pivot = a(k, k);
+        if (std::fabs(pivot) <= pivotTolerance) {
+            info.singular = true;
+            if (pivot == 0) {
+                continue; // Столбец уже нулевой, исключать нечего
+            }
+        }
+
+        const T* pivotRowValues = a.rowData(k);
+        for (int i = k + 1; i < n; i++) {
+            T* current = a.rowData(i);
+            T factor = current[k] / pivot;
+            current[k] = factor;
+            rowUpdate(n - k - 1, -factor, pivotRowValues + k + 1, current + k + 1);
+        }
+    }
+    return info;
+}
+
+// Обратная матрица по LU-разложению на месте: решение A * X = I сразу для всех столбцов единичной матрицы.
+// Подстановки выполняются над целыми строками X на месте, поэтому внутренний цикл идёт по памяти подряд.
+template <typename T>
+void inverseFromLU(BasicMatrixView<const T> lu, const int* permutation, BasicMatrixView<T> x) {
+    int n = lu.rows();
+    ProfileScope profile("lu inverse");
+    profile.addFlops(4.0 / 3.0 * n * n * n);
+
+    // X = P * I: в i-й строке единица стоит в столбце permutation[i]
+    for (int i = 0; i < n; i++) {
+        std::fill(x.rowData(i), x.rowData(i) + n, T(0));
+        x(i, permutation[i]) = 1;
+    }
+
+    // Прямая подстановка L * Y = P * I
+    for (int i = 1; i < n; i++) {
+        T* rowI = x.rowData(i);
+        for (int k = 0; k < i; k++) {
+            T factor = lu(i, k);
+            if (factor == 0) continue;
+            rowUpdate(n, -factor, x.rowData(k), rowI);
+        }
+    }
+
+    // Обратная подстановка U * X = Y
+    for (int i = n - 1; i >= 0; i--) {
+        T* rowI = x.rowData(i);
+        for (int k = i + 1; k < n; k++) {
+            T factor = lu(i, k);
+            if (factor == 0) continue;
+            rowUpdate(n, -factor, x.rowData(k), rowI);
+        }
+        T invPivot = 1 / lu(i, i);
+        for (int j = 0; j < n; j++) {
+            rowI[j] *= invPivot;
+        }
+    }
+}
+
+// LU-разложение квадратной матрицы с частичным выбором ведущего элемента: P * A = L * U.
+// Множители L (без единичной диагонали) и элементы U хранятся вместе в матрице lu,
+// поэтому одно разложение можно использовать для определителя, решения систем и проверки вырожденности.
+struct LUDecomposition {
+    Matrix lu; // Под диагональю - множители L, на диагонали и выше - U
+    std::vector<int> permutation; // permutation[i] - номер строки исходной матрицы, ставшей i-й строкой
+    int sign = 1; // Знак перестановки строк (+1 или -1)
+    double pivotTolerance = 0.0; // Порог, ниже которого ведущий элемент считается нулевым
+    bool singular = false; // Признак вырожденности матрицы
+
+    int size() const { return lu.rows(); }
+    bool isSingular() const { return singular; }
+
+    // Нижняя треугольная матрица L с единицами на диагонали
+    Matrix lower() const {
+        int n = size();
+        Matrix l(n, n);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < i; j++) {
+                l(i, j) = lu(i, j);
+            }
+            l(i, i) = 1.0;
+        }
+        return l;
+    }
+
+    // Верхняя треугольная матрица U
+    Matrix upper() const {
+        int n = size();
+        Matrix u(n, n);
+        for (int i = 0; i < n; i++) {
+            for (int j = i; j < n; j++) {
+                u(i, j) = lu(i, j);
+            }
+        }
+        return u;
+    }
+
+    // Определитель как произведение диагонали U с учётом знака перестановки
+    double determinant() const {
+        double det = static_cast<double>(sign);
+        for (int i = 0; i < size(); i++) {
+            det *= lu(i, i);
+        }
+        return det;
+    }
+
+    // Решение системы A * x = b прямой и обратной подстановкой
+    std::vector<double> solve(const std::vector<double>& b) const {
+        int n = size();
+        if (static_cast<int>(b.size()) != n) {
+            throw std::invalid_argument("Размер правой части не совпадает с размером матрицы");
+        }
+        if (singular) {
+            throw std::runtime_error("Матрица вырожденная, система не имеет единственного решения");
+        }
+
+        std::vector<double> x(n);
+        for (int i = 0; i < n; i++) {
+            const double* rowI = lu.rowData(i);
+            double sum = b[permutation[i]];
+            for (int j = 0; j < i; j++) {
+                sum -= rowI[j] * x[j];
+            }
+            x[i] = sum;
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            const double* rowI = lu.rowData(i);
+            double sum = x[i];
+            for (int j = i + 1; j < n; j++) {
+                sum -= rowI[j] * x[j];
+            }
+            x[i] = sum / rowI[i];
+        }
+        return x;
+    }
+
+    // Обратная матрица (см. inverseFromLU)
+    Matrix inverse() const {
+        int n = size();
+        if (singular) {
+            throw std::runtime_error("Матрица вырожденная, обратной матрицы не существует");
+        }
+        Matrix x(n, n);
+        inverseFromLU<double>(lu, permutation.data(), x);
+        return x;
+    }
+};
+
+// Функция для LU-разложения квадратной матрицы (метод Гаусса с частичным выбором ведущего элемента)
+LUDecomposition decomposeLU(ConstMatrixView matrix) {
+    if (!isSquareMatrix(matrix)) {
+        throw std::invalid_argument("LU-разложение возможно только для квадратной матрицы");
+    }
+
+    LUDecomposition result;
+    result.lu = Matrix(matrix);
+    result.permutation.resize(matrix.rows());
+    LUFactorInfo info = factorLUInPlace(result.lu.view(), result.permutation.data());
+    result.sign = info.sign;
+    result.pivotTolerance = info.pivotTolerance;
+    result.singular = info.singular;
+    return result;
+}
+
+// Функция для нахождения определителя матрицы
+double determinant(ConstMatrixView matrix) {
+    ProfileScope profile("determinant");
+    int n = matrix.rows();
+
+    // Проверка на квадратную матрицу и размерность больше 1
+    if (!isSquareMatrix(matrix) || n < 2) {
+        return 0.0;
+    }
+
+    // Малые матрицы - развёрнутыми ядрами фиксированного размера без выделения памяти
+    if (n <= FixedMaxSize) {
+        return fixedDeterminant(matrix);
+    }
+
+    // Почти нулевые матрицы - разреженным исключением, если заполнение остаётся небольшим
+    if (preferSparse(matrix)) {
+        SparseMatrix sparse = SparseMatrix::fromDense(matrix);
+        SparseElimination elimination;
+        if (eliminateSparse(sparse, 0.0, sparseFillLimit(sparse), elimination)) {
+            return elimination.determinant;
+        }
+    }
+
+    // Для больших матриц определитель берётся из LU-разложения за O(n^3); копия для разложения - в рабочей области
+    Workspace& workspace = threadWorkspace();
+    WorkspaceScope scope(workspace);
+    MatrixView lu = workspace.allocateMatrix(n, n);
+    copyInto(matrix, lu);
+    LUFactorInfo info = factorLUInPlace(lu, workspace.allocate<int>(n));
+    double det = static_cast<double>(info.sign);
+    for (int i = 0; i < n; i++) {
+        det *= lu(i, i);
+    }
+    return det;
+}
+
+// Функция для нахождения определителя разреженной матрицы (при большом заполнении - через плотное LU-разложение)
+double determinant(const SparseMatrix& matrix) {
+    int n = matrix.rows();
+    if (matrix.cols() != n || n < 2) {
+        return 0.0;
+    }
+    if (n <= FixedMaxSize) {
+        return fixedDeterminant(matrix.toDense());
+    }
+
+    ProfileScope profile("sparse determinant");
+    SparseElimination elimination;
+    if (eliminateSparse(matrix, 0.0, sparseFillLimit(matrix), elimination)) {
+        return elimination.determinant;
+    }
+    return decomposeLU(matrix.toDense()).determinant();
+}
+
+// Функция вычисления обратной матрицы в заранее выделенную матрицу result (n x n);
+// false, если матрица вырожденная. Разложение хранится в рабочей области workspace.
+bool inverseInto(ConstMatrixView matrix, MatrixView result, Workspace& workspace) {
+    int n = matrix.rows();
+    if (!isSquareMatrix(matrix) || result.rows() != n || result.cols() != n) {
+        throw std::invalid_argument("Обратная матрица существует только для квадратной матрицы");
+    }
+    if (hasFixedSize(matrix)) {
+        return fixedInverse(matrix, result);
+    }
+
+    // Одно LU-разложение вместо определителей n^2 миноров
+    WorkspaceScope scope(workspace);
+    MatrixView lu = workspace.allocateMatrix(n, n);
+    copyInto(matrix, lu);
+    int* permutation = workspace.allocate<int>(n);
+    if (factorLUInPlace(lu, permutation).singular) {
+        return false;
+    }
+    inverseFromLU<double>(lu, permutation, result);
+    return true;
+}
+
+// Функция для вычисления обратной матрицы
+Matrix inverseMatrix(ConstMatrixView matrix) {
+    int n = matrix.rows();
+
+    if (!isSquareMatrix(matrix)) {
+        std::cout << "Обратная матрица существует только для квадратной матрицы." << std::endl;
+        return Matrix(n, n);
+    }
+
+    // Проверка на вырожденность матрицы по порогу ведущего элемента
+    Matrix result(n, n);
+    if (!inverseInto(matrix, result, threadWorkspace())) {
+        std::cout << "Матрица вырожденная, обратной матрицы не существует." << std::endl;
+        return Matrix(n, n);
+    }
+    return result;
+}
+
+// Квадратная матрица вместе с обратной и определителем, которые после малых изменений (элемент,
+// строка, столбец, добавка U * V^T ранга k) обновляются за O(n^2 k) вместо полного пересчёта за O(n^3):
+// обратная - по формуле Шермана-Моррисона (k = 1) или Вудбери, определитель - по лемме об определителе
+// det(A + U V^T) = det(A) * det(I + V^T A^-1 U). Каждое обновление проверяется на устойчивость: малый
+// ведущий элемент матрицы I + V^T A^-1 U (обновлённая матрица близка к вырожденной) или выросшая
+// невязка A * (A^-1 x) - x на пробном векторе приводят к полному LU-разложению. Пока матрица
+// вырожденная, обратной нет, и каждое обновление пересчитывает разложение целиком.
+class FactorizedMatrix {
+public:
+    explicit FactorizedMatrix(ConstMatrixView matrix) : matrix_(matrix) {
+        if (!isSquareMatrix(matrix)) {
+            throw std::invalid_argument("Обновляемое разложение возможно только для квадратной матрицы");
+        }
+        refactor();
+    }
+
+    int size() const { return matrix_.rows(); }
+    ConstMatrixView matrix() const { return matrix_.view(); }
+    bool isSingular() const { return singular_; }
+    double determinant() const { return determinant_; }
+
+    // Ранг считается по запросу тем же findRank, что и без разложения: невырожденность LU его
+    // не гарантирует. Результат запоминается до следующего изменения
+    int rank() {
+        if (rank_ < 0) {
+            rank_ = findRank(matrix_);
+        }
+        return rank_;
+    }
+
+    const Matrix& inverse() const {
+        if (singular_) {
+            throw std::runtime_error("Матрица вырожденная, обратной матрицы не существует");
+        }
+        return inverse_;
+    }
+
+    // Решение системы A * x = b умножением на обратную за O(n^2)
+    std::vector<double> solve(const std::vector<double>& b) const {
+        if (static_cast<int>(b.size()) != size()) {
+            throw std::invalid_argument("Размер правой части не совпадает с размером матрицы");
+        }
+        return multiplyVector(inverse(), b);
+    }
+
+    // Замена элемента: A += (value - a_ij) * e_i * e_j^T
+    void setElement(int row, int col, double value) {
+        checkIndex(row);
+        checkIndex(col);
+        double delta = value - matrix_(row, col);
+        matrix_(row, col) = value;
+        if (delta == 0.0) {
+            return;
+        }
+        if (!beginUpdate()) {
+            return;
+        }
+        int n = size();
+        std::vector<double> column(n);
+        for (int k = 0; k < n; k++) {
+            column[k] = delta * inverse_(k, row);
+        }
+        std::vector<double> rowValues(inverse_.rowData(col), inverse_.rowData(col) + n);
+        applyRankOne(column, rowValues, column[col]);
+    }
+
+    // Замена строки: A += e_i * d^T, где d - разность новой и старой строки
+    void replaceRow(int row, const std::vector<double>& values) {
+        checkIndex(row);
+        checkLength(values);
+        int n = size();
+        std::vector<double> difference(n);
+        for (int j = 0; j < n; j++) {
+            difference[j] = values[j] - matrix_(row, j);
+        }
+        std::copy(values.begin(), values.end(), matrix_.rowData(row));
+        if (!beginUpdate()) {
+            return;
+        }
+        std::vector<double> column(n);
+        std::vector<double> rowValues(n, 0.0);
+        for (int k = 0; k < n; k++) {
+            column[k] = inverse_(k, row);
+            if (difference[k] != 0.0) {
+                rowUpdate(n, difference[k], inverse_.rowData(k), rowValues.data());
+            }
+        }
+        applyRankOne(column, rowValues, rowValues[row]);
+    }
+
+    // Замена столбца: A += d * e_j^T, где d - разность нового и старого столбца
+    void replaceColumn(int col, const std::vector<double>& values) {
+        checkIndex(col);
+        checkLength(values);
+        int n = size();
+        std::vector<double> difference(n);
+        for (int i = 0; i < n; i++) {
+            difference[i] = values[i] - matrix_(i, col);
+            matrix_(i, col) = values[i];
+        }
+        if (!beginUpdate()) {
+            return;
+        }
+        std::vector<double> column = multiplyVector(inverse_, difference);
+        std::vector<double> rowValues(inverse_.rowData(col), inverse_.rowData(col) + n);
+        applyRankOne(column, rowValues, column[col]);
+    }
+
+    // Добавка ранга k: A += U * V^T, где U и V - матрицы n x k
+    void update(ConstMatrixView u, ConstMatrixView v) {
+        int n = size();
+        if (u.rows() != n || v.rows() != n || u.cols() != v.cols()) {
+            throw std::invalid_argument("Множители добавки должны иметь размер n x k с общим k");
+        }
+        int k = u.cols();
+        if (k == 0) {
+            return;
+        }
+        gemmAccumulate(u, v.transposed(), matrix_);
+        if (!beginUpdate()) {
+            return;
+        }
+
+        Matrix y(n, k); // A^-1 U
+        gemmAccumulate(inverse_, u, y);
+        if (k == 1) {
+            std::vector<double> column(n);
+            std::vector<double> rowValues(n, 0.0);
+            double term = 0.0;
+            for (int i = 0; i < n; i++) {
+                column[i] = y(i, 0);
+                term += v(i, 0) * column[i];
+                if (v(i, 0) != 0.0) {
+                    rowUpdate(n, v(i, 0), inverse_.rowData(i), rowValues.data());
+                }
+            }
+            applyRankOne(column, rowValues, term);
+            return;
+        }
+
+        // Формула Вудбери: A^-1 -= A^-1 U * (I + V^T A^-1 U)^-1 * V^T A^-1
+        Matrix z(k, n); // V^T A^-1
+        gemmAccumulate(v.transposed(), inverse_, z);
+        Matrix capacitance(k, k);
+        for (int i = 0; i < k; i++) {
+            capacitance(i, i) = 1.0;
+        }
+        gemmAccumulate(v.transposed(), y, capacitance);
+        double scale = 1.0;
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j < k; j++) {
+                scale = (std::max)(scale, std::fabs(capacitance(i, j)));
+            }
+        }
+        LUDecomposition factors = decomposeLU(capacitance);
+        if (factors.singular || !stablePivots(factors, scale)) {
+            refactor();
+            return;
+        }
+        Matrix w(k, n); // (I + V^T A^-1 U)^-1 * V^T A^-1
+        gemmAccumulate(factors.inverse(), z, w);
+        gemmAccumulate(y, w, inverse_, -1.0);
+        determinant_ *= factors.determinant();
+        finishUpdate();
+    }
+
+    long long updates() const { return updates_; }
+    long long refactorizations() const { return refactorizations_; }
+    bool lastUpdateRefactorized() const { return lastRefactorized_; }
+
+private:
+    // Порог ведущего элемента I + V^T A^-1 U относительно его масштаба: ниже - обновление неустойчиво
+    static constexpr double StabilityTolerance = 1e-8;
+    // Наименьший допустимый предел относительной невязки после обновления
+    static constexpr double ResidualTolerance = 1e-12;
+
+    void checkIndex(int index) const {
+        if (index < 0 || index >= size()) {
+            throw std::out_of_range("Индекс " + std::to_string(index) + " вне матрицы размера " + std::to_string(size()));
+        }
+    }
+
+    void checkLength(const std::vector<double>& values) const {
+        if (static_cast<int>(values.size()) != size()) {
+            throw std::invalid_argument("Длина новой строки или столбца не совпадает с размером матрицы");
+        }
+    }
+
+    static std::vector<double> multiplyVector(const Matrix& matrix, const std::vector<double>& x) {
+        int n = matrix.rows();
+        std::vector<double> y(n);
+        for (int i = 0; i < n; i++) {
+            const double* row = matrix.rowData(i);
+            double sum = 0.0;
+            for (int j = 0; j < n; j++) {
+                sum += row[j] * x[j];
+            }
+            y[i] = sum;
+        }
+        return y;
+    }
+
+    // Начало обновления уже изменённой matrix_; false - вырожденная матрица пересчитана целиком
+    bool beginUpdate() {
+        updates_++;
+        lastRefactorized_ = false;
+        rank_ = -1;
+        if (singular_) {
+            refactor();
+            return false;
+        }
+        return true;
+    }
+
+    // Формула Шермана-Моррисона: A^-1 -= c * r^T / (1 + term), где c = A^-1 u, r^T = v^T A^-1, term = v^T A^-1 u
+    void applyRankOne(const std::vector<double>& column, const std::vector<double>& rowValues, double term) {
+        double denominator = 1.0 + term;
+        if (!(std::fabs(denominator) > StabilityTolerance * (std::max)(1.0, std::fabs(term)))) {
+            refactor();
+            return;
+        }
+        int n = size();
+        for (int i = 0; i < n; i++) {
+            if (column[i] != 0.0) {
+                rowUpdate(n, -column[i] / denominator, rowValues.data(), inverse_.rowData(i));
+            }
+        }
+        determinant_ *= denominator;
+        finishUpdate();
+    }
+
+    static bool stablePivots(const LUDecomposition& factors, double scale) {
+        for (int i = 0; i < factors.size(); i++) {
+            if (!(std::fabs(factors.lu(i, i)) > StabilityTolerance * scale)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Проверка накопленной погрешности обновлённой обратной; при росте невязки - полный пересчёт
+    void finishUpdate() {
+        if (!(probeResidual() <= residualLimit_)) {
+            refactor();
+        }
+    }
+
+    // Относительная покомпонентная невязка max |A y - x|_i / (sum_j |a_ij| |y_j| + |x_i|) при y = A^-1 x
+    // на фиксированном пробном векторе x; для точной обратной - порядка n * eps
+    double probeResidual() const {
+        int n = size();
+        std::vector<double> x(n);
+        for (int i = 0; i < n; i++) {
+            x[i] = (i % 2 == 0 ? 1.0 : -1.0) * (1.0 + (i % 7) * 0.125);
+        }
+        std::vector<double> y = multiplyVector(inverse_, x);
+        double worst = 0.0;
+        for (int i = 0; i < n; i++) {
+            const double* row = matrix_.rowData(i);
+            double sum = -x[i];
+            double scale = std::fabs(x[i]);
+            for (int j = 0; j < n; j++) {
+                sum += row[j] * y[j];
+                scale += std::fabs(row[j] * y[j]);
+            }
+            worst = (std::max)(worst, std::fabs(sum) / scale);
+        }
+        return worst;
+    }
+
+    // Полное LU-разложение текущей матрицы
+    void refactor() {
+        refactorizations_++;
+        lastRefactorized_ = true;
+        rank_ = -1;
+        LUDecomposition factors = decomposeLU(matrix_);
+        singular_ = factors.singular;
+        if (singular_) {
+            determinant_ = ::determinant(matrix_.view()); // Как у запроса det без разложения: малое или нулевое значение
+            inverse_ = Matrix(0, 0);
+            return;
+        }
+        determinant_ = factors.determinant();
+        inverse_ = factors.inverse();
+        residualLimit_ = (std::max)(ResidualTolerance, 64.0 * probeResidual());
+    }
+
+    Matrix matrix_;
+    Matrix inverse_;
+    double determinant_ = 1.0;
+    int rank_ = -1; // -1 - ранг ещё не посчитан
+    bool singular_ = false;
+    double residualLimit_ = ResidualTolerance;
+    long long updates_ = 0;
+    long long refactorizations_ = 0;
+    bool lastRefactorized_ = false;
+};
+
+// Признаки того, что determinant и inverseInto считают матрицу через плотное LU-разложение. Тогда одно
+// разложение (decomposeLU) можно посчитать заранее и разделить между определителем и обратной матрицей:
+// LUDecomposition::determinant и LUDecomposition::inverse дают те же самые значения.
+bool determinantUsesLU(ConstMatrixView matrix) {
+    return isSquareMatrix(matrix) && matrix.rows() > FixedMaxSize && !preferSparse(matrix);
+}
+
+bool inverseUsesLU(ConstMatrixView matrix) {
+    return isSquareMatrix(matrix) && !hasFixedSize(matrix);
+}
+
+// Режим сравнения элементов матриц: точный (как оператор ==), по абсолютной или относительной
+// погрешности или по расстоянию в единицах последнего разряда (ULP)
+enum class EqualityMode { Exact, Absolute, Relative, Ulp };
+
+// Допуск сравнения. Бесконечности равны только бесконечностям того же знака; NaN по умолчанию
+// не равен ничему, как у оператора ==, а с nanEqual равен любому другому NaN
+struct EqualityTolerance {
+    EqualityMode mode = EqualityMode::Exact;
+    double tolerance = 0.0; // Для Absolute и Relative
+    std::uint64_t ulps = 0; // Для Ulp
+    bool nanEqual = false;
+
+    bool isDefault() const { return mode == EqualityMode::Exact && !nanEqual; }
+};
+
+// Функция разбора допуска вида exact, abs:1e-9, rel:1e-12 или ulp:4
+EqualityTolerance parseEqualityTolerance(const std::string& text) {
+    EqualityTolerance tolerance;
+    std::size_t colon = text.find(':');
+    std::string mode = text.substr(0, colon);
+    std::string value = colon == std::string::npos ? std::string() : text.substr(colon + 1);
+    if (mode == "exact" && value.empty()) {
+        return tolerance;
+    }
+    if (value.empty()) {
+        throw std::invalid_argument("Неверный допуск сравнения " + text + " (exact, abs:x, rel:x или ulp:n)");
+    }
+    if (mode == "abs" || mode == "rel") {
+        tolerance.mode = mode == "abs" ? EqualityMode::Absolute : EqualityMode::Relative;
+        tolerance.tolerance = std::stod(value);
+        if (!(tolerance.tolerance >= 0.0)) {
+            throw std::invalid_argument("Допуск сравнения должен быть неотрицательным");
+        }
+    }
+    else if (mode == "ulp") {
+        tolerance.mode = EqualityMode::Ulp;
+        tolerance.ulps = std::stoull(value);
+    }
+    else {
+        throw std::invalid_argument("Неверный допуск сравнения " + text + " (exact, abs:x, rel:x или ulp:n)");
+    }
+    return tolerance;
+}
+
+// Положение числа на упорядоченной целочисленной шкале: соседние числа отличаются на 1, +0 и -0 совпадают
+std::uint64_t orderedBits(double value) {
+    constexpr std::uint64_t SignBit = 0x8000000000000000ull;
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & SignBit) != 0 ? SignBit - (bits & ~SignBit) : SignBit + bits;
+}
+
+// Функция сравнения двух элементов с допуском (эталон для векторного сравнения)
+bool elementsEqual(double x, double y, const EqualityTolerance& tolerance) {
+    if (x == y) {
+        return true;
+    }
+    if (std::isnan(x) || std::isnan(y)) {
+        return tolerance.nanEqual && std::isnan(x) && std::isnan(y);
+    }
+    if (std::isinf(x) || std::isinf(y)) {
+        return false;
+    }
+    switch (tolerance.mode) {
+    case EqualityMode::Absolute:
+        return std::abs(x - y) <= tolerance.tolerance;
+    case EqualityMode::Relative:
+        return std::abs(x - y) <= tolerance.tolerance * (std::max)(std::abs(x), std::abs(y));
+    case EqualityMode::Ulp: {
+        std::uint64_t a = orderedBits(x);
+        std::uint64_t b = orderedBits(y);
+        return (a > b ? a - b : b - a) <= tolerance.ulps;
+    }
+    default:
+        return false;
+    }
+}
+
+// Номер первой пары несовпадающих элементов массивов; count, если все пары совпадают
+std::size_t firstMismatchScalar(const double* a, const double* b, std::size_t count, const EqualityTolerance& tolerance) {
+    for (std::size_t i = 0; i < count; i++) {
+        if (!elementsEqual(a[i], b[i], tolerance)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+#if P2_X86
+// Блок из 16 элементов сравнивается векторно без ветвлений; если хотя бы одна пара не подтверждена
+// (различие, NaN или режим ULP), блок перепроверяется поэлементно и сравнение сразу заканчивается
+// на первом настоящем различии
+P2_TARGET_AVX2
+inline __m256d elementsMatchAvx2(const double* a, const double* b, const EqualityTolerance& tolerance) {
+    __m256d x = _mm256_loadu_pd(a);
+    __m256d y = _mm256_loadu_pd(b);
+    __m256d equal = _mm256_cmp_pd(x, y, _CMP_EQ_OQ);
+    if (tolerance.mode == EqualityMode::Absolute || tolerance.mode == EqualityMode::Relative) {
+        // |x - y| <= допуск при конечной разности; совпадает с elementsEqual для конечных x и y
+        const __m256d signMask = _mm256_set1_pd(-0.0);
+        __m256d difference = _mm256_andnot_pd(signMask, _mm256_sub_pd(x, y));
+        __m256d limit = _mm256_set1_pd(tolerance.tolerance);
+        if (tolerance.mode == EqualityMode::Relative) {
+            limit = _mm256_mul_pd(limit, _mm256_max_pd(_mm256_andnot_pd(signMask, x), _mm256_andnot_pd(signMask, y)));
+        }
+        __m256d finite = _mm256_cmp_pd(difference, _mm256_set1_pd(std::numeric_limits<double>::infinity()), _CMP_LT_OQ);
+        equal = _mm256_or_pd(equal, _mm256_and_pd(_mm256_cmp_pd(difference, limit, _CMP_LE_OQ), finite));
+    }
+    return equal;
+}
+
+P2_TARGET_AVX2
+std::size_t firstMismatchAvx2(const double* a, const double* b, std::size_t count, const EqualityTolerance& tolerance) {
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256d all = _mm256_and_pd(
+            _mm256_and_pd(elementsMatchAvx2(a + i, b + i, tolerance), elementsMatchAvx2(a + i + 4, b + i + 4, tolerance)),
+            _mm256_and_pd(elementsMatchAvx2(a + i + 8, b + i + 8, tolerance), elementsMatchAvx2(a + i + 12, b + i + 12, tolerance)));
+        if (_mm256_movemask_pd(all) == 0xF) {
+            continue;
+        }
+        std::size_t position = firstMismatchScalar(a + i, b + i, 16, tolerance);
+        if (position < 16) {
+            return i + position;
+        }
+    }
+    return i + firstMismatchScalar(a + i, b + i, count - i, tolerance);
+}
+#endif
+
+// Функция выбора ядра сравнения массивов по возможностям процессора
+using MismatchScan = std::size_t (*)(const double* a, const double* b, std::size_t count, const EqualityTolerance& tolerance);
+
+MismatchScan mismatchScan() {
+    static const MismatchScan scan = [] {
+#if P2_X86
+        if (cpuFeatures().avx2) {
+            return static_cast<MismatchScan>(firstMismatchAvx2);
+        }
+#endif
+        return static_cast<MismatchScan>(firstMismatchScalar);
+    }();
+    return scan;
+}
+
+// Функция для проверки на равенство двух матриц с допуском tolerance (размеры совпадают, а каждая
+// пара элементов равна в смысле elementsEqual). Пустые матрицы одного размера равны.
+bool areMatricesEqual(ConstMatrixView matrix1, ConstMatrixView matrix2, const EqualityTolerance& tolerance) {
+    ProfileScope profile("equal");
+    if (matrix1.rows() != matrix2.rows() || matrix1.cols() != matrix2.cols()) {
+        return false; // Матрицы разных размеров
+    }
+
+    MismatchScan scan = mismatchScan();
+    std::size_t cols = static_cast<std::size_t>(matrix1.cols());
+    for (int i = 0; i < matrix1.rows(); i++) {
+        if (matrix1.hasContiguousRows() && matrix2.hasContiguousRows()) {
+            if (scan(matrix1.rowData(i), matrix2.rowData(i), cols, tolerance) < cols) {
+                return false; // Найдены различающиеся элементы
+            }
+            continue;
+        }
+        for (int j = 0; j < matrix1.cols(); j++) {
+            if (!elementsEqual(matrix1(i, j), matrix2(i, j), tolerance)) {
+                return false;
+            }
+        }
+    }
+
+    return true; // Матрицы равны
+}
+
+// Функция для проверки на равенство двух матриц (2 матрицы равны по размерам и значениям внутри них)
+bool areMatricesEqual(ConstMatrixView matrix1, ConstMatrixView matrix2) {
+    return areMatricesEqual(matrix1, matrix2, EqualityTolerance());
+}
+
+// Потоковый 64-битный отпечаток матрицы: элементы подаются по строкам любыми порциями (например, по мере
+// чтения или вычисления), результат не зависит от разбиения на порции. Перед перемешиванием -0 заменяется
+// на +0, а любой NaN - на один и тот же, поэтому точно равные матрицы (в том числе с nanEqual) всегда
+// имеют равные отпечатки, и различие отпечатков исключает равенство без просмотра элементов.
+// Четыре независимые цепочки перемешивания, чтобы отпечаток больших матриц не упирался в задержку умножения.
+class MatrixFingerprint {
+public:
+    void update(const double* values, std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            mix(values[i]);
+        }
+    }
+
+    void update(double value) { mix(value); }
+
+    // Итоговое значение с учётом размеров матрицы; накопленное состояние не меняется
+    std::uint64_t value(int rows, int cols) const {
+        std::uint64_t hash = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(rows)) << 32) | static_cast<std::uint32_t>(cols);
+        for (std::uint64_t lane : lanes_) {
+            hash = (hash ^ lane) * 0xBF58476D1CE4E5B9ull;
+            hash ^= hash >> 31;
+        }
+        return hash;
+    }
+
+private:
+    void mix(double value) {
+        value += 0.0; // -0 + 0 = +0
+        if (value != value) {
+            value = std::numeric_limits<double>::quiet_NaN();
+        }
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        std::uint64_t& lane = lanes_[position_++ & 3];
+        lane = (lane ^ bits) * 0x9E3779B97F4A7C15ull;
+        lane ^= lane >> 29;
+    }
+
+    std::uint64_t lanes_[4] = { 0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull };
+    std::size_t position_ = 0;
+};
+
+// Функция вычисления отпечатка матрицы целиком
+std::uint64_t contentHash(ConstMatrixView matrix) {
+    ProfileScope profile("hash");
+    MatrixFingerprint fingerprint;
+    for (int i = 0; i < matrix.rows(); i++) {
+        if (matrix.hasContiguousRows()) {
+            fingerprint.update(matrix.rowData(i), static_cast<std::size_t>(matrix.cols()));
+        }
+        else {
+            for (int j = 0; j < matrix.cols(); j++) {
+                fingerprint.update(matrix(i, j));
+            }
+        }
+    }
+    return fingerprint.value(matrix.rows(), matrix.cols());
+}
+
+// Функция сложения двух матриц в заранее выделенную матрицу result того же размера
+void addInto(ConstMatrixView matrix1, ConstMatrixView matrix2, MatrixView result) {
+    if (matrix1.rows() != matrix2.rows() || matrix1.cols() != matrix2.cols()
+        || result.rows() != matrix1.rows() || result.cols() != matrix1.cols()) {
+        throw std::invalid_argument("Размеры слагаемых и результата не совпадают");
+    }
+
+    int rows = matrix1.rows();
+    int cols = matrix1.cols();
+    ProfileScope profile("add");
+    profile.addFlops(static_cast<double>(rows) * cols);
+
+    // Полоса строк складывается без проверок и сразу, пока она в кэше, проверяется на переполнение
+    auto addRows = [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            double* resultRow = result.rowData(i);
+            if (matrix1.hasContiguousRows() && matrix2.hasContiguousRows()) {
+                const double* row1 = matrix1.rowData(i);
+                const double* row2 = matrix2.rowData(i);
+                for (int j = 0; j < cols; j++) {
+                    resultRow[j] = row1[j] + row2[j];
+                }
+            }
+            else {
+                for (int j = 0; j < cols; j++) {
+                    resultRow[j] = matrix1(i, j) + matrix2(i, j);
+                }
+            }
+        }
+        checkFiniteRows(result, first, last, "Переполнение при сложении элементов матриц");
+    };
+
+    if (static_cast<std::size_t>(rows) * cols >= ParallelMinElements) {
+        int grain = (std::max)(1, static_cast<int>(ParallelMinElements / 4 / cols));
+        threadPool().parallelFor(0, rows, grain, addRows);
+    }
+    else {
+        addRows(0, rows);
+    }
+}
+
+// Функция сложения двух матриц
+Matrix addMatrices(ConstMatrixView matrix1, ConstMatrixView matrix2) {
+    // Проверка, что обе матрицы имеют одинаковое количество строк и столбцов
+    if (matrix1.rows() != matrix2.rows() || matrix1.cols() != matrix2.cols()) {
+        std::cerr << "Матрицы должны иметь одинаковое количество строк и столбцов." << std::endl;
+        return Matrix(); // Возвращаем пустую матрицу
+    }
+
+    Matrix result(matrix1.rows(), matrix1.cols());
+    addInto(matrix1, matrix2, result);
+    return result;
+}
+
+// Функция умножения двух матриц в заранее выделенную матрицу result (строки подряд) размера rows1 x cols2
+void multiplyInto(ConstMatrixView matrix1, ConstMatrixView matrix2, MatrixView result) {
+    if (matrix1.cols() != matrix2.rows() || result.rows() != matrix1.rows() || result.cols() != matrix2.cols()) {
+        throw std::invalid_argument("Размеры множителей и результата не согласованы");
+    }
+
+    ProfileScope profile("multiply");
+    profile.addFlops(2.0 * matrix1.rows() * matrix1.cols() * matrix2.cols());
+
+    if (preferSparse(matrix1) && preferSparse(matrix2)) {
+        // Оба множителя почти нулевые: произведение разреженных матриц и раскладка в плотный результат
+        multiplySparse(SparseMatrix::fromDense(matrix1), SparseMatrix::fromDense(matrix2)).toDense(result);
+    }
+    else if (hasFixedSize(matrix1) && hasFixedSize(matrix2) && matrix1.rows() == matrix2.rows()) {
+        fixedMultiply(matrix1, matrix2, result);
+    }
+    else {
+        for (int i = 0; i < result.rows(); i++) {
+            std::fill(result.rowData(i), result.rowData(i) + result.cols(), 0.0);
+        }
+        gemmAccumulate(matrix1, matrix2, result);
+    }
+
+    // Проверка переполнения одним проходом по результату вместо ветвления во внутреннем цикле
+    checkFiniteRows(result, 0, result.rows(), "Переполнение при умножении матриц");
+}
+
+// Функция умножения двух матриц
+Matrix multiplyMatrices(ConstMatrixView matrix1, ConstMatrixView matrix2) {
+    // Проверка, что количество столбцов в первой матрице равно количеству строк во второй матрице
+    if (matrix1.cols() != matrix2.rows()) {
+        std::cerr << "Количество столбцов в первой матрице должно быть равно количеству строк во второй матрице." << std::endl;
+        return Matrix();
+    }
+
+    Matrix result(matrix1.rows(), matrix2.cols());
+    multiplyInto(matrix1, matrix2, result);
+    return result;
+}
+
+// Функция преобразования типа элементов матрицы. Дробные числа округляются к ближайшему представимому
+// значению; при переводе в целые каждый элемент обязан быть целым числом в диапазоне int64.
+template <typename U, typename T>
+BasicMatrix<U> convertMatrix(BasicMatrixView<const T> source) {
+    BasicMatrix<U> result(source.rows(), source.cols());
+    for (int i = 0; i < source.rows(); i++) {
+        U* row = result.rowData(i);
+        for (int j = 0; j < source.cols(); j++) {
+            T value = source(i, j);
+            if constexpr (std::is_integral<U>::value && !std::is_integral<T>::value) {
+                // 2^63 представимо точно, поэтому проверка диапазона не теряет точности
+                const T limit = static_cast<T>(9223372036854775808.0);
+                if (!(value >= -limit && value < limit) || std::trunc(value) != value) {
+                    throw std::invalid_argument("Элемент [" + std::to_string(i) + "][" + std::to_string(j) + "] не является целым числом в диапазоне int64");
+                }
+            }
+            row[j] = static_cast<U>(value);
+        }
+    }
+    return result;
+}
+
+template <typename U>
+BasicMatrix<U> convertMatrix(ConstMatrixView source) {
+    return convertMatrix<U, double>(source);
+}
+
+template <typename U, typename T>
+BasicMatrix<U> convertMatrix(const BasicMatrix<T>& source) {
+    return convertMatrix<U, T>(source.view());
+}
+
+// Функция преобразования матрицы с элементами типа T в основную матрицу Matrix с элементами double
+template <typename T, EnableIfOtherElement<T> = 0>
+Matrix toMatrix(const BasicMatrix<T>& source) {
+    Matrix result(source.rows(), source.cols());
+    for (std::size_t i = 0; i < source.size(); i++) {
+        result.data()[i] = static_cast<double>(source.data()[i]);
+    }
+    return result;
+}
+
+// Целочисленные операции с проверкой переполнения: false, если результат не помещается в int64
+bool checkedAdd(std::int64_t a, std::int64_t b, std::int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_add_overflow(a, b, &result);
+#else
+    if ((b > 0 && a > (std::numeric_limits<std::int64_t>::max)() - b) || (b < 0 && a < (std::numeric_limits<std::int64_t>::min)() - b)) {
+        return false;
+    }
+    result = a + b;
+    return true;
+#endif
+}
+
+bool checkedSubtract(std::int64_t a, std::int64_t b, std::int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_sub_overflow(a, b, &result);
+#else
+    if ((b < 0 && a > (std::numeric_limits<std::int64_t>::max)() + b) || (b > 0 && a < (std::numeric_limits<std::int64_t>::min)() + b)) {
+        return false;
+    }
+    result = a - b;
+    return true;
+#endif
+}
+
+bool checkedMultiply(std::int64_t a, std::int64_t b, std::int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_mul_overflow(a, b, &result);
+#else
+    if (a != 0 && b != 0) {
+        const std::int64_t max = (std::numeric_limits<std::int64_t>::max)();
+        const std::int64_t min = (std::numeric_limits<std::int64_t>::min)();
+        bool overflow = a > 0 ? (b > 0 ? a > max / b : b < min / a) : (b > 0 ? a < min / b : b < max / a);
+        if (overflow) {
+            return false;
+        }
+    }
+    result = a * b;
+    return true;
+#endif
+}
+
+// Шаг исключения Барейса: (a * b - c * d) / divisor. Деление нацело гарантировано тождеством Сильвестра.
+// С 128-битными промежуточными значениями переполнение возможно только для самого результата,
+// без них - уже для произведений; в обоих случаях возвращается false.
+bool bareissStep(std::int64_t a, std::int64_t b, std::int64_t c, std::int64_t d, std::int64_t divisor, std::int64_t& result) {
+#ifdef __SIZEOF_INT128__
+    __int128 value = (static_cast<__int128>(a) * b - static_cast<__int128>(c) * d) / divisor;
+    if (value > (std::numeric_limits<std::int64_t>::max)() || value < (std::numeric_limits<std::int64_t>::min)()) {
+        return false;
+    }
+    result = static_cast<std::int64_t>(value);
+    return true;
+#else
+    std::int64_t ab = 0;
+    std::int64_t cd = 0;
+    std::int64_t difference = 0;
+    if (!checkedMultiply(a, b, ab) || !checkedMultiply(c, d, cd) || !checkedSubtract(ab, cd, difference)
+        || (difference == (std::numeric_limits<std::int64_t>::min)() && divisor == -1)) {
+        return false;
+    }
+    result = difference / divisor;
+    return true;
+#endif
+}
+
+// Результат точного исключения: ранг и (для квадратной матрицы) определитель
+struct ExactElimination {
+    int rank = 0;
+    std::int64_t determinant = 0;
+};
+
+// Исключение Барейса на месте без дробей: после шага k каждый элемент оставшейся части равен минору
+// порядка k + 1 исходной матрицы, поэтому все промежуточные значения целые, а последний ведущий
+// элемент - определитель. Столбцы без ненулевого ведущего элемента пропускаются (они не увеличивают ранг).
+// false, если промежуточное значение не помещается в int64.
+bool eliminateBareiss(BasicMatrixView<std::int64_t> a, ExactElimination& result) {
+    int m = a.rows();
+    int n = a.cols();
+    ProfileScope profile("bareiss");
+
+    int rank = 0;
+    int sign = 1;
+    std::int64_t previous = 1;
+    for (int col = 0; col < n && rank < m; col++) {
+        int pivotRow = rank;
+        while (pivotRow < m && a(pivotRow, col) == 0) {
+            pivotRow++;
+        }
+        if (pivotRow == m) {
+            continue;
+        }
+        if (pivotRow != rank) {
+            std::swap_ranges(a.rowData(pivotRow), a.rowData(pivotRow) + n, a.rowData(rank));
+            sign = -sign;
+        }
+
+        std::int64_t pivot = a(rank, col);
+        const std::int64_t* pivotRowValues = a.rowData(rank);
+        for (int i = rank + 1; i < m; i++) {
+            std::int64_t* current = a.rowData(i);
+            std::int64_t factor = current[col];
+            for (int j = col + 1; j < n; j++) {
+                if (!bareissStep(current[j], pivot, factor, pivotRowValues[j], previous, current[j])) {
+                    return false;
+                }
+            }
+            current[col] = 0;
+        }
+        previous = pivot;
+        rank++;
+    }
+
+    result.rank = rank;
+    result.determinant = 0;
+    if (m == n && rank == n) {
+        result.determinant = sign > 0 ? previous : -previous;
+        if (sign < 0 && previous == (std::numeric_limits<std::int64_t>::min)()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Функция точного исключения копии целочисленной матрицы; при переполнении - overflow_error
+ExactElimination exactElimination(const IntegerMatrix& matrix) {
+    IntegerMatrix work(matrix);
+    ExactElimination result;
+    if (!eliminateBareiss(work.view(), result)) {
+        throw std::overflow_error("Промежуточные значения исключения Барейса не помещаются в 64-битное целое");
+    }
+    return result;
+}
+
+// Операции над матрицами с элементами типа T. В отличие от вариантов для double, которые сообщают
+// об ошибке в поток и возвращают пустую матрицу, здесь ошибки - исключения: invalid_argument при
+// несогласованных размерах, runtime_error для вырожденной матрицы, overflow_error при переполнении
+// (для целых - точный выход за диапазон int64, для дробных - бесконечность или NaN в результате).
+
+// Проверка результата дробного типа на бесконечности и NaN
+template <typename T>
+void checkFiniteMatrix(const BasicMatrix<T>& result, const char* message) {
+    for (int i = 0; i < result.rows(); i++) {
+        const T* row = result.rowData(i);
+        for (int j = 0; j < result.cols(); j++) {
+            if (!std::isfinite(row[j])) {
+                throwOverflow(message, i, j);
+            }
+        }
+    }
+}
+
+// Функция сложения двух матриц с элементами типа T
+template <typename T, EnableIfOtherElement<T> = 0>
+BasicMatrix<T> addMatrices(const BasicMatrix<T>& matrix1, const BasicMatrix<T>& matrix2) {
+    if (matrix1.rows() != matrix2.rows() || matrix1.cols() != matrix2.cols()) {
+        throw std::invalid_argument("Матрицы должны иметь одинаковое количество строк и столбцов");
+    }
+    ProfileScope profile("add");
+    profile.addFlops(static_cast<double>(matrix1.size()));
+
+    BasicMatrix<T> result(matrix1.rows(), matrix1.cols());
+    for (int i = 0; i < result.rows(); i++) {
+        const T* row1 = matrix1.rowData(i);
+        const T* row2 = matrix2.rowData(i);
+        T* resultRow = result.rowData(i);
+        for (int j = 0; j < result.cols(); j++) {
+            if constexpr (std::is_integral<T>::value) {
+                if (!checkedAdd(row1[j], row2[j], resultRow[j])) {
+                    throwOverflow("Переполнение при сложении элементов матриц", i, j);
+                }
+            }
+            else {
+                resultRow[j] = row1[j] + row2[j];
+            }
+        }
+    }
+    if constexpr (!std::is_integral<T>::value) {
+        checkFiniteMatrix(result, "Переполнение при сложении элементов матриц");
+    }
+    return result;
+}
+
+// Функция умножения двух матриц с элементами типа T. Порядок циклов i-k-j: строка результата
+// накапливается обновлениями rowUpdate4 по четыре строки второго множителя, а k и j разбиты на блоки,
+// чтобы блок второго множителя оставался в кэше, пока через него проходят все строки первого.
+template <typename T, EnableIfOtherElement<T> = 0>
+BasicMatrix<T> multiplyMatrices(const BasicMatrix<T>& matrix1, const BasicMatrix<T>& matrix2) {
+    if (matrix1.cols() != matrix2.rows()) {
+        throw std::invalid_argument("Количество столбцов в первой матрице должно быть равно количеству строк во второй матрице");
+    }
+    int rows = matrix1.rows();
+    int inner = matrix1.cols();
+    int cols = matrix2.cols();
+    ProfileScope profile("multiply");
+    profile.addFlops(2.0 * rows * inner * cols);
+
+    // Блок второго множителя GemmKC x columnBlock занимает около 256 КБ и остаётся в L2
+    const int columnBlock = (std::max)(16, static_cast<int>(256 * 1024 / (GemmKC * sizeof(T))) / 16 * 16);
+    BasicMatrix<T> result(rows, cols);
+    for (int jBlock = 0; jBlock < cols; jBlock += columnBlock) {
+        int width = (std::min)(cols - jBlock, columnBlock);
+        for (int kBlock = 0; kBlock < inner; kBlock += GemmKC) {
+            int kEnd = (std::min)(inner, kBlock + GemmKC);
+            for (int i = 0; i < rows; i++) {
+                const T* rowA = matrix1.rowData(i);
+                T* resultRow = result.rowData(i) + jBlock;
+                for (int k = kBlock; k < kEnd; k++) {
+                    const T* rowB = matrix2.rowData(k) + jBlock;
+                    if constexpr (std::is_integral<T>::value) {
+                        for (int j = 0; j < width; j++) {
+                            std::int64_t product = 0;
+                            if (!checkedMultiply(rowA[k], rowB[j], product) || !checkedAdd(resultRow[j], product, resultRow[j])) {
+                                throwOverflow("Переполнение при умножении матриц", i, jBlock + j);
+                            }
+                        }
+                    }
+                    else if (k + 4 <= kEnd) {
+                        rowUpdate4(width, rowA + k, rowB, matrix2.cols(), resultRow);
+                        k += 3;
+                    }
+                    else {
+                        rowUpdate(width, rowA[k], rowB, resultRow);
+                    }
+                }
+            }
+        }
+    }
+    if constexpr (!std::is_integral<T>::value) {
+        checkFiniteMatrix(result, "Переполнение при умножении матриц");
+    }
+    return result;
+}
+
+// Функция вычисления определителя матрицы с элементами типа T: для дробных типов - LU-разложение,
+// для целых - точное исключение Барейса
+template <typename T, EnableIfOtherElement<T> = 0>
+T determinant(const BasicMatrix<T>& matrix) {
+    if (matrix.rows() != matrix.cols()) {
+        throw std::invalid_argument("Определитель существует только для квадратной матрицы");
+    }
+    int n = matrix.rows();
+    if (n == 0) {
+        return 1;
+    }
+    if constexpr (std::is_integral<T>::value) {
+        return exactElimination(matrix).determinant;
+    }
+    else {
+        BasicMatrix<T> lu(matrix);
+        std::vector<int> permutation(n);
+        LUFactorInfo info = factorLUInPlace(lu.view(), permutation.data());
+        T result = static_cast<T>(info.sign);
+        for (int i = 0; i < n; i++) {
+            result *= lu(i, i);
+        }
+        return result;
+    }
+}
+
+// Функция вычисления обратной матрицы с элементами дробного типа T
+template <typename T, EnableIfOtherElement<T> = 0>
+BasicMatrix<T> inverseMatrix(const BasicMatrix<T>& matrix) {
+    static_assert(!std::is_integral<T>::value, "Обратная матрица целочисленной матрицы в общем случае не целочисленна");
+    if (matrix.rows() != matrix.cols()) {
+        throw std::invalid_argument("Обратная матрица существует только для квадратной матрицы");
+    }
+    int n = matrix.rows();
+    BasicMatrix<T> lu(matrix);
+    std::vector<int> permutation(n);
+    if (factorLUInPlace(lu.view(), permutation.data()).singular) {
+        throw std::runtime_error("Матрица вырожденная, обратной матрицы не существует");
+    }
+    BasicMatrix<T> result(n, n);
+    inverseFromLU<T>(lu.view(), permutation.data(), result.view());
+    return result;
+}
+
+// Функция вычисления ранга матрицы с элементами типа T: для целых - точный ранг исключением Барейса,
+// для дробных - тот же алгоритм, что для double (исключение с перепроверкой QR), с порогом по eps(T)
+template <typename T, EnableIfOtherElement<T> = 0>
+int findRank(const BasicMatrix<T>& matrix) {
+    if constexpr (std::is_integral<T>::value) {
+        return exactElimination(matrix).rank;
+    }
+    else {
+        if (matrix.empty()) {
+            return 0;
+        }
+        return findDenseRank<T>(matrix.view(), RankOptions(), threadWorkspace());
+    }
+}
+
+// Явные инстанцирования для поддерживаемых типов элементов: все варианты компилируются вместе с программой
+template class BasicMatrix<float>;
+template class BasicMatrix<long double>;
+template class BasicMatrix<std::int64_t>;
+template FloatMatrix addMatrices(const FloatMatrix&, const FloatMatrix&);
+template LongDoubleMatrix addMatrices(const LongDoubleMatrix&, const LongDoubleMatrix&);
+template IntegerMatrix addMatrices(const IntegerMatrix&, const IntegerMatrix&);
+template FloatMatrix multiplyMatrices(const FloatMatrix&, const FloatMatrix&);
+template LongDoubleMatrix multiplyMatrices(const LongDoubleMatrix&, const LongDoubleMatrix&);
+template IntegerMatrix multiplyMatrices(const IntegerMatrix&, const IntegerMatrix&);
+template float determinant(const FloatMatrix&);
+template long double determinant(const LongDoubleMatrix&);
+template std::int64_t determinant(const IntegerMatrix&);
+template FloatMatrix inverseMatrix(const FloatMatrix&);
+template LongDoubleMatrix inverseMatrix(const LongDoubleMatrix&);
+template int findRank(const FloatMatrix&);
+template int findRank(const LongDoubleMatrix&);
+template int findRank(const IntegerMatrix&);
+
+// Решение системы L * U * x = P * b по LU-разложению на месте (b и x - массивы из n элементов)
+template <typename T>
+void solveFromLU(BasicMatrixView<const T> lu, const int* permutation, const T* b, T* x) {
+    int n = lu.rows();
+    for (int i = 0; i < n; i++) {
+        T sum = b[permutation[i]];
+        const T* row = lu.rowData(i);
+        for (int k = 0; k < i; k++) {
+            sum -= row[k] * x[k];
+        }
+        x[i] = sum;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        T sum = x[i];
+        const T* row = lu.rowData(i);
+        for (int k = i + 1; k < n; k++) {
+            sum -= row[k] * x[k];
+        }
+        x[i] = sum / row[i];
+    }
+}
+
+// Решение системы A * x = b со смешанной точностью: LU-разложение считается в float (вдвое меньше
+// памяти и вдвое шире SIMD), а точность double достигается итерационным уточнением - невязка
+// b - A * x считается в double, поправка находится по разложению float. Если разложение float
+// вырождено или уточнение не сходится (число обусловленности порядка 1 / eps(float) и больше),
+// система решается обычным LU-разложением в double.
+std::vector<double> solveMixedPrecision(ConstMatrixView a, const std::vector<double>& b, int maxIterations = 30) {
+    int n = a.rows();
+    if (a.cols() != n || static_cast<int>(b.size()) != n) {
+        throw std::invalid_argument("Размеры матрицы и правой части не согласованы");
+    }
+    ProfileScope profile("mixed solve");
+
+    FloatMatrix lu = convertMatrix<float>(a);
+    std::vector<int> permutation(n);
+    bool finite = std::all_of(lu.data(), lu.data() + lu.size(), [](float value) { return std::isfinite(value); });
+    if (finite && !factorLUInPlace(lu.view(), permutation.data()).singular) {
+        std::vector<double> x(n, 0.0);
+        std::vector<float> residual(n);
+        std::vector<float> correction(n);
+        double previousNorm = std::numeric_limits<double>::infinity();
+        for (int iteration = 0; iteration < maxIterations; iteration++) {
+            for (int i = 0; i < n; i++) {
+                double sum = b[i];
+                for (int j = 0; j < n; j++) {
+                    sum -= a(i, j) * x[j];
+                }
+                residual[i] = static_cast<float>(sum);
+            }
+            solveFromLU<float>(lu.view(), permutation.data(), residual.data(), correction.data());
+
+            double correctionNorm = 0.0;
+            double solutionNorm = 0.0;
+            for (int i = 0; i < n; i++) {
+                x[i] += correction[i];
+                correctionNorm = (std::max)(correctionNorm, std::fabs(static_cast<double>(correction[i])));
+                solutionNorm = (std::max)(solutionNorm, std::fabs(x[i]));
+            }
+            if (!std::isfinite(correctionNorm)) {
+                break;
+            }
+            // Поправка упала до уровня округления double - решение получено
+            if (correctionNorm <= std::numeric_limits<double>::epsilon() * solutionNorm) {
+                return x;
+            }
+            // Поправка перестала убывать: либо достигнут предел точности, либо итерации расходятся
+            if (correctionNorm > 0.5 * previousNorm) {
+                if (correctionNorm <= n * std::numeric_limits<double>::epsilon() * solutionNorm) {
+                    return x;
+                }
+                break;
+            }
+            previousNorm = correctionNorm;
+        }
+    }
+    return decomposeLU(a).solve(b);
+}
+
+// Число матриц в одном блоке пакета: ширина регистра AVX-512 в числах double
+constexpr int MatrixBatchLanes = 8;
+
+// Пакет из count матриц одного размера rows x cols в чередующемся формате "структура массивов":
+// одноимённые элементы всех матриц лежат подряд, поэтому SIMD-регистр содержит один и тот же элемент
+// нескольких соседних матриц, и одна формула считает сразу 4 или 8 матриц. Элемент (i, j) матрицы m
+// хранится в data()[(i * cols + j) * stride() + m], где stride() - число матриц, округлённое вверх
+// до MatrixBatchLanes; матрицы в хвосте сверх count нулевые.
+class MatrixBatch {
+public:
+    MatrixBatch() = default;
+
+    MatrixBatch(int count, int rows, int cols)
+        : count_(checkDimension(count)), rows_(checkDimension(rows)), cols_(checkDimension(cols)),
+          stride_((count_ + MatrixBatchLanes - 1) / MatrixBatchLanes * MatrixBatchLanes), data_(allocateAligned(bufferSize())) {
+        std::fill(data_, data_ + bufferSize(), 0.0);
+    }
+
+    MatrixBatch(const MatrixBatch& other)
+        : count_(other.count_), rows_(other.rows_), cols_(other.cols_), stride_(other.stride_), data_(allocateAligned(other.bufferSize())) {
+        std::copy(other.data_, other.data_ + bufferSize(), data_);
+    }
+
+    MatrixBatch(MatrixBatch&& other) noexcept
+        : count_(other.count_), rows_(other.rows_), cols_(other.cols_), stride_(other.stride_), data_(other.data_) {
+        other.count_ = 0;
+        other.rows_ = 0;
+        other.cols_ = 0;
+        other.stride_ = 0;
+        other.data_ = nullptr;
+    }
+
+    MatrixBatch& operator=(const MatrixBatch& other) {
+        if (this != &other) {
+            MatrixBatch copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    MatrixBatch& operator=(MatrixBatch&& other) noexcept {
+        MatrixBatch moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~MatrixBatch() { freeAligned(data_); }
+
+    void swap(MatrixBatch& other) noexcept {
+        std::swap(count_, other.count_);
+        std::swap(rows_, other.rows_);
+        std::swap(cols_, other.cols_);
+        std::swap(stride_, other.stride_);
+        std::swap(data_, other.data_);
+    }
+
+    int count() const { return count_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    int stride() const { return stride_; }
+    int blocks() const { return stride_ / MatrixBatchLanes; }
+    int elements() const { return rows_ * cols_; }
+
+    double* data() { return data_; }
+    const double* data() const { return data_; }
+
+    // Элемент (i, j) первой матрицы; тот же элемент следующих матриц идёт за ним подряд
+    double* element(int i, int j) { return data_ + static_cast<std::size_t>(i * cols_ + j) * stride_; }
+    const double* element(int i, int j) const { return data_ + static_cast<std::size_t>(i * cols_ + j) * stride_; }
+
+    double& operator()(int m, int i, int j) { return element(i, j)[m]; }
+    double operator()(int m, int i, int j) const { return element(i, j)[m]; }
+
+    // Запись матрицы с номером m; размеры матрицы должны совпадать с размерами матриц пакета
+    void set(int m, ConstMatrixView matrix) {
+        checkIndex(m);
+        if (matrix.rows() != rows_ || matrix.cols() != cols_) {
+            throw std::invalid_argument("Размер матрицы не совпадает с размером матриц пакета");
+        }
+        for (int i = 0; i < rows_; i++) {
+            for (int j = 0; j < cols_; j++) {
+                element(i, j)[m] = matrix(i, j);
+            }
+        }
+    }
+
+    // Копия матрицы с номером m в result (размер result должен совпадать с размером матриц пакета)
+    void get(int m, MatrixView result) const {
+        checkIndex(m);
+        if (result.rows() != rows_ || result.cols() != cols_) {
+            throw std::invalid_argument("Размер матрицы не совпадает с размером матриц пакета");
+        }
+        for (int i = 0; i < rows_; i++) {
+            for (int j = 0; j < cols_; j++) {
+                result(i, j) = element(i, j)[m];
+            }
+        }
+    }
+
+    Matrix get(int m) const {
+        Matrix result(rows_, cols_);
+        get(m, result);
+        return result;
+    }
+
+private:
+    static int checkDimension(int value) {
+        if (value < 0) {
+            throw std::invalid_argument("Размеры пакета матриц не могут быть отрицательными");
+        }
+        return value;
+    }
+
+    void checkIndex(int m) const {
+        if (m < 0 || m >= count_) {
+            throw std::out_of_range("Номер матрицы выходит за пределы пакета");
+        }
+    }
+
+    std::size_t bufferSize() const { return static_cast<std::size_t>(elements()) * static_cast<std::size_t>(stride_); }
+
+    int count_ = 0;
+    int rows_ = 0;
+    int cols_ = 0;
+    int stride_ = 0;
+    double* data_ = nullptr;
+};
+
+// SIMD-значения ядер над пакетами: Width соседних матриц пакета за одну операцию.
+// Скалярный вариант - запасной путь для процессоров без AVX2 и других архитектур.
+struct ScalarLanes {
+    static constexpr int Width = 1;
+
+    ScalarLanes() = default;
+    explicit ScalarLanes(double value) : value(value) {}
+
+    static ScalarLanes load(const double* p) { return ScalarLanes(*p); }
+    void store(double* p) const { *p = value; }
+
+    static ScalarLanes multiplyAdd(ScalarLanes a, ScalarLanes b, ScalarLanes c) { return ScalarLanes(a.value * b.value + c.value); }
+    static ScalarLanes absolute(ScalarLanes a) { return ScalarLanes(std::fabs(a.value)); }
+    static ScalarLanes maximum(ScalarLanes a, ScalarLanes b) { return ScalarLanes((std::max)(a.value, b.value)); }
+
+    // 1 / x там, где |x| > tolerance и результат конечен, иначе 0; mask - биты лан, где обращение удалось
+    static ScalarLanes reciprocalAbove(ScalarLanes x, ScalarLanes tolerance, unsigned& mask) {
+        double reciprocal = 1.0 / x.value;
+        bool valid = std::fabs(x.value) > tolerance.value && std::fabs(reciprocal) < std::numeric_limits<double>::infinity();
+        mask = valid ? 1u : 0u;
+        return ScalarLanes(valid ? reciprocal : 0.0);
+    }
+
+    double value;
+};
+
+ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return ScalarLanes(a.value + b.value); }
+ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return ScalarLanes(a.value - b.value); }
+ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return ScalarLanes(a.value * b.value); }
+ScalarLanes operator-(ScalarLanes a) { return ScalarLanes(-a.value); }
+
+#if P2_X86
+struct Avx2Lanes {
+    static constexpr int Width = 4;
+
+    Avx2Lanes() = default;
+    P2_TARGET_AVX2 explicit Avx2Lanes(__m256d value) : value(value) {}
+    P2_TARGET_AVX2 explicit Avx2Lanes(double value) : value(_mm256_set1_pd(value)) {}
+
+    P2_TARGET_AVX2 static Avx2Lanes load(const double* p) { return Avx2Lanes(_mm256_loadu_pd(p)); }
+    P2_TARGET_AVX2 void store(double* p) const { _mm256_storeu_pd(p, value); }
+
+    P2_TARGET_AVX2 static Avx2Lanes multiplyAdd(Avx2Lanes a, Avx2Lanes b, Avx2Lanes c) {
+        return Avx2Lanes(_mm256_fmadd_pd(a.value, b.value, c.value));
+    }
+    P2_TARGET_AVX2 static Avx2Lanes absolute(Avx2Lanes a) { return Avx2Lanes(_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.value)); }
+    P2_TARGET_AVX2 static Avx2Lanes maximum(Avx2Lanes a, Avx2Lanes b) { return Avx2Lanes(_mm256_max_pd(a.value, b.value)); }
+
+    P2_TARGET_AVX2 static Avx2Lanes reciprocalAbove(Avx2Lanes x, Avx2Lanes tolerance, unsigned& mask) {
+        __m256d reciprocal = _mm256_div_pd(_mm256_set1_pd(1.0), x.value);
+        __m256d valid = _mm256_and_pd(_mm256_cmp_pd(absolute(x).value, tolerance.value, _CMP_GT_OQ),
+            _mm256_cmp_pd(absolute(Avx2Lanes(reciprocal)).value, _mm256_set1_pd(std::numeric_limits<double>::infinity()), _CMP_LT_OQ));
+        mask = static_cast<unsigned>(_mm256_movemask_pd(valid));
+        return Avx2Lanes(_mm256_and_pd(reciprocal, valid));
+    }
+
+    __m256d value;
+};
+
+P2_TARGET_AVX2 Avx2Lanes operator+(Avx2Lanes a, Avx2Lanes b) { return Avx2Lanes(_mm256_add_pd(a.value, b.value)); }
+P2_TARGET_AVX2 Avx2Lanes operator-(Avx2Lanes a, Avx2Lanes b) { return Avx2Lanes(_mm256_sub_pd(a.value, b.value)); }
+P2_TARGET_AVX2 Avx2Lanes operator*(Avx2Lanes a, Avx2Lanes b) { return Avx2Lanes(_mm256_mul_pd(a.value, b.value)); }
+P2_TARGET_AVX2 Avx2Lanes operator-(Avx2Lanes a) { return Avx2Lanes(_mm256_xor_pd(_mm256_set1_pd(-0.0), a.value)); }
+
+struct Avx512Lanes {
+    static constexpr int Width = 8;
+
+    Avx512Lanes() = default;
+    P2_TARGET_AVX512 explicit Avx512Lanes(__m512d value) : value(value) {}
+    P2_TARGET_AVX512 explicit Avx512Lanes(double value) : value(_mm512_set1_pd(value)) {}
+
+    P2_TARGET_AVX512 static Avx512Lanes load(const double* p) { return Avx512Lanes(_mm512_loadu_pd(p)); }
+    P2_TARGET_AVX512 void store(double* p) const { _mm512_storeu_pd(p, value); }
+
+    P2_TARGET_AVX512 static Avx512Lanes multiplyAdd(Avx512Lanes a, Avx512Lanes b, Avx512Lanes c) {
+        return Avx512Lanes(_mm512_fmadd_pd(a.value, b.value, c.value));
+    }
+    P2_TARGET_AVX512 static Avx512Lanes absolute(Avx512Lanes a) { return Avx512Lanes(_mm512_abs_pd(a.value)); }
+    P2_TARGET_AVX512 static Avx512Lanes maximum(Avx512Lanes a, Avx512Lanes b) { return Avx512Lanes(_mm512_mask_max_pd(a.value, 0xFF, a.value, b.value)); }
+
+    P2_TARGET_AVX512 static Avx512Lanes reciprocalAbove(Avx512Lanes x, Avx512Lanes tolerance, unsigned& mask) {
+        __m512d reciprocal = _mm512_div_pd(_mm512_set1_pd(1.0), x.value);
+        __mmask8 valid = _mm512_cmp_pd_mask(_mm512_abs_pd(x.value), tolerance.value, _CMP_GT_OQ)
+            & _mm512_cmp_pd_mask(_mm512_abs_pd(reciprocal), _mm512_set1_pd(std::numeric_limits<double>::infinity()), _CMP_LT_OQ);
+        mask = valid;
+        return Avx512Lanes(_mm512_maskz_mov_pd(valid, reciprocal));
+    }
+
+    __m512d value;
+};
+
+P2_TARGET_AVX512 Avx512Lanes operator+(Avx512Lanes a, Avx512Lanes b) { return Avx512Lanes(_mm512_add_pd(a.value, b.value)); }
+P2_TARGET_AVX512 Avx512Lanes operator-(Avx512Lanes a, Avx512Lanes b) { return Avx512Lanes(_mm512_sub_pd(a.value, b.value)); }
+P2_TARGET_AVX512 Avx512Lanes operator*(Avx512Lanes a, Avx512Lanes b) { return Avx512Lanes(_mm512_mul_pd(a.value, b.value)); }
+P2_TARGET_AVX512 Avx512Lanes operator-(Avx512Lanes a) { return Avx512Lanes(_mm512_sub_pd(_mm512_setzero_pd(), a.value)); }
+#endif
+
+// Пакетные операции с SIMD-ядрами
+enum class BatchKernelOperation {
+    Determinant,
+    Inverse,
+    Trace,
+    Multiply
+};
+
+// Аргументы ядра пакетной операции. Ядро обрабатывает блоки по MatrixBatchLanes соседних матриц;
+// выходные массивы values и singular рассчитаны на stride() матриц пакета.
+struct BatchKernelTask {
+    BatchKernelOperation operation;
+    const MatrixBatch* a;
+    const MatrixBatch* b; // Второй множитель (Multiply)
+    MatrixBatch* result; // Обратные матрицы (Inverse) или произведения (Multiply)
+    double* values; // Определители (Determinant) или следы (Trace)
+    std::uint8_t* singular; // Признаки вырожденности (Inverse)
+};
+
+// Width соседних матриц пакета, начиная с матрицы offset, как одна матрица N x N из SIMD-значений
+template <typename Lanes, int N>
+struct BatchLanesView {
+    const double* data;
+    std::ptrdiff_t stride;
+
+    Lanes operator()(int i, int j) const { return Lanes::load(data + (i * N + j) * stride); }
+};
+
+template <typename Lanes, int N>
+void determinantLanes(const BatchKernelTask& task, int offset) {
+    BatchLanesView<Lanes, N> a{ task.a->data() + offset, task.a->stride() };
+    determinantFormula<N, Lanes>(a).store(task.values + offset);
+}
+
+template <typename Lanes, int N>
+void inverseLanes(const BatchKernelTask& task, int offset) {
+    std::ptrdiff_t stride = task.a->stride();
+    const double* source = task.a->data() + offset;
+    BatchLanesView<Lanes, N> a{ source, stride };
+    Lanes adjugate[N * N];
+    Lanes det = adjugateFormula<N>(a, adjugate);
+
+    // Порог вырожденности тот же, что у FixedMatrix::inverse: N * eps * max|a|^N
+    Lanes maxAbs(0.0);
+    for (int e = 0; e < N * N; e++) {
+        maxAbs = Lanes::maximum(maxAbs, Lanes::absolute(Lanes::load(source + e * stride)));
+    }
+    Lanes tolerance(N * std::numeric_limits<double>::epsilon());
+    for (int k = 0; k < N; k++) {
+        tolerance = tolerance * maxAbs;
+    }
+    unsigned mask = 0;
+    Lanes scale = Lanes::reciprocalAbove(det, tolerance, mask);
+
+    double* target = task.result->data() + offset;
+    for (int e = 0; e < N * N; e++) {
+        (adjugate[e] * scale).store(target + e * stride);
+    }
+    for (int lane = 0; lane < Lanes::Width; lane++) {
+        task.singular[offset + lane] = ((mask >> lane) & 1u) == 0 ? 1 : 0;
+    }
+}
+
+template <typename Lanes>
+void traceLanes(const BatchKernelTask& task, int offset) {
+    const MatrixBatch& a = *task.a;
+    Lanes sum(0.0);
+    for (int i = 0; i < a.rows(); i++) {
+        sum = sum + Lanes::load(a.element(i, i) + offset);
+    }
+    sum.store(task.values + offset);
+}
+
+template <typename Lanes>
+void multiplyLanes(const BatchKernelTask& task, int offset) {
+    const MatrixBatch& a = *task.a;
+    const MatrixBatch& b = *task.b;
+    MatrixBatch& c = *task.result;
+    for (int i = 0; i < a.rows(); i++) {
+        for (int j = 0; j < b.cols(); j++) {
+            Lanes sum(0.0);
+            for (int k = 0; k < a.cols(); k++) {
+                sum = Lanes::multiplyAdd(Lanes::load(a.element(i, k) + offset), Lanes::load(b.element(k, j) + offset), sum);
+            }
+            sum.store(c.element(i, j) + offset);
+        }
+    }
+}
+
+template <typename Lanes, int N>
+void squareLanes(const BatchKernelTask& task, int offset) {
+    if (task.operation == BatchKernelOperation::Determinant) {
+        determinantLanes<Lanes, N>(task, offset);
+    }
+    else {
+        inverseLanes<Lanes, N>(task, offset);
+    }
+}
+
+// Обработка блоков [firstBlock, lastBlock); определители и обратные матрицы - только для размеров 1 ... 4
+template <typename Lanes>
+void runBatchBlocks(const BatchKernelTask& task, int firstBlock, int lastBlock) {
+    int n = task.a->rows();
+    for (int offset = firstBlock * MatrixBatchLanes; offset < lastBlock * MatrixBatchLanes; offset += Lanes::Width) {
+        switch (task.operation) {
+        case BatchKernelOperation::Trace:
+            traceLanes<Lanes>(task, offset);
+            break;
+        case BatchKernelOperation::Multiply:
+            multiplyLanes<Lanes>(task, offset);
+            break;
+        default:
+            switch (n) {
+            case 1: squareLanes<Lanes, 1>(task, offset); break;
+            case 2: squareLanes<Lanes, 2>(task, offset); break;
+            case 3: squareLanes<Lanes, 3>(task, offset); break;
+            case 4: squareLanes<Lanes, 4>(task, offset); break;
+            default: break;
+            }
+            break;
+        }
+    }
+}
+
+P2_FLATTEN
+void runBatchBlocksScalar(const BatchKernelTask& task, int firstBlock, int lastBlock) {
+    runBatchBlocks<ScalarLanes>(task, firstBlock, lastBlock);
+}
+
+#if P2_X86
+P2_TARGET_AVX2 P2_FLATTEN
+void runBatchBlocksAvx2(const BatchKernelTask& task, int firstBlock, int lastBlock) {
+    runBatchBlocks<Avx2Lanes>(task, firstBlock, lastBlock);
+}
+
+P2_TARGET_AVX512 P2_FLATTEN
+void runBatchBlocksAvx512(const BatchKernelTask& task, int firstBlock, int lastBlock) {
+    runBatchBlocks<Avx512Lanes>(task, firstBlock, lastBlock);
+}
+#endif
+
+using BatchKernel = void (*)(const BatchKernelTask&, int, int);
+
+// Функция выбора ядра пакетных операций по возможностям процессора
+BatchKernel batchKernel() {
+    static const BatchKernel kernel = [] {
+#if P2_X86
+        const CpuFeatures& features = cpuFeatures();
+        if (features.avx512f) {
+            return runBatchBlocksAvx512;
+        }
+        if (features.avx2 && features.fma) {
+            return runBatchBlocksAvx2;
+        }
+#endif
+        return runBatchBlocksScalar;
+    }();
+    return kernel;
+}
+
+// Функция выполнения пакетной операции: блоки матриц делятся между потоками пула,
+// если суммарный объём работы достаточно велик
+void runBatchKernel(const BatchKernelTask& task, std::size_t workPerMatrix) {
+    BatchKernel kernel = batchKernel();
+    int blocks = task.a->blocks();
+    std::size_t blockWork = (std::max)(std::size_t(1), workPerMatrix) * MatrixBatchLanes;
+    if (blocks > 1 && blockWork * blocks >= ParallelMinElements) {
+        int grain = (std::max)(1, static_cast<int>(ParallelMinElements / 4 / blockWork));
+        threadPool().parallelFor(0, blocks, grain, [&](int first, int last) { kernel(task, first, last); });
+    }
+    else {
+        kernel(task, 0, blocks);
+    }
+}
+
+// Определители или обратные матрицы размеров больше 4 - по одной матрице: ядрами фиксированного
+// размера для 5x5 ... 8x8 и через LU-разложение для больших
+void runLargeSquareBatch(const BatchKernelTask& task) {
+    const MatrixBatch& batch = *task.a;
+    int n = batch.rows();
+    auto processMatrices = [&](int first, int last) {
+        FixedMatrix<FixedMaxSize, FixedMaxSize> source;
+        FixedMatrix<FixedMaxSize, FixedMaxSize> inverse;
+        for (int m = first; m < last; m++) {
+            if (n <= FixedMaxSize) {
+                MatrixView matrix = source.view().submatrix(0, 0, n, n);
+                batch.get(m, matrix);
+                if (task.operation == BatchKernelOperation::Determinant) {
+                    task.values[m] = fixedDeterminant(matrix);
+                    continue;
+                }
+                MatrixView result = inverse.view().submatrix(0, 0, n, n);
+                task.singular[m] = fixedInverse(matrix, result) ? 0 : 1;
+                if (!task.singular[m]) {
+                    task.result->set(m, result);
+                }
+                continue;
+            }
+            LUDecomposition lu = decomposeLU(batch.get(m));
+            if (task.operation == BatchKernelOperation::Determinant) {
+                task.values[m] = lu.determinant();
+                continue;
+            }
+            task.singular[m] = lu.isSingular() ? 1 : 0;
+            if (!lu.isSingular()) {
+                task.result->set(m, lu.inverse());
+            }
+        }
+    };
+
+    std::size_t work = static_cast<std::size_t>(n) * n * n;
+    if (work * batch.count() >= ParallelMinElements) {
+        int grain = (std::max)(1, static_cast<int>(ParallelMinElements / 4 / work));
+        threadPool().parallelFor(0, batch.count(), grain, processMatrices);
+    }
+    else {
+        processMatrices(0, batch.count());
+    }
+}
+
+// Функция проверки, что матрицы пакета квадратные
+void checkSquareBatch(const MatrixBatch& batch) {
+    if (batch.rows() != batch.cols()) {
+        throw std::invalid_argument("Матрицы пакета должны быть квадратными");
+    }
+}
+
+// Функция нахождения определителей всех матриц пакета
+std::vector<double> batchDeterminant(const MatrixBatch& batch) {
+    checkSquareBatch(batch);
+    int n = batch.rows();
+    ProfileScope profile("batch determinant");
+    profile.addFlops(2.0 / 3.0 * n * n * n * batch.count());
+
+    std::vector<double> values(batch.stride());
+    BatchKernelTask task = { BatchKernelOperation::Determinant, &batch, nullptr, nullptr, values.data(), nullptr };
+    if (n <= 4) {
+        runBatchKernel(task, static_cast<std::size_t>(n) * n * n);
+    }
+    else {
+        runLargeSquareBatch(task);
+    }
+    values.resize(batch.count());
+    return values;
+}
+
+// Функция вычисления обратных матриц пакета. singular[m] = 1, если матрица m вырожденная
+// (её обратная в результате остаётся нулевой), иначе 0
+MatrixBatch batchInverse(const MatrixBatch& batch, std::vector<std::uint8_t>& singular) {
+    checkSquareBatch(batch);
+    int n = batch.rows();
+    ProfileScope profile("batch inverse");
+    profile.addFlops(2.0 * n * n * n * batch.count());
+
+    MatrixBatch result(batch.count(), n, n);
+    singular.assign(batch.stride(), 0);
+    BatchKernelTask task = { BatchKernelOperation::Inverse, &batch, nullptr, &result, nullptr, singular.data() };
+    if (n <= 4) {
+        runBatchKernel(task, static_cast<std::size_t>(n) * n * n);
+    }
+    else {
+        runLargeSquareBatch(task);
+    }
+    singular.resize(batch.count());
+    return result;
+}
+
+// Функция вычисления следов всех матриц пакета
+std::vector<double> batchTrace(const MatrixBatch& batch) {
+    if (batch.rows() > batch.cols()) {
+        throw std::out_of_range("Индекс главной диагонали превышает размер матрицы");
+    }
+    ProfileScope profile("batch trace");
+    profile.addFlops(static_cast<double>(batch.rows()) * batch.count());
+
+    std::vector<double> values(batch.stride());
+    BatchKernelTask task = { BatchKernelOperation::Trace, &batch, nullptr, nullptr, values.data(), nullptr };
+    runBatchKernel(task, batch.rows());
+    values.resize(batch.count());
+    return values;
+}
+
+// Функция попарного умножения матриц двух пакетов: результат m - произведение a[m] * b[m]
+MatrixBatch batchMultiply(const MatrixBatch& a, const MatrixBatch& b) {
+    if (a.count() != b.count()) {
+        throw std::invalid_argument("Пакеты должны содержать одинаковое число матриц");
+    }
+    if (a.cols() != b.rows()) {
+        throw std::invalid_argument("Количество столбцов в первой матрице должно быть равно количеству строк во второй матрице");
+    }
+    ProfileScope profile("batch multiply");
+    profile.addFlops(2.0 * a.rows() * a.cols() * b.cols() * a.count());
+
+    MatrixBatch result(a.count(), a.rows(), b.cols());
+    BatchKernelTask task = { BatchKernelOperation::Multiply, &a, &b, &result, nullptr, nullptr };
+    runBatchKernel(task, static_cast<std::size_t>(a.rows()) * a.cols() * b.cols());
+    return result;
+}
+
+// Ленивые матричные выражения: A + B, A - B, s * A, A * B и их сочетания вычисляются только при
+// вызове evaluate. Поэлементная часть выражения считается за один проход по результату, произведения
+// накапливаются прямо в результат через gemmAccumulate с множителем, а операнды произведений,
+// сами являющиеся выражениями, вычисляются во временные буферы рабочей области.
+// Поэтому вычисление в уже выделенный буфер не обращается к куче.
+// Выражение хранит представления операндов: матрицы должны жить до вычисления выражения.
+
+// Функция проверки пересечения памяти представления с диапазоном [begin, end)
+bool viewOverlaps(ConstMatrixView view, const double* begin, const double* end) {
+    if (view.empty()) {
+        return false;
+    }
+    const double* first = view.data();
+    const double* last = view.data() + (view.rows() - 1) * view.rowStride() + (view.cols() - 1) * view.colStride() + 1;
+    return first < end && begin < last;
+}
+
+// Лист выражения: представление матрицы
+class MatrixOperand {
+public:
+    static constexpr bool IsLeaf = true;
+    static constexpr bool HasElementwise = true;
+
+    explicit MatrixOperand(ConstMatrixView view) : view_(view) {}
+
+    int rows() const { return view_.rows(); }
+    int cols() const { return view_.cols(); }
+    ConstMatrixView view() const { return view_; }
+    bool unitStride() const { return view_.hasContiguousRows(); }
+
+    // Элемент (i, j); при UnitStride все листья выражения хранят строки подряд
+    template <bool UnitStride>
+    double element(int i, int j) const { return UnitStride ? view_.rowData(i)[j] : view_(i, j); }
+
+    void accumulateProducts(MatrixView, double, Workspace&) const {}
+    bool productOverlaps(const double*, const double*) const { return false; }
+    bool overlaps(const double* begin, const double* end) const { return viewOverlaps(view_, begin, end); }
+
+private:
+    ConstMatrixView view_;
+};
+
+// Выражение, умноженное на число
+template <typename E>
+class ScaledExpression {
+public:
+    static constexpr bool IsLeaf = false;
+    static constexpr bool HasElementwise = E::HasElementwise;
+
+    ScaledExpression(double scale, const E& expression) : scale_(scale), expression_(expression) {}
+
+    int rows() const { return expression_.rows(); }
+    int cols() const { return expression_.cols(); }
+    bool unitStride() const { return expression_.unitStride(); }
+
+    template <bool UnitStride>
+    double element(int i, int j) const { return scale_ * expression_.template element<UnitStride>(i, j); }
+
+    void accumulateProducts(MatrixView destination, double alpha, Workspace& workspace) const {
+        expression_.accumulateProducts(destination, alpha * scale_, workspace);
+    }
+    bool productOverlaps(const double* begin, const double* end) const { return expression_.productOverlaps(begin, end); }
+    bool overlaps(const double* begin, const double* end) const { return expression_.overlaps(begin, end); }
+
+private:
+    double scale_;
+    E expression_;
+};
+
+// Сумма (sign = 1) или разность (sign = -1) двух выражений одного размера
+template <typename L, typename R>
+class SumExpression {
+public:
+    static constexpr bool IsLeaf = false;
+    static constexpr bool HasElementwise = L::HasElementwise || R::HasElementwise;
+
+    SumExpression(const L& left, const R& right, double sign) : left_(left), right_(right), sign_(sign) {
+        if (left.rows() != right.rows() || left.cols() != right.cols()) {
+            throw std::invalid_argument("Размеры слагаемых матричного выражения не совпадают");
+        }
+    }
+
+    int rows() const { return left_.rows(); }
+    int cols() const { return left_.cols(); }
+    bool unitStride() const { return left_.unitStride() && right_.unitStride(); }
+
+    template <bool UnitStride>
+    double element(int i, int j) const {
+        if constexpr (L::HasElementwise && R::HasElementwise) {
+            return left_.template element<UnitStride>(i, j) + sign_ * right_.template element<UnitStride>(i, j);
+        }
+        else if constexpr (L::HasElementwise) {
+            return left_.template element<UnitStride>(i, j);
+        }
+        else if constexpr (R::HasElementwise) {
+            return sign_ * right_.template element<UnitStride>(i, j);
+        }
+        else {
+            return 0.0;
+        }
+    }
+
+    void accumulateProducts(MatrixView destination, double alpha, Workspace& workspace) const {
+        left_.accumulateProducts(destination, alpha, workspace);
+        right_.accumulateProducts(destination, alpha * sign_, workspace);
+    }
+    bool productOverlaps(const double* begin, const double* end) const {
+        return left_.productOverlaps(begin, end) || right_.productOverlaps(begin, end);
+    }
+    bool overlaps(const double* begin, const double* end) const { return left_.overlaps(begin, end) || right_.overlaps(begin, end); }
+
+private:
+    L left_;
+    R right_;
+    double sign_;
+};
+
+template <typename E>
+void evaluateExpression(MatrixView destination, const E& expression, Workspace& workspace);
+
+// Операнд произведения как представление: лист берётся как есть, выражение вычисляется в рабочую область
+template <typename E>
+ConstMatrixView materializeOperand(const E& expression, Workspace& workspace) {
+    if constexpr (E::IsLeaf) {
+        return expression.view();
+    }
+    else {
+        MatrixView result = workspace.allocateMatrix(expression.rows(), expression.cols());
+        evaluateExpression(result, expression, workspace);
+        return result;
+    }
+}
+
+// Матричное произведение двух выражений; в поэлементном проходе не участвует
+template <typename L, typename R>
+class ProductExpression {
+public:
+    static constexpr bool IsLeaf = false;
+    static constexpr bool HasElementwise = false;
+
+    ProductExpression(const L& left, const R& right) : left_(left), right_(right) {
+        if (left.cols() != right.rows()) {
+            throw std::invalid_argument("Число столбцов левого множителя не равно числу строк правого");
+        }
+    }
+
+    int rows() const { return left_.rows(); }
+    int cols() const { return right_.cols(); }
+    bool unitStride() const { return true; }
+
+    template <bool UnitStride>
+    double element(int, int) const { return 0.0; }
+
+    // destination += alpha * left * right
+    void accumulateProducts(MatrixView destination, double alpha, Workspace& workspace) const {
+        WorkspaceScope scope(workspace);
+        ConstMatrixView a = materializeOperand(left_, workspace);
+        ConstMatrixView b = materializeOperand(right_, workspace);
+        gemmAccumulate(a, b, destination, alpha);
+    }
+    bool productOverlaps(const double* begin, const double* end) const { return overlaps(begin, end); }
+    bool overlaps(const double* begin, const double* end) const { return left_.overlaps(begin, end) || right_.overlaps(begin, end); }
+
+private:
+    L left_;
+    R right_;
+};
+
+template <typename T>
+struct IsMatrixExpression : std::false_type {};
+template <>
+struct IsMatrixExpression<MatrixOperand> : std::true_type {};
+template <typename E>
+struct IsMatrixExpression<ScaledExpression<E>> : std::true_type {};
+template <typename L, typename R>
+struct IsMatrixExpression<SumExpression<L, R>> : std::true_type {};
+template <typename L, typename R>
+struct IsMatrixExpression<ProductExpression<L, R>> : std::true_type {};
+
+// Операнд ленивого выражения: узел выражения, матрица или её представление
+template <typename T>
+struct IsExpressionOperand : std::integral_constant<bool, IsMatrixExpression<T>::value || std::is_same<T, Matrix>::value
+    || std::is_same<T, MatrixView>::value || std::is_same<T, ConstMatrixView>::value> {};
+
+template <typename E, typename = typename std::enable_if<IsMatrixExpression<E>::value>::type>
+const E& toExpression(const E& expression) {
+    return expression;
+}
+
+inline MatrixOperand toExpression(ConstMatrixView view) {
+    return MatrixOperand(view);
+}
+
+inline MatrixOperand toExpression(const Matrix& matrix) {
+    return MatrixOperand(matrix.view());
+}
+
+template <typename T>
+using ExpressionOf = typename std::decay<decltype(toExpression(std::declval<const T&>()))>::type;
+
+// Временная матрица умерла бы раньше выражения, которое хранит лишь её представление
+template <typename T>
+constexpr bool isTemporaryMatrix() {
+    return std::is_same<T, Matrix>::value;
+}
+
+template <typename L, typename R, typename = typename std::enable_if<IsExpressionOperand<typename std::decay<L>::type>::value && IsExpressionOperand<typename std::decay<R>::type>::value>::type>
+SumExpression<ExpressionOf<typename std::decay<L>::type>, ExpressionOf<typename std::decay<R>::type>> operator+(L&& left, R&& right) {
+    static_assert(!isTemporaryMatrix<L>() && !isTemporaryMatrix<R>(), "Временная матрица не может быть операндом ленивого выражения");
+    return { toExpression(left), toExpression(right), 1.0 };
+}
+
+template <typename L, typename R, typename = typename std::enable_if<IsExpressionOperand<typename std::decay<L>::type>::value && IsExpressionOperand<typename std::decay<R>::type>::value>::type>
+SumExpression<ExpressionOf<typename std::decay<L>::type>, ExpressionOf<typename std::decay<R>::type>> operator-(L&& left, R&& right) {
+    static_assert(!isTemporaryMatrix<L>() && !isTemporaryMatrix<R>(), "Временная матрица не может быть операндом ленивого выражения");
+    return { toExpression(left), toExpression(right), -1.0 };
+}
+
+template <typename L, typename R, typename = typename std::enable_if<IsExpressionOperand<typename std::decay<L>::type>::value && IsExpressionOperand<typename std::decay<R>::type>::value>::type>
+ProductExpression<ExpressionOf<typename std::decay<L>::type>, ExpressionOf<typename std::decay<R>::type>> operator*(L&& left, R&& right) {
+    static_assert(!isTemporaryMatrix<L>() && !isTemporaryMatrix<R>(), "Временная матрица не может быть операндом ленивого выражения");
+    return { toExpression(left), toExpression(right) };
+}
+
+template <typename E, typename = typename std::enable_if<IsExpressionOperand<typename std::decay<E>::type>::value>::type>
+ScaledExpression<ExpressionOf<typename std::decay<E>::type>> operator*(double scale, E&& expression) {
+    static_assert(!isTemporaryMatrix<E>(), "Временная матрица не может быть операндом ленивого выражения");
+    return { scale, toExpression(expression) };
+}
+
+template <typename E, typename = typename std::enable_if<IsExpressionOperand<typename std::decay<E>::type>::value>::type>
+ScaledExpression<ExpressionOf<typename std::decay<E>::type>> operator*(E&& expression, double scale) {
+    static_assert(!isTemporaryMatrix<E>(), "Временная матрица не может быть операндом ленивого выражения");
+    return { scale, toExpression(expression) };
+}
+
+template <typename E, typename = typename std::enable_if<IsExpressionOperand<typename std::decay<E>::type>::value>::type>
+ScaledExpression<ExpressionOf<typename std::decay<E>::type>> operator-(E&& expression) {
+    static_assert(!isTemporaryMatrix<E>(), "Временная матрица не может быть операндом ленивого выражения");
+    return { -1.0, toExpression(expression) };
+}
+
+// Поэлементный проход: destination = поэлементная часть выражения (строки параллельно для больших матриц)
+template <typename E>
+void evaluateElementwise(MatrixView destination, const E& expression) {
+    int cols = destination.cols();
+    bool unitStride = expression.unitStride();
+    auto evaluateRows = [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            double* row = destination.rowData(i);
+            if (unitStride) {
+                for (int j = 0; j < cols; j++) {
+                    row[j] = expression.template element<true>(i, j);
+                }
+            }
+            else {
+                for (int j = 0; j < cols; j++) {
+                    row[j] = expression.template element<false>(i, j);
+                }
+            }
+        }
+    };
+
+    if (static_cast<std::size_t>(destination.rows()) * cols >= ParallelMinElements) {
+        int grain = (std::max)(1, static_cast<int>(ParallelMinElements / 4 / (std::max)(1, cols)));
+        threadPool().parallelFor(0, destination.rows(), grain, evaluateRows);
+    }
+    else {
+        evaluateRows(0, destination.rows());
+    }
+}
+
+// Функция вычисления выражения в destination. Если произведение читает память результата
+// (например, C = A * C) или строки результата не лежат подряд, выражение считается во временный буфер.
+template <typename E>
+void evaluateExpression(MatrixView destination, const E& expression, Workspace& workspace) {
+    if (destination.rows() != expression.rows() || destination.cols() != expression.cols()) {
+        throw std::invalid_argument("Размер результата не совпадает с размером матричного выражения");
+    }
+    if (destination.empty()) {
+        return;
+    }
+
+    const double* begin = destination.data();
+    const double* end = destination.data() + (destination.rows() - 1) * destination.rowStride() + (destination.cols() - 1) * destination.colStride() + 1;
+    if (!destination.hasContiguousRows() || expression.productOverlaps(begin, end)) {
+        WorkspaceScope scope(workspace);
+        MatrixView temporary = workspace.allocateMatrix(destination.rows(), destination.cols());
+        evaluateExpression(temporary, expression, workspace);
+        for (int i = 0; i < destination.rows(); i++) {
+            for (int j = 0; j < destination.cols(); j++) {
+                destination(i, j) = temporary(i, j);
+            }
+        }
+        return;
+    }
+
+    if constexpr (E::HasElementwise) {
+        evaluateElementwise(destination, expression);
+    }
+    else {
+        for (int i = 0; i < destination.rows(); i++) {
+            std::fill(destination.rowData(i), destination.rowData(i) + destination.cols(), 0.0);
+        }
+    }
+    expression.accumulateProducts(destination, 1.0, workspace);
+}
+
+// Вычисление выражения в существующий буфер (без выделения памяти после прогрева рабочей области)
+template <typename E, typename = typename std::enable_if<IsMatrixExpression<E>::value>::type>
+void evaluate(MatrixView destination, const E& expression) {
+    evaluateExpression(destination, expression, threadWorkspace());
+}
+
+// Вычисление выражения в матрицу; буфер матрицы переиспользуется, если её размер совпадает
+template <typename E, typename = typename std::enable_if<IsMatrixExpression<E>::value>::type>
+void evaluate(Matrix& destination, const E& expression) {
+    if (destination.rows() != expression.rows() || destination.cols() != expression.cols()) {
+        destination = Matrix(expression.rows(), expression.cols());
+    }
+    evaluateExpression(destination.view(), expression, threadWorkspace());
+}
+
+// Вычисление выражения в новую матрицу
+template <typename E, typename = typename std::enable_if<IsMatrixExpression<E>::value>::type>
+Matrix evaluate(const E& expression) {
+    Matrix result(expression.rows(), expression.cols());
+    evaluateExpression(result.view(), expression, threadWorkspace());
+    return result;
+}
+
+// Адаптеры для матриц во вложенных векторах: сохраняют прежние сигнатуры функций
+
+int findRank(const std::vector<std::vector<double>>& matrix) {
+    return findRank(toMatrix(matrix));
+}
+
+std::vector<std::vector<double>> transposeMatrix(const std::vector<std::vector<double>>& matrix) {
+    return toNestedVector(transposeMatrix(toMatrix(matrix)));
+}
+
+bool isSquareMatrix(const std::vector<std::vector<double>>& matrix) {
+    return matrix.size() == 0 ? false : matrix.size() == matrix[0].size();
+}
+
+double trace(const std::vector<std::vector<double>>& matrix) {
+    return trace(toMatrix(matrix));
+}
+
+LUDecomposition decomposeLU(const std::vector<std::vector<double>>& matrix) {
+    return decomposeLU(toMatrix(matrix));
+}
+
+double determinant(const std::vector<std::vector<double>>& matrix) {
+    return determinant(toMatrix(matrix));
+}
+
+std::vector<std::vector<double>> inverseMatrix(const std::vector<std::vector<double>>& matrix) {
+    return toNestedVector(inverseMatrix(toMatrix(matrix)));
+}
+
+bool areMatricesEqual(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
+    if (matrix1.size() != matrix2.size() || (!matrix1.empty() && matrix1[0].size() != matrix2[0].size())) {
+        return false; // Матрицы разных размеров
+    }
+    return areMatricesEqual(toMatrix(matrix1), toMatrix(matrix2));
+}
+
+std::vector<std::vector<double>> addMatrices(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
+    return toNestedVector(addMatrices(toMatrix(matrix1), toMatrix(matrix2)));
+}
+
+std::vector<std::vector<double>> multiplyMatrices(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
+    // Проверка, что количество элементов в каждой строке матрицы одинаковое
+    for (const auto& row : matrix1) {
+        if (row.size() != matrix1[0].size()) {
+            std::cerr << "Неравное количество элементов в строках первой матрицы." << std::endl;
+            return std::vector<std::vector<double>>();
+        }
+    }
+
+    for (const auto& row : matrix2) {
+        if (row.size() != matrix2[0].size()) {
+            std::cerr << "Неравное количество элементов в строках второй матрицы." << std::endl;
+            return std::vector<std::vector<double>>();
+        }
+    }
+
+    return toNestedVector(multiplyMatrices(toMatrix(matrix1), toMatrix(matrix2)));
+}
+
+// Размер буферов текстового ввода-вывода (в байтах)
+constexpr std::size_t TextBufferSize = 1 << 20;
+
+// Текстовые форматы матриц
+enum class MatrixTextFormat {
+    Whitespace, // "строки столбцы", затем элементы по строкам через пробельные символы
+    Csv // Строка текста - строка матрицы, элементы через запятую; матрицы разделяются пустой строкой
+};
+
+// Функция дописывания числа в кратчайшей записи, которая читается обратно в то же самое значение
+void appendNumber(std::string& text, double value) {
+    char buffer[32];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    text.append(buffer, result.ptr);
+}
+
+template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+void appendNumber(std::string& text, T value) {
+    char buffer[24];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    text.append(buffer, result.ptr);
+}
+
+// Буферизованный текстовый вывод. Числа форматируются через std::to_chars; текст либо дописывается
+// в строку, либо уходит в поток крупными порциями - без сброса потока после каждой строки.
+class TextOutput {
+public:
+    // Дописывание текста в конец target
+    explicit TextOutput(std::string& target) : text_(&target) {}
+
+    // Вывод в поток sink порциями примерно по capacity байт
+    explicit TextOutput(std::ostream& sink, std::size_t capacity = TextBufferSize)
+        : text_(&buffer_), sink_(&sink), capacity_(capacity) {
+        buffer_.reserve(capacity + 64);
+    }
+
+    TextOutput(const TextOutput&) = delete;
+    TextOutput& operator=(const TextOutput&) = delete;
+    ~TextOutput() { flush(); }
+
+    TextOutput& operator<<(char c) {
+        text_->push_back(c);
+        return spill();
+    }
+
+    TextOutput& operator<<(const char* text) {
+        text_->append(text);
+        return spill();
+    }
+
+    TextOutput& operator<<(const std::string& text) {
+        text_->append(text);
+        return spill();
+    }
+
+    TextOutput& operator<<(double value) {
+        appendNumber(*text_, value);
+        return spill();
+    }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    TextOutput& operator<<(T value) {
+        appendNumber(*text_, value);
+        return spill();
+    }
+
+    // Передача накопленного текста в поток (в режиме дописывания в строку ничего не делает)
+    void flush() {
+        if (sink_ != nullptr && !text_->empty()) {
+            sink_->write(text_->data(), static_cast<std::streamsize>(text_->size()));
+            text_->clear();
+        }
+    }
+
+    // Размер накопленного текста и откат к ранее запомненному размеру (только при дописывании в строку)
+    std::size_t size() const { return text_->size(); }
+    void truncate(std::size_t size) { text_->resize(size); }
+
+private:
+    TextOutput& spill() {
+        if (sink_ != nullptr && text_->size() >= capacity_) {
+            flush();
+        }
+        return *this;
+    }
+
+    std::string buffer_;
+    std::string* text_;
+    std::ostream* sink_ = nullptr;
+    std::size_t capacity_ = 0;
+};
+
+// Буферизованное чтение чисел из текстового потока через std::from_chars.
+// Разделители - пробельные символы, ',' и ';'; '#' начинает комментарий до конца строки.
+class TextNumberReader {
+public:
+    explicit TextNumberReader(std::istream& in, std::size_t capacity = TextBufferSize) : in_(in), buffer_(capacity) {}
+
+    // Переход к началу следующего числа; false при конце потока.
+    // При withinLine поиск не выходит за конец текущей строки: тогда перевод строки потребляется и возвращается false.
+    bool next(bool withinLine = false) {
+        while (true) {
+            if (pos_ == end_ && !fill()) {
+                return false;
+            }
+            char c = buffer_[pos_];
+            if (c == '\n' || c == '#') {
+                skipLine();
+                if (withinLine) {
+                    return false;
+                }
+            }
+            else if (isSeparator(c)) {
+                pos_++;
+            }
+            else {
+                return true;
+            }
+        }
+    }
+
+    // Проверка, что впереди пустая строка или конец потока (строки из одного комментария пропускаются).
+    // Пустая строка потребляется; если впереди данные, позиция остаётся в пределах текущей строки.
+    bool blankLineAhead() {
+        while (true) {
+            if (pos_ == end_ && !fill()) {
+                return true;
+            }
+            char c = buffer_[pos_];
+            if (c == '\n') {
+                pos_++;
+                return true;
+            }
+            if (c == '#') {
+                skipLine();
+            }
+            else if (isSeparator(c)) {
+                pos_++;
+            }
+            else {
+                return false;
+            }
+        }
+    }
+
+    // Разбор числа, на начале которого стоит позиция (после next()); false, если запись неверна
+    template <typename T>
+    bool parse(T& value) {
+        std::size_t last = tokenEnd();
+        const char* begin = buffer_.data() + pos_;
+        const char* end = buffer_.data() + last;
+        if (begin != end && *begin == '+') {
+            begin++; // from_chars не принимает '+', но знак после него разобрал бы как свой
+            if (begin != end && *begin == '-') {
+                pos_ = last;
+                return false;
+            }
+        }
+        std::from_chars_result result = std::from_chars(begin, end, value);
+        pos_ = last;
+        return result.ec == std::errc() && result.ptr == end && begin != end;
+    }
+
+private:
+    static bool isSeparator(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' || c == ',' || c == ';';
+    }
+
+    // Конец текущего числа; при необходимости число целиком дочитывается в буфер
+    std::size_t tokenEnd() {
+        std::size_t i = pos_;
+        while (true) {
+            while (i < end_ && !isSeparator(buffer_[i]) && buffer_[i] != '\n' && buffer_[i] != '#') {
+                i++;
+            }
+            if (i < end_) {
+                return i;
+            }
+            std::size_t offset = i - pos_;
+            if (!fill()) {
+                return end_;
+            }
+            i = pos_ + offset;
+        }
+    }
+
+    void skipLine() {
+        while (true) {
+            const char* begin = buffer_.data() + pos_;
+            const void* newline = std::memchr(begin, '\n', end_ - pos_);
+            if (newline != nullptr) {
+                pos_ += static_cast<const char*>(newline) - begin + 1;
+                return;
+            }
+            pos_ = end_;
+            if (!fill()) {
+                return;
+            }
+        }
+    }
+
+    // Дочитывание потока в буфер; непрочитанный остаток переносится в начало буфера
+    bool fill() {
+        if (eof_) {
+            return false;
+        }
+        if (pos_ > 0) {
+            std::copy(buffer_.begin() + pos_, buffer_.begin() + end_, buffer_.begin());
+            end_ -= pos_;
+            pos_ = 0;
+        }
+        if (end_ == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        in_.read(buffer_.data() + end_, static_cast<std::streamsize>(buffer_.size() - end_));
+        std::size_t count = static_cast<std::size_t>(in_.gcount());
+        end_ += count;
+        if (count == 0) {
+            eof_ = true;
+        }
+        return count > 0;
+    }
+
+    std::istream& in_;
+    std::vector<char> buffer_;
+    std::size_t pos_ = 0;
+    std::size_t end_ = 0;
+    bool eof_ = false;
+};
+
+// Подготовка матрицы rows x cols с переиспользованием уже выделенного буфера
+void resizeMatrix(Matrix& matrix, int rows, int cols) {
+    if (matrix.size() == static_cast<std::size_t>(rows) * static_cast<std::size_t>(cols)) {
+        matrix.reshape(rows, cols);
+    }
+    else {
+        matrix = Matrix(rows, cols);
+    }
+}
+
+// Функция чтения матрицы формата "строки столбцы элементы..."; false, если данные закончились
+bool readMatrixText(TextNumberReader& reader, Matrix& matrix) {
+    ProfileScope profile("parse text");
+    if (!reader.next()) {
+        return false;
+    }
+    long long rows = 0;
+    long long cols = 0;
+    if (!reader.parse(rows) || !reader.next() || !reader.parse(cols) || rows < 0 || cols < 0
+        || rows > (std::numeric_limits<int>::max)() || cols > (std::numeric_limits<int>::max)()) {
+        throw std::invalid_argument("Неверные размеры матрицы");
+    }
+
+    resizeMatrix(matrix, static_cast<int>(rows), static_cast<int>(cols));
+    double* data = matrix.data();
+    for (std::size_t i = 0; i < matrix.size(); i++) {
+        if (!reader.next()) {
+            throw std::invalid_argument("Недостаточно элементов матрицы");
+        }
+        if (!reader.parse(data[i])) {
+            throw std::invalid_argument("Неверное значение элемента матрицы");
+        }
+    }
+    return true;
+}
+
+// Функция чтения матрицы формата CSV (до пустой строки или конца потока); false, если данные закончились.
+// values - буфер для элементов, переиспользуемый между вызовами
+bool readMatrixCsv(TextNumberReader& reader, Matrix& matrix, std::vector<double>& values) {
+    ProfileScope profile("parse text");
+    if (!reader.next()) {
+        return false;
+    }
+    values.clear();
+    int rows = 0;
+    std::size_t cols = 0;
+    while (true) {
+        std::size_t rowStart = values.size();
+        do {
+            double value = 0.0;
+            if (!reader.parse(value)) {
+                throw std::invalid_argument("Неверное значение элемента матрицы");
+            }
+            values.push_back(value);
+        } while (reader.next(true));
+
+        std::size_t count = values.size() - rowStart;
+        if (rows > 0 && count != cols) {
+            throw std::invalid_argument("Строки матрицы содержат разное количество элементов");
+        }
+        cols = count;
+        rows++;
+        if (reader.blankLineAhead() || !reader.next()) {
+            break;
+        }
+    }
+
+    resizeMatrix(matrix, rows, static_cast<int>(cols));
+    std::copy(values.begin(), values.end(), matrix.data());
+    return true;
+}
+
+// Запись матрицы в текстовом формате: для Whitespace - "rows cols", затем строки матрицы;
+// для Csv - строки через запятую и пустая строка после матрицы
+void writeMatrixText(TextOutput& out, ConstMatrixView matrix, MatrixTextFormat format = MatrixTextFormat::Whitespace) {
+    ProfileScope profile("format text");
+    char separator = format == MatrixTextFormat::Csv ? ',' : ' ';
+    if (format == MatrixTextFormat::Whitespace) {
+        out << matrix.rows() << ' ' << matrix.cols() << '\n';
+    }
+    for (int i = 0; i < matrix.rows(); i++) {
+        for (int j = 0; j < matrix.cols(); j++) {
+            if (j > 0) {
+                out << separator;
+            }
+            out << matrix(i, j);
+        }
+        out << '\n';
+    }
+    if (format == MatrixTextFormat::Csv) {
+        out << '\n';
+    }
+}
+
+// Вывод матрицы из вложенных векторов построчно ("элемент элемент ... \n") одним буферизованным блоком
+void printMatrix(std::ostream& stream, const std::vector<std::vector<double>>& matrix) {
+    ProfileScope profile("print");
+    TextOutput out(stream);
+    for (const auto& row : matrix) {
+        for (double elem : row) {
+            out << elem << ' ';
+        }
+        out << '\n';
+    }
+}
+
+// Вывод матрицы (или её представления) в том же формате
+void printMatrix(std::ostream& stream, ConstMatrixView matrix) {
+    ProfileScope profile("print");
+    TextOutput out(stream);
+    for (int i = 0; i < matrix.rows(); i++) {
+        for (int j = 0; j < matrix.cols(); j++) {
+            out << matrix(i, j) << ' ';
+        }
+        out << '\n';
+    }
+}
+
+// Тип элементов в двоичном файле матрицы
+enum class MatrixDataType : std::uint32_t {
+    Float64 = 1
+};
+
+// Порядок хранения элементов в двоичном файле матрицы
+enum class MatrixLayout : std::uint32_t {
+    RowMajor = 0,
+    ColumnMajor = 1
+};
+
+constexpr char MatrixFileMagic[8] = { 'P', '2', 'V', 'M', 'A', 'T', 'R', 'X' };
+constexpr std::uint32_t MatrixFileVersion = 1;
+
+// Заголовок двоичного файла матрицы (64 байта, порядок байтов little-endian).
+// За заголовком с выравниванием alignment следуют rows * cols элементов без промежутков.
+struct MatrixFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dataType; // MatrixDataType
+    std::uint64_t rows;
+    std::uint64_t cols;
+    std::uint32_t layout; // MatrixLayout
+    std::uint32_t alignment; // Выравнивание начала данных в байтах
+    std::uint64_t payloadOffset; // Смещение данных от начала файла
+    std::uint64_t reserved[2];
+};
+static_assert(sizeof(MatrixFileHeader) == 64, "Заголовок файла матрицы должен занимать 64 байта");
+
+// Функция заполнения заголовка для матрицы rows x cols, хранящейся по строкам
+MatrixFileHeader makeMatrixFileHeader(int rows, int cols) {
+    MatrixFileHeader header = {};
+    std::copy(MatrixFileMagic, MatrixFileMagic + 8, header.magic);
+    header.version = MatrixFileVersion;
+    header.dataType = static_cast<std::uint32_t>(MatrixDataType::Float64);
+    header.rows = static_cast<std::uint64_t>(rows);
+    header.cols = static_cast<std::uint64_t>(cols);
+    header.layout = static_cast<std::uint32_t>(MatrixLayout::RowMajor);
+    header.alignment = static_cast<std::uint32_t>(MatrixAlignment);
+    header.payloadOffset = sizeof(MatrixFileHeader);
+    return header;
+}
+
+// Функция проверки заголовка; fileSize - полный размер файла в байтах
+void validateMatrixFileHeader(const MatrixFileHeader& header, std::uint64_t fileSize, const std::string& path) {
+    const std::uint16_t probe = 1;
+    if (*reinterpret_cast<const unsigned char*>(&probe) != 1) {
+        throw std::runtime_error("Двоичный формат матриц поддерживается только на little-endian платформах");
+    }
+    if (!std::equal(MatrixFileMagic, MatrixFileMagic + 8, header.magic)) {
+        throw std::invalid_argument("Файл " + path + " не является двоичным файлом матрицы");
+    }
+    if (header.version != MatrixFileVersion) {
+        throw std::invalid_argument("Неподдерживаемая версия файла матрицы " + path);
+    }
+    if (header.dataType != static_cast<std::uint32_t>(MatrixDataType::Float64)) {
+        throw std::invalid_argument("Неподдерживаемый тип элементов в файле " + path);
+    }
+    if (header.layout != static_cast<std::uint32_t>(MatrixLayout::RowMajor) && header.layout != static_cast<std::uint32_t>(MatrixLayout::ColumnMajor)) {
+        throw std::invalid_argument("Неизвестный порядок хранения в файле " + path);
+    }
+    const std::uint64_t maxDimension = static_cast<std::uint64_t>((std::numeric_limits<int>::max)());
+    if (header.rows > maxDimension || header.cols > maxDimension) {
+        throw std::invalid_argument("Слишком большие размеры матрицы в файле " + path);
+    }
+    if (header.alignment == 0 || header.payloadOffset < sizeof(MatrixFileHeader) || header.payloadOffset % header.alignment != 0 || header.payloadOffset % sizeof(double) != 0) {
+        throw std::invalid_argument("Неверное смещение данных в файле " + path);
+    }
+    // Размер данных сравнивается делением: произведение rows * cols * 8 для размеров до INT_MAX переполняет 64 бита
+    if (header.payloadOffset > fileSize) {
+        throw std::invalid_argument("Файл " + path + " короче, чем указано в заголовке");
+    }
+    const std::uint64_t capacity = (fileSize - header.payloadOffset) / sizeof(double);
+    if (header.rows != 0 && header.cols > capacity / header.rows) {
+        throw std::invalid_argument("Файл " + path + " короче, чем указано в заголовке");
+    }
+}
+
+// Функция проверки, начинается ли файл с сигнатуры двоичного формата матриц
+bool isMatrixFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[8] = {};
+    return file.read(magic, 8) && std::equal(MatrixFileMagic, MatrixFileMagic + 8, magic);
+}
+
+// Двоичный файл матрицы, отображённый в память. Операции работают прямо со страницами отображения,
+// без копирования в собственный буфер: загрузка сводится к отображению файла.
+class MappedMatrixFile {
+public:
+    MappedMatrixFile(const MappedMatrixFile&) = delete;
+    MappedMatrixFile& operator=(const MappedMatrixFile&) = delete;
+
+    ~MappedMatrixFile() {
+#ifdef _WIN32
+        if (base_ != nullptr) {
+            UnmapViewOfFile(base_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+#else
+        if (base_ != nullptr) {
+            munmap(base_, size_);
+        }
+        if (file_ >= 0) {
+            close(file_);
+        }
+#endif
+    }
+
+    // Отображение существующего файла только для чтения
+    static std::unique_ptr<MappedMatrixFile> open(const std::string& path) {
+        ProfileScope profile("map file");
+        std::unique_ptr<MappedMatrixFile> result(new MappedMatrixFile(path));
+        result->map(false, 0);
+        if (result->size_ < sizeof(MatrixFileHeader)) {
+            throw std::invalid_argument("Файл " + path + " короче заголовка матрицы");
+        }
+        validateMatrixFileHeader(result->header(), result->size_, path);
+        return result;
+    }
+
+    // Создание файла под матрицу rows x cols и отображение его для записи (элементы изначально нулевые)
+    static std::unique_ptr<MappedMatrixFile> create(const std::string& path, int rows, int cols) {
+        MatrixFileHeader header = makeMatrixFileHeader(rows, cols);
+        std::uint64_t size = header.payloadOffset + header.rows * header.cols * sizeof(double);
+        std::unique_ptr<MappedMatrixFile> result(new MappedMatrixFile(path));
+        result->map(true, size);
+        std::memcpy(result->base_, &header, sizeof(header));
+        return result;
+    }
+
+    const MatrixFileHeader& header() const { return *static_cast<const MatrixFileHeader*>(base_); }
+
+    ConstMatrixView view() const {
+        const MatrixFileHeader& h = header();
+        const double* data = reinterpret_cast<const double*>(static_cast<const char*>(base_) + h.payloadOffset);
+        int rows = static_cast<int>(h.rows);
+        int cols = static_cast<int>(h.cols);
+        if (h.layout == static_cast<std::uint32_t>(MatrixLayout::ColumnMajor)) {
+            return ConstMatrixView(data, rows, cols, 1, rows);
+        }
+        return ConstMatrixView(data, rows, cols, cols);
+    }
+
+    MatrixView mutableView() {
+        if (!writable_) {
+            throw std::logic_error("Файл матрицы " + path_ + " отображён только для чтения");
+        }
+        const MatrixFileHeader& h = header();
+        double* data = reinterpret_cast<double*>(static_cast<char*>(base_) + h.payloadOffset);
+        return MatrixView(data, static_cast<int>(h.rows), static_cast<int>(h.cols), static_cast<std::ptrdiff_t>(h.cols));
+    }
+
+    // Сброс изменённых страниц на диск
+    void flush() {
+#ifdef _WIN32
+        FlushViewOfFile(base_, 0);
+#else
+        msync(base_, size_, MS_SYNC);
+#endif
+    }
+
+    const std::string& path() const { return path_; }
+
+private:
+    explicit MappedMatrixFile(const std::string& path) : path_(path) {}
+
+    void map(bool writable, std::uint64_t createSize) {
+        writable_ = writable;
+#ifdef _WIN32
+        file_ = CreateFileA(path_.c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ,
+            nullptr, writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Не удалось открыть файл " + path_);
+        }
+        if (writable) {
+            size_ = static_cast<std::size_t>(createSize);
+        }
+        else {
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file_, &fileSize);
+            size_ = static_cast<std::size_t>(fileSize.QuadPart);
+        }
+        if (size_ == 0) {
+            throw std::invalid_argument("Файл " + path_ + " пуст");
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+            static_cast<DWORD>(static_cast<std::uint64_t>(size_) >> 32), static_cast<DWORD>(size_ & 0xFFFFFFFFu), nullptr);
+        if (mapping_ == nullptr) {
+            throw std::runtime_error("Не удалось отобразить файл " + path_);
+        }
+        base_ = MapViewOfFile(mapping_, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size_);
+        if (base_ == nullptr) {
+            throw std::runtime_error("Не удалось отобразить файл " + path_);
+        }
+#else
+        file_ = ::open(path_.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+        if (file_ < 0) {
+            throw std::runtime_error("Не удалось открыть файл " + path_);
+        }
+        if (writable) {
+            size_ = static_cast<std::size_t>(createSize);
+            if (ftruncate(file_, static_cast<off_t>(size_)) != 0) {
+                throw std::runtime_error("Не удалось задать размер файла " + path_);
+            }
+        }
+        else {
+            struct stat info;
+            if (fstat(file_, &info) != 0) {
+                throw std::runtime_error("Не удалось получить размер файла " + path_);
+            }
+            size_ = static_cast<std::size_t>(info.st_size);
+        }
+        if (size_ == 0) {
+            throw std::invalid_argument("Файл " + path_ + " пуст");
+        }
+        void* base = mmap(nullptr, size_, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file_, 0);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("Не удалось отобразить файл " + path_);
+        }
+        base_ = base;
+        madvise(base_, size_, MADV_WILLNEED);
+#endif
+    }
+
+    std::string path_;
+    bool writable_ = false;
+    void* base_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int file_ = -1;
+#endif
+};
+
+// Функция записи матрицы в двоичный файл (строки пишутся блоками без промежуточного буфера)
+void writeMatrixFile(const std::string& path, ConstMatrixView matrix) {
+    ProfileScope profile("write binary");
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Не удалось создать файл " + path);
+    }
+    MatrixFileHeader header = makeMatrixFileHeader(matrix.rows(), matrix.cols());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<double> row;
+    for (int i = 0; i < matrix.rows(); i++) {
+        if (matrix.hasContiguousRows()) {
+            file.write(reinterpret_cast<const char*>(matrix.rowData(i)), static_cast<std::streamsize>(matrix.cols() * sizeof(double)));
+        }
+        else {
+            row.resize(matrix.cols());
+            for (int j = 0; j < matrix.cols(); j++) {
+                row[j] = matrix(i, j);
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(double)));
+        }
+    }
+    if (!file) {
+        throw std::runtime_error("Ошибка записи файла " + path);
+    }
+}
+
+// Двоичный файл матрицы с позиционным вводом-выводом (pread/pwrite) вместо отображения в память:
+// читаются и пишутся только нужные прямоугольные блоки, поэтому файл может быть больше оперативной памяти
+class MatrixFileStream {
+public:
+    MatrixFileStream(const MatrixFileStream&) = delete;
+    MatrixFileStream& operator=(const MatrixFileStream&) = delete;
+
+    ~MatrixFileStream() {
+#ifdef _WIN32
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+#else
+        if (file_ >= 0) {
+            close(file_);
+        }
+#endif
+    }
+
+    // Открытие существующего файла для чтения
+    static std::unique_ptr<MatrixFileStream> open(const std::string& path) {
+        std::unique_ptr<MatrixFileStream> result(new MatrixFileStream(path, false));
+        result->readAt(0, &result->header_, sizeof(MatrixFileHeader));
+        validateMatrixFileHeader(result->header_, result->fileSize(), path);
+        return result;
+    }
+
+    // Создание файла под матрицу rows x cols (по строкам); элементы изначально нулевые.
+    // Если файл открыт, но не подготовлен, он удаляется
+    static std::unique_ptr<MatrixFileStream> create(const std::string& path, int rows, int cols) {
+        std::unique_ptr<MatrixFileStream> result(new MatrixFileStream(path, true));
+        try {
+            result->header_ = makeMatrixFileHeader(rows, cols);
+            result->writeAt(0, &result->header_, sizeof(MatrixFileHeader));
+            result->resize(result->header_.payloadOffset + result->header_.rows * result->header_.cols * sizeof(double));
+        }
+        catch (...) {
+            result.reset();
+            std::remove(path.c_str());
+            throw;
+        }
+        return result;
+    }
+
+    int rows() const { return static_cast<int>(header_.rows); }
+    int cols() const { return static_cast<int>(header_.cols); }
+    const std::string& path() const { return path_; }
+
+    // Чтение блока, начинающегося с элемента (row, col), размером tile.rows() x tile.cols() (строки tile подряд)
+    void readTile(int row, int col, MatrixView tile) {
+        if (header_.layout == static_cast<std::uint32_t>(MatrixLayout::ColumnMajor)) {
+            // Файл по столбцам: столбец блока читается целиком и раскладывается по строкам
+            std::vector<double> column(tile.rows());
+            for (int j = 0; j < tile.cols(); j++) {
+                readAt(elementOffset(row, col + j), column.data(), column.size() * sizeof(double));
+                for (int i = 0; i < tile.rows(); i++) {
+                    tile(i, j) = column[i];
+                }
+            }
+            return;
+        }
+        for (int i = 0; i < tile.rows(); i++) {
+            readAt(elementOffset(row + i, col), tile.rowData(i), static_cast<std::size_t>(tile.cols()) * sizeof(double));
+        }
+    }
+
+    // Запись блока tile (строки подряд) начиная с элемента (row, col)
+    void writeTile(int row, int col, ConstMatrixView tile) {
+        for (int i = 0; i < tile.rows(); i++) {
+            writeAt(elementOffset(row + i, col), tile.rowData(i), static_cast<std::size_t>(tile.cols()) * sizeof(double));
+        }
+    }
+
+    // Сброс записанных данных на диск
+    void sync() {
+#ifdef _WIN32
+        FlushFileBuffers(file_);
+#else
+        fsync(file_);
+#endif
+    }
+
+private:
+    MatrixFileStream(const std::string& path, bool writable) : path_(path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ,
+            nullptr, writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Не удалось открыть файл " + path);
+        }
+#else
+        file_ = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+        if (file_ < 0) {
+            throw std::runtime_error("Не удалось открыть файл " + path);
+        }
+#endif
+    }
+
+    std::uint64_t elementOffset(int row, int col) const {
+        std::uint64_t index = header_.layout == static_cast<std::uint32_t>(MatrixLayout::ColumnMajor)
+            ? static_cast<std::uint64_t>(col) * header_.rows + static_cast<std::uint64_t>(row)
+            : static_cast<std::uint64_t>(row) * header_.cols + static_cast<std::uint64_t>(col);
+        return header_.payloadOffset + index * sizeof(double);
+    }
+
+    std::uint64_t fileSize() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        return static_cast<std::uint64_t>(size.QuadPart);
+#else
+        struct stat info;
+        if (fstat(file_, &info) != 0) {
+            throw std::runtime_error("Не удалось получить размер файла " + path_);
+        }
+        return static_cast<std::uint64_t>(info.st_size);
+#endif
+    }
+
+    void resize(std::uint64_t size) {
+#ifdef _WIN32
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file_, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file_)) {
+            throw std::runtime_error("Не удалось задать размер файла " + path_);
+        }
+#else
+        if (ftruncate(file_, static_cast<off_t>(size)) != 0) {
+            throw std::runtime_error("Не удалось задать размер файла " + path_);
+        }
+#endif
+    }
+
+    void readAt(std::uint64_t offset, void* data, std::size_t bytes) {
+        char* target = static_cast<char*>(data);
+        while (bytes > 0) {
+#ifdef _WIN32
+            OVERLAPPED position = {};
+            position.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFu);
+            position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD done = 0;
+            DWORD chunk = static_cast<DWORD>((std::min)(bytes, static_cast<std::size_t>(1) << 30));
+            if (!ReadFile(file_, target, chunk, &done, &position) || done == 0) {
+                throw std::runtime_error("Ошибка чтения файла " + path_);
+            }
+            std::size_t count = done;
+#else
+            ssize_t done = ::pread(file_, target, bytes, static_cast<off_t>(offset));
+            if (done < 0 && errno == EINTR) {
+                continue;
+            }
+            if (done <= 0) {
+                throw std::runtime_error("Ошибка чтения файла " + path_);
+            }
+            std::size_t count = static_cast<std::size_t>(done);
+#endif
+            target += count;
+            offset += count;
+            bytes -= count;
+        }
+    }
+
+    void writeAt(std::uint64_t offset, const void* data, std::size_t bytes) {
+        const char* source = static_cast<const char*>(data);
+        while (bytes > 0) {
+#ifdef _WIN32
+            OVERLAPPED position = {};
+            position.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFu);
+            position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD done = 0;
+            DWORD chunk = static_cast<DWORD>((std::min)(bytes, static_cast<std::size_t>(1) << 30));
+            if (!WriteFile(file_, source, chunk, &done, &position) || done == 0) {
+                throw std::runtime_error("Ошибка записи файла " + path_);
+            }
+            std::size_t count = done;
+#else
+            ssize_t done = ::pwrite(file_, source, bytes, static_cast<off_t>(offset));
+            if (done < 0 && errno == EINTR) {
+                continue;
+            }
+            if (done <= 0) {
+                throw std::runtime_error("Ошибка записи файла " + path_);
+            }
+            std::size_t count = static_cast<std::size_t>(done);
+#endif
+            source += count;
+            offset += count;
+            bytes -= count;
+        }
+    }
+
+    std::string path_;
+    MatrixFileHeader header_ = {};
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+    int file_ = -1;
+#endif
+};
+
+// Операции пакетного режима
+enum class BatchOperation {
+    Rank,
+    Transpose,
+    Determinant,
+    Trace,
+    Inverse,
+    Equal,
+    Add,
+    Multiply
+};
+
+// Операция над двумя матрицами (задание тогда состоит из пары матриц)
+bool isBinaryOperation(BatchOperation operation) {
+    return operation == BatchOperation::Equal || operation == BatchOperation::Add || operation == BatchOperation::Multiply;
+}
+
+const char* operationName(BatchOperation operation) {
+    switch (operation) {
+    case BatchOperation::Rank: return "rank";
+    case BatchOperation::Transpose: return "transpose";
+    case BatchOperation::Determinant: return "det";
+    case BatchOperation::Trace: return "trace";
+    case BatchOperation::Inverse: return "inverse";
+    case BatchOperation::Equal: return "equal";
+    case BatchOperation::Add: return "add";
+    case BatchOperation::Multiply: return "multiply";
+    }
+    return "";
+}
+
+// Функция разбора имени операции из командной строки
+BatchOperation parseOperation(const std::string& name) {
+    const BatchOperation all[] = {
+        BatchOperation::Rank, BatchOperation::Transpose, BatchOperation::Determinant, BatchOperation::Trace,
+        BatchOperation::Inverse, BatchOperation::Equal, BatchOperation::Add, BatchOperation::Multiply
+    };
+    for (BatchOperation operation : all) {
+        if (name == operationName(operation)) {
+            return operation;
+        }
+    }
+    if (name == "determinant") {
+        return BatchOperation::Determinant;
+    }
+    throw std::invalid_argument("Неизвестная операция: " + name);
+}
+
+// Функция разбора списка операций через запятую
+std::vector<BatchOperation> parseOperationList(const std::string& list) {
+    std::vector<BatchOperation> operations;
+    std::size_t start = 0;
+    while (start <= list.size()) {
+        std::size_t comma = list.find(',', start);
+        std::string name = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!name.empty()) {
+            operations.push_back(parseOperation(name));
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+    return operations;
+}
+
+// Параметры пакетного режима
+struct BatchOptions {
+    std::vector<BatchOperation> operations; // Пусто - все операции, как в интерактивном режиме
+    std::vector<std::string> inputs; // Пусто или "-" - стандартный ввод
+    std::string output; // Пусто или "-" - стандартный вывод
+    std::string binaryDirectory; // Непусто - матричные результаты пишутся двоичными файлами в этот каталог
+    MatrixTextFormat format = MatrixTextFormat::Whitespace; // Текстовый формат входных матриц и матричных результатов
+    EqualityTolerance tolerance; // Допуск операции equal
+    int threads = 0;
+};
+
+// Матрица задания: собственный буфер (текстовый ввод) или отображённый в память двоичный файл
+struct BatchMatrix {
+    Matrix storage;
+    std::shared_ptr<const MappedMatrixFile> mapping;
+
+    ConstMatrixView view() const { return mapping ? mapping->view() : storage.view(); }
+};
+
+// Задание пакетного режима: одна матрица или пара матриц
+struct BatchJob {
+    long long index = 0;
+    BatchMatrix first;
+    BatchMatrix second;
+    bool hasSecond = false;
+    std::string result;
+};
+
+// Чтение матриц подряд из нескольких файлов (или стандартного ввода) в текстовом формате format;
+// '#' - комментарий до конца строки. Файл двоичного формата (MatrixFileHeader) содержит ровно одну
+// матрицу и отображается в память без разбора.
+class MatrixStreamReader {
+public:
+    MatrixStreamReader(const std::vector<std::string>& inputs, MatrixTextFormat format) : inputs_(inputs), format_(format) {
+        if (inputs_.empty()) {
+            inputs_.push_back("-");
+        }
+    }
+
+    // Чтение следующей матрицы; false, если входные данные закончились
+    bool read(BatchMatrix& matrix) {
+        while (next_ < inputs_.size()) {
+            const std::string& name = inputs_[next_];
+            if (!reader_) {
+                if (name != "-" && isMatrixFile(name)) {
+                    matrix.mapping = MappedMatrixFile::open(name);
+                    next_++;
+                    return true;
+                }
+                if (name != "-") {
+                    file_.open(name, std::ios::binary);
+                    if (!file_) {
+                        throw std::runtime_error("Не удалось открыть файл " + name);
+                    }
+                }
+                reader_.reset(new TextNumberReader(name == "-" ? std::cin : file_));
+            }
+
+            bool found = false;
+            try {
+                found = format_ == MatrixTextFormat::Csv ? readMatrixCsv(*reader_, matrix.storage, values_) : readMatrixText(*reader_, matrix.storage);
+            }
+            catch (const std::invalid_argument& e) {
+                throw std::invalid_argument(std::string(e.what()) + " в " + name);
+            }
+            if (found) {
+                matrix.mapping.reset();
+                return true;
+            }
+            nextInput();
+        }
+        return false;
+    }
+
+private:
+    void nextInput() {
+        reader_.reset();
+        if (file_.is_open()) {
+            file_.close();
+            file_.clear();
+        }
+        next_++;
+    }
+
+    std::vector<std::string> inputs_;
+    MatrixTextFormat format_;
+    std::size_t next_ = 0;
+    std::ifstream file_;
+    std::unique_ptr<TextNumberReader> reader_;
+    std::vector<double> values_;
+};
+
+// Запись матричного результата после заголовка операции: текстом в out или, если задан путь,
+// двоичным файлом со ссылкой на него в out
+void writeMatrixResult(TextOutput& out, ConstMatrixView matrix, MatrixTextFormat format, const std::string& path) {
+    if (!path.empty()) {
+        writeMatrixFile(path, matrix);
+        out << " file " << path << '\n';
+        return;
+    }
+    out << (format == MatrixTextFormat::Csv ? '\n' : ' ');
+    writeMatrixText(out, matrix, format);
+}
+
+// Функция выполнения унарной операции над матрицей задания; результат дописывается в out.
+// resultPath - файл для матричного результата (пусто - результат пишется текстом)
+// factors - заранее посчитанное LU-разложение matrix для определителя и обратной (nullptr - считать здесь)
+void runUnaryOperation(BatchOperation operation, const char* operand, ConstMatrixView matrix, TextOutput& out, MatrixTextFormat format, const std::string& resultPath, Workspace& workspace,
+    const LUDecomposition* factors = nullptr) {
+    out << operationName(operation) << ' ' << operand;
+    switch (operation) {
+    case BatchOperation::Rank:
+        out << ' ' << findRank(matrix) << '\n';
+        break;
+    case BatchOperation::Transpose: {
+        ProfileScope profile("transpose");
+        MatrixView transposed = workspace.allocateMatrix(matrix.cols(), matrix.rows());
+        transposeInto(matrix, transposed);
+        writeMatrixResult(out, transposed, format, resultPath);
+        break;
+    }
+    case BatchOperation::Determinant:
+        if (!isSquareMatrix(matrix)) {
+            throw std::invalid_argument("матрица не квадратная");
+        }
+        if (matrix.rows() == 1) {
+            out << ' ' << matrix(0, 0) << '\n';
+        }
+        else {
+            out << ' ' << (factors != nullptr && determinantUsesLU(matrix) ? factors->determinant() : determinant(matrix)) << '\n';
+        }
+        break;
+    case BatchOperation::Trace:
+        if (!isSquareMatrix(matrix)) {
+            throw std::invalid_argument("матрица не квадратная");
+        }
+        out << ' ' << trace(matrix) << '\n';
+        break;
+    case BatchOperation::Inverse: {
+        if (!isSquareMatrix(matrix)) {
+            throw std::invalid_argument("матрица не квадратная");
+        }
+        MatrixView inverse = workspace.allocateMatrix(matrix.rows(), matrix.cols());
+        bool invertible = true;
+        if (factors != nullptr && inverseUsesLU(matrix)) {
+            invertible = !factors->singular;
+            if (invertible) {
+                inverseFromLU<double>(factors->lu, factors->permutation.data(), inverse);
+            }
+        }
+        else {
+            invertible = inverseInto(matrix, inverse, workspace);
+        }
+        if (!invertible) {
+            out << " singular\n";
+        }
+        else {
+            writeMatrixResult(out, inverse, format, resultPath);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Функция выполнения бинарной операции над парой матриц задания
+void runBinaryOperation(BatchOperation operation, ConstMatrixView first, ConstMatrixView second, TextOutput& out, MatrixTextFormat format,
+    const EqualityTolerance& tolerance, const std::string& resultPath, Workspace& workspace) {
+    out << operationName(operation) << " AB";
+    switch (operation) {
+    case BatchOperation::Equal:
+        out << (areMatricesEqual(first, second, tolerance) ? " true" : " false") << '\n';
+        break;
+    case BatchOperation::Add:
+        if (first.rows() != second.rows() || first.cols() != second.cols()) {
+            throw std::invalid_argument("размеры матриц не совпадают");
+        }
+        {
+            MatrixView sum = workspace.allocateMatrix(first.rows(), first.cols());
+            addInto(first, second, sum);
+            writeMatrixResult(out, sum, format, resultPath);
+        }
+        break;
+    case BatchOperation::Multiply:
+        if (first.cols() != second.rows()) {
+            throw std::invalid_argument("число столбцов A не равно числу строк B");
+        }
+        {
+            MatrixView product = workspace.allocateMatrix(first.rows(), second.cols());
+            multiplyInto(first, second, product);
+            writeMatrixResult(out, product, format, resultPath);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Путь для матричного результата операции задания (пусто - результат пишется текстом)
+std::string batchResultPath(const BatchJob& job, const BatchOptions& options, BatchOperation operation, const char* operand) {
+    if (options.binaryDirectory.empty()) {
+        return std::string();
+    }
+    return options.binaryDirectory + "/job" + std::to_string(job.index) + "_" + operationName(operation) + "_" + operand + ".p2vm";
+}
+
+// Выполнение унарной операции задания с выводом в out: ошибка заменяет частичный вывод операции сообщением.
+// Результат берётся из рабочей области и освобождается сразу после вывода
+void runJobUnaryOperation(const BatchJob& job, const BatchOptions& options, BatchOperation operation, const char* operand, ConstMatrixView matrix,
+    TextOutput& out, Workspace& workspace, const LUDecomposition* factors = nullptr) {
+    std::size_t start = out.size();
+    try {
+        WorkspaceScope operationScope(workspace);
+        runUnaryOperation(operation, operand, matrix, out, options.format, batchResultPath(job, options, operation, operand), workspace, factors);
+    }
+    catch (const std::exception& e) {
+        out.truncate(start);
+        out << operationName(operation) << ' ' << operand << " error " << e.what() << '\n';
+    }
+}
+
+// Выполнение бинарной операции задания с выводом в out (см. runJobUnaryOperation)
+void runJobBinaryOperation(const BatchJob& job, const BatchOptions& options, BatchOperation operation, ConstMatrixView first, ConstMatrixView second,
+    TextOutput& out, Workspace& workspace) {
+    std::size_t start = out.size();
+    try {
+        WorkspaceScope operationScope(workspace);
+        runBinaryOperation(operation, first, second, out, options.format, options.tolerance, batchResultPath(job, options, operation, "AB"), workspace);
+    }
+    catch (const std::exception& e) {
+        out.truncate(start);
+        out << operationName(operation) << " AB error " << e.what() << '\n';
+    }
+}
+
+// Суммарное число элементов матриц задания, начиная с которого задание выполняется графом задач:
+// для меньших матриц накладные расходы графа сравнимы с самими операциями
+constexpr std::size_t TaskGraphMinElements = 64 * 64;
+
+// Имя узла графа для операции над операндом ("det A", "multiply AB"). Строки живут до конца программы,
+// поскольку на имена ссылаются события профилирования
+const char* operationTaskName(BatchOperation operation, int operand) {
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> result;
+        for (int op = 0; op <= static_cast<int>(BatchOperation::Multiply); op++) {
+            for (const char* suffix : { " A", " B", " AB" }) {
+                result.push_back(operationName(static_cast<BatchOperation>(op)) + std::string(suffix));
+            }
+        }
+        return result;
+    }();
+    return names[static_cast<int>(operation) * 3 + operand].c_str();
+}
+
+// Отчёт о выполнении графа задач в стандартный поток ошибок (только при включённом профилировании)
+void reportTaskGraph(const TaskGraph& graph, const std::string& title) {
+    if (!Profiler::instance().enabled()) {
+        return;
+    }
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cerr << title << '\n';
+    graph.writeTimeline(std::cerr);
+}
+
+// Задание с крупными матрицами выполняется графом задач: независимые операции (в том числе над разными
+// матрицами) идут параллельно, а определитель и обратная матрица используют одно LU-разложение.
+// Каждая операция пишет в собственный фрагмент, фрагменты собираются в исходном порядке операций.
+void runBatchJobGraph(const BatchJob& job, const BatchOptions& options, ConstMatrixView first, ConstMatrixView second, TextOutput& out) {
+    ConstMatrixView matrices[] = { first, second };
+    const char* operands[] = { "A", "B" };
+    int operandCount = job.hasSecond ? 2 : 1;
+
+    // Признаки использования общего LU-разложения каждой матрицы
+    auto usesFactors = [&](BatchOperation operation, int k) {
+        return (operation == BatchOperation::Determinant && matrices[k].rows() > 1 && determinantUsesLU(matrices[k]))
+            || (operation == BatchOperation::Inverse && inverseUsesLU(matrices[k]));
+    };
+
+    TaskGraph graph;
+    LUDecomposition factors[2];
+    bool factored[2] = { false, false };
+    int factorNodes[2] = { -1, -1 };
+    for (int k = 0; k < operandCount; k++) {
+        bool needed = false;
+        for (BatchOperation operation : options.operations) {
+            needed = needed || (!isBinaryOperation(operation) && usesFactors(operation, k));
+        }
+        if (needed) {
+            // Ошибка разложения не прерывает задание: зависящие операции посчитают результат сами
+            factorNodes[k] = graph.add(k == 0 ? "lu A" : "lu B", [&, k] {
+                try {
+                    factors[k] = decomposeLU(matrices[k]);
+                    factored[k] = true;
+                }
+                catch (const std::exception&) {
+                }
+            });
+        }
+    }
+
+    std::size_t fragmentCount = 0;
+    for (BatchOperation operation : options.operations) {
+        fragmentCount += isBinaryOperation(operation) ? 1 : operandCount;
+    }
+    std::vector<std::string> fragments(fragmentCount);
+    std::size_t fragment = 0;
+    for (BatchOperation operation : options.operations) {
+        if (isBinaryOperation(operation)) {
+            graph.add(operationTaskName(operation, 2), [&, operation, fragment] {
+                TextOutput part(fragments[fragment]);
+                runJobBinaryOperation(job, options, operation, first, second, part, threadWorkspace());
+            });
+            fragment++;
+            continue;
+        }
+        for (int k = 0; k < operandCount; k++) {
+            auto body = [&, operation, k, fragment] {
+                TextOutput part(fragments[fragment]);
+                const LUDecomposition* shared = usesFactors(operation, k) && factored[k] ? &factors[k] : nullptr;
+                runJobUnaryOperation(job, options, operation, operands[k], matrices[k], part, threadWorkspace(), shared);
+            };
+            if (usesFactors(operation, k)) {
+                graph.add(operationTaskName(operation, k), body, { factorNodes[k] });
+            }
+            else {
+                graph.add(operationTaskName(operation, k), body);
+            }
+            fragment++;
+        }
+    }
+
+    graph.run(threadPool());
+    for (const std::string& part : fragments) {
+        out << part;
+    }
+    reportTaskGraph(graph, "# job " + std::to_string(job.index));
+}
+
+// Функция обработки одного задания. Ошибка операции не прерывает пакет: частичный вывод операции
+// отбрасывается, а вместо него записывается сообщение об ошибке.
+// Результаты и временные буферы операций берутся из рабочей области потока и возвращаются ей
+// после вывода каждой операции, а буфер текста задания переиспользуется, поэтому в установившемся
+// режиме задания с небольшими матрицами не обращаются к куче. Задания с крупными матрицами
+// выполняются графом задач (runBatchJobGraph).
+void runBatchJob(BatchJob& job, const BatchOptions& options) {
+    ProfileScope profile("batch job");
+    job.result.clear();
+    TextOutput out(job.result);
+    out << "# job " << job.index << '\n';
+
+    ConstMatrixView first = job.first.view();
+    ConstMatrixView second = job.second.view();
+    std::size_t elements = static_cast<std::size_t>(first.rows()) * first.cols();
+    if (job.hasSecond) {
+        elements += static_cast<std::size_t>(second.rows()) * second.cols();
+    }
+    if (elements >= TaskGraphMinElements) {
+        runBatchJobGraph(job, options, first, second, out);
+        return;
+    }
+
+    Workspace& workspace = threadWorkspace();
+    const char* operands[] = { "A", "B" };
+    ConstMatrixView matrices[] = { first, second };
+    for (BatchOperation operation : options.operations) {
+        if (isBinaryOperation(operation)) {
+            runJobBinaryOperation(job, options, operation, first, second, out, workspace);
+            continue;
+        }
+        for (int k = 0; k < (job.hasSecond ? 2 : 1); k++) {
+            runJobUnaryOperation(job, options, operation, operands[k], matrices[k], out, workspace);
+        }
+    }
+}
+
+void printBatchUsage(std::ostream& out) {
+    out << "Использование: P2V1 --batch [--ops список] [--output файл] [--binary-dir каталог] [--format text|csv]\n"
+        << "                [--tolerance допуск] [--nan-equal] [--threads N] [файл ...]\n"
+        << "  --ops       операции через запятую: rank,transpose,det,trace,inverse,equal,add,multiply\n"
+        << "              (по умолчанию все; при equal/add/multiply задание - пара матриц A и B)\n"
+        << "  --output    файл результатов (по умолчанию стандартный вывод)\n"
+        << "  --binary-dir каталог для матричных результатов в двоичном формате (в результатах - ссылка на файл)\n"
+        << "  --format    текстовый формат матриц: text - \"строки столбцы элементы...\" (по умолчанию),\n"
+        << "              csv - строки через запятую, матрицы разделяются пустой строкой\n"
+        << "  --tolerance допуск операции equal: exact (по умолчанию), abs:x, rel:x или ulp:n\n"
+        << "  --nan-equal в операции equal считать NaN равным NaN\n"
+        << "  --threads   число потоков (по умолчанию по числу аппаратных потоков)\n"
+        << "  файл        файлы с матрицами в текстовом формате или двоичные файлы матриц (отображаются в память);\n"
+        << "              '-' или без файлов - стандартный ввод\n"
+        << "  --profile   summary - сводка по этапам в стандартный поток ошибок, trace - Chrome trace-event JSON\n"
+        << "              (--profile-output файл; для trace по умолчанию p2v1_trace.json)\n";
+}
+
+// Функция разбора аргументов пакетного режима
+BatchOptions parseBatchOptions(int argc, char* argv[]) {
+    BatchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Не указано значение параметра " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--batch") {
+            continue;
+        }
+        else if (arg == "--ops") {
+            options.operations = parseOperationList(value());
+        }
+        else if (arg == "--output") {
+            options.output = value();
+        }
+        else if (arg == "--binary-dir") {
+            options.binaryDirectory = value();
+        }
+        else if (arg == "--format") {
+            std::string format = value();
+            if (format == "text") {
+                options.format = MatrixTextFormat::Whitespace;
+            }
+            else if (format == "csv") {
+                options.format = MatrixTextFormat::Csv;
+            }
+            else {
+                throw std::invalid_argument("Неизвестный формат: " + format);
+            }
+        }
+        else if (arg == "--tolerance") {
+            bool nanEqual = options.tolerance.nanEqual;
+            options.tolerance = parseEqualityTolerance(value());
+            options.tolerance.nanEqual = nanEqual;
+        }
+        else if (arg == "--nan-equal") {
+            options.tolerance.nanEqual = true;
+        }
+        else if (arg == "--threads") {
+            options.threads = std::stoi(value());
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && arg != "-") {
+            throw std::invalid_argument("Неизвестный параметр " + arg);
+        }
+        else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    if (options.operations.empty()) {
+        options.operations = {
+            BatchOperation::Rank, BatchOperation::Transpose, BatchOperation::Determinant, BatchOperation::Trace,
+            BatchOperation::Inverse, BatchOperation::Equal, BatchOperation::Add, BatchOperation::Multiply
+        };
+    }
+    return options;
+}
+
+// Пакетный режим: задания читаются порциями, порция обрабатывается параллельно на пуле потоков,
+// результаты пишутся в исходном порядке заданий
+int runBatch(int argc, char* argv[]) {
+    BatchOptions options;
+    try {
+        options = parseBatchOptions(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        printBatchUsage(std::cerr);
+        return 1;
+    }
+
+    if (options.threads > 0) {
+        setThreadCount(options.threads);
+    }
+
+    std::ofstream file;
+    if (!options.output.empty() && options.output != "-") {
+        file.open(options.output, std::ios::binary);
+        if (!file) {
+            std::cerr << "Ошибка: не удалось открыть файл " << options.output << '\n';
+            return 1;
+        }
+    }
+    std::ostream& out = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+
+    bool pairs = false;
+    for (BatchOperation operation : options.operations) {
+        pairs = pairs || isBinaryOperation(operation);
+    }
+
+    constexpr int ChunkSize = 256;
+    MatrixStreamReader reader(options.inputs, options.format);
+    std::vector<BatchJob> jobs(ChunkSize);
+    long long processed = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    try {
+        bool more = true;
+        while (more) {
+            int count = 0;
+            {
+                ProfileScope profile("read input");
+                while (count < ChunkSize) {
+                    BatchJob& job = jobs[count];
+                    if (!reader.read(job.first)) {
+                        more = false;
+                        break;
+                    }
+                    job.hasSecond = pairs;
+                    if (pairs && !reader.read(job.second)) {
+                        throw std::invalid_argument("У последнего задания нет второй матрицы");
+                    }
+                    job.index = processed + count + 1;
+                    count++;
+                }
+            }
+
+            threadPool().parallelFor(0, count, 1, [&](int first, int last) {
+                for (int i = first; i < last; i++) {
+                    runBatchJob(jobs[i], options);
+                }
+            });
+
+            ProfileScope profile("write output");
+            for (int i = 0; i < count; i++) {
+                out.write(jobs[i].result.data(), static_cast<std::streamsize>(jobs[i].result.size()));
+            }
+            processed += count;
+        }
+    }
+    catch (const std::exception& e) {
+        out.flush();
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        return 1;
+    }
+
+    out.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Обработано заданий: " << processed << " за " << seconds << " с ("
+        << (seconds > 0.0 ? processed / seconds : 0.0) << " заданий/с)\n";
+    return 0;
+}
+
+// Режим сервера: долгоживущий процесс принимает запросы - по одному объекту JSON на строку - со
+// стандартного ввода или через сокет Unix. Загруженные матрицы хранятся под именами, одинаковые по
+// содержимому матрицы - в одном экземпляре (ключ - 64-битный хеш содержимого), а производные результаты
+// (LU-разложение, ранг, определитель, след, обратная, транспонированная, сумма, произведение) - в кэше
+// LRU с ограничением по памяти. Повторный запрос к тем же матрицам отвечается из кэша без вычислений.
+// Хеш содержимого - отпечаток MatrixFingerprint, поэтому неравенство матриц часто видно сразу по хешам.
+
+// Значение JSON. Массив из одних чисел хранится сразу в numbers - без отдельного узла на элемент,
+// поэтому большие матрицы в запросах разбираются без лишних выделений
+struct JsonValue {
+    enum class Kind { Null, Boolean, Number, String, Array, Object };
+
+    Kind kind = Kind::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string text;
+    std::vector<double> numbers; // Элементы массива, если все они числа
+    std::vector<JsonValue> items; // Элементы массива в остальных случаях
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    bool isArray() const { return kind == Kind::Array; }
+    std::size_t arraySize() const { return items.empty() ? numbers.size() : items.size(); }
+
+    // Поле объекта с именем key; nullptr, если его нет
+    const JsonValue* find(const char* key) const {
+        for (const auto& member : members) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Разбор текста JSON (RFC 8259); при ошибке - invalid_argument с позицией
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text_(text) {}
+
+    JsonValue parse() {
+        JsonValue result = value(0);
+        skipSpace();
+        if (pos_ != text_.size()) {
+            fail("лишние символы после значения");
+        }
+        return result;
+    }
+
+private:
+    static constexpr int MaxDepth = 64;
+
+    [[noreturn]] void fail(const char* message) const {
+        throw std::invalid_argument(std::string("Неверный JSON: ") + message + " (позиция " + std::to_string(pos_) + ")");
+    }
+
+    void skipSpace() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\r' || text_[pos_] == '\n')) {
+            pos_++;
+        }
+    }
+
+    bool consume(const char* word) {
+        std::size_t length = std::strlen(word);
+        if (text_.compare(pos_, length, word) == 0) {
+            pos_ += length;
+            return true;
+        }
+        return false;
+    }
+
+    JsonValue value(int depth) {
+        if (depth > MaxDepth) {
+            fail("слишком глубокая вложенность");
+        }
+        skipSpace();
+        if (pos_ >= text_.size()) {
+            fail("неожиданный конец текста");
+        }
+
+        JsonValue result;
+        char c = text_[pos_];
+        if (c == '{') {
+            result.kind = JsonValue::Kind::Object;
+            pos_++;
+            skipSpace();
+            if (pos_ < text_.size() && text_[pos_] == '}') {
+                pos_++;
+                return result;
+            }
+            while (true) {
+                skipSpace();
+                if (pos_ >= text_.size() || text_[pos_] != '"') {
+                    fail("ожидалось имя поля");
+                }
+                std::string key = string();
+                skipSpace();
+                if (pos_ >= text_.size() || text_[pos_] != ':') {
+                    fail("ожидалось ':'");
+                }
+                pos_++;
+                result.members.emplace_back(std::move(key), value(depth + 1));
+                skipSpace();
+                if (pos_ < text_.size() && text_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                if (pos_ < text_.size() && text_[pos_] == '}') {
+                    pos_++;
+                    return result;
+                }
+                fail("ожидалось ',' или '}'");
+            }
+        }
+        if (c == '[') {
+            result.kind = JsonValue::Kind::Array;
+            pos_++;
+            skipSpace();
+            if (pos_ < text_.size() && text_[pos_] == ']') {
+                pos_++;
+                return result;
+            }
+            while (true) {
+                JsonValue item = value(depth + 1);
+                if (item.kind == JsonValue::Kind::Number && result.items.empty()) {
+                    result.numbers.push_back(item.number);
+                }
+                else {
+                    // Первый нечисловой элемент: накопленные числа переносятся в общий список
+                    for (double number : result.numbers) {
+                        JsonValue converted;
+                        converted.kind = JsonValue::Kind::Number;
+                        converted.number = number;
+                        result.items.push_back(std::move(converted));
+                    }
+                    result.numbers.clear();
+                    result.items.push_back(std::move(item));
+                }
+                skipSpace();
+                if (pos_ < text_.size() && text_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                if (pos_ < text_.size() && text_[pos_] == ']') {
+                    pos_++;
+                    return result;
+                }
+                fail("ожидалось ',' или ']'");
+            }
+        }
+        if (c == '"') {
+            result.kind = JsonValue::Kind::String;
+            result.text = string();
+            return result;
+        }
+        if (consume("true")) {
+            result.kind = JsonValue::Kind::Boolean;
+            result.boolean = true;
+            return result;
+        }
+        if (consume("false")) {
+            result.kind = JsonValue::Kind::Boolean;
+            return result;
+        }
+        if (consume("null")) {
+            return result;
+        }
+
+        std::size_t end = pos_;
+        while (end < text_.size() && (std::isdigit(static_cast<unsigned char>(text_[end])) || text_[end] == '-' || text_[end] == '+'
+            || text_[end] == '.' || text_[end] == 'e' || text_[end] == 'E')) {
+            end++;
+        }
+        const char* first = text_.data() + pos_;
+        const char* last = text_.data() + end;
+        std::from_chars_result parsed = std::from_chars(first, last, result.number);
+        if (first == last || *first == '+' || parsed.ec != std::errc() || parsed.ptr != last) {
+            fail("неверное значение");
+        }
+        result.kind = JsonValue::Kind::Number;
+        pos_ = end;
+        return result;
+    }
+
+    // Строка в кавычках с управляющими последовательностями; \uXXXX перекодируется в UTF-8
+    std::string string() {
+        std::string result;
+        pos_++;
+        while (true) {
+            if (pos_ >= text_.size()) {
+                fail("незакрытая строка");
+            }
+            char c = text_[pos_++];
+            if (c == '"') {
+                return result;
+            }
+            if (c != '\\') {
+                result.push_back(c);
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                fail("незакрытая строка");
+            }
+            char escape = text_[pos_++];
+            switch (escape) {
+            case '"': result.push_back('"'); break;
+            case '\\': result.push_back('\\'); break;
+            case '/': result.push_back('/'); break;
+            case 'b': result.push_back('\b'); break;
+            case 'f': result.push_back('\f'); break;
+            case 'n': result.push_back('\n'); break;
+            case 'r': result.push_back('\r'); break;
+            case 't': result.push_back('\t'); break;
+            case 'u': {
+                std::uint32_t code = hex4();
+                if (code >= 0xD800 && code < 0xDC00 && consume("\\u")) {
+                    std::uint32_t low = hex4();
+                    if (low < 0xDC00 || low >= 0xE000) {
+                        fail("неверная суррогатная пара");
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(result, code);
+                break;
+            }
+            default:
+                fail("неверная управляющая последовательность");
+            }
+        }
+    }
+
+    std::uint32_t hex4() {
+        if (pos_ + 4 > text_.size()) {
+            fail("неверная последовательность \\u");
+        }
+        std::uint32_t code = 0;
+        std::from_chars_result parsed = std::from_chars(text_.data() + pos_, text_.data() + pos_ + 4, code, 16);
+        if (parsed.ptr != text_.data() + pos_ + 4) {
+            fail("неверная последовательность \\u");
+        }
+        pos_ += 4;
+        return code;
+    }
+
+    static void appendUtf8(std::string& text, std::uint32_t code) {
+        if (code < 0x80) {
+            text.push_back(static_cast<char>(code));
+        }
+        else if (code < 0x800) {
+            text.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            text.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        else if (code < 0x10000) {
+            text.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            text.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            text.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        else {
+            text.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            text.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            text.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            text.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    const std::string& text_;
+    std::size_t pos_ = 0;
+};
+
+// Запись строки JSON в кавычках с экранированием
+void appendJsonString(std::string& text, const std::string& value) {
+    text.push_back('"');
+    for (char c : value) {
+        switch (c) {
+        case '"': text.append("\\\""); break;
+        case '\\': text.append("\\\\"); break;
+        case '\n': text.append("\\n"); break;
+        case '\r': text.append("\\r"); break;
+        case '\t': text.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+                text.append(buffer);
+            }
+            else {
+                text.push_back(c);
+            }
+        }
+    }
+    text.push_back('"');
+}
+
+// Запись числа JSON; бесконечность и NaN в JSON непредставимы и записываются как null
+void appendJsonNumber(std::string& text, double value) {
+    if (std::isfinite(value)) {
+        appendNumber(text, value);
+    }
+    else {
+        text.append("null");
+    }
+}
+
+// Запись матрицы JSON: {"rows": m, "cols": n, "data": [[...], ...]}
+void appendJsonMatrix(std::string& text, ConstMatrixView matrix) {
+    text.append("{\"rows\":");
+    appendNumber(text, matrix.rows());
+    text.append(",\"cols\":");
+    appendNumber(text, matrix.cols());
+    text.append(",\"data\":[");
+    for (int i = 0; i < matrix.rows(); i++) {
+        text.append(i > 0 ? ",[" : "[");
+        for (int j = 0; j < matrix.cols(); j++) {
+            if (j > 0) {
+                text.push_back(',');
+            }
+            appendJsonNumber(text, matrix(i, j));
+        }
+        text.push_back(']');
+    }
+    text.append("]}");
+}
+
+// Хеш в виде 16 шестнадцатеричных цифр
+std::string hashText(std::uint64_t hash) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+}
+
+// Матрица хранилища сервера вместе с хешем содержимого
+struct StoredMatrix {
+    BatchMatrix matrix;
+    std::uint64_t hash = 0;
+    std::uint64_t id = 0; // Номер экземпляра в хранилище, не повторяется; ключ кэша результатов
+};
+
+// Функция проверки двоичного совпадения содержимого двух матриц (для исключения коллизий хеша)
+bool sameContent(ConstMatrixView a, ConstMatrixView b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+        return false;
+    }
+    for (int i = 0; i < a.rows(); i++) {
+        for (int j = 0; j < a.cols(); j++) {
+            double x = a(i, j);
+            double y = b(i, j);
+            if (std::memcmp(&x, &y, sizeof(double)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Именованное хранилище матриц сервера. Имя ссылается на матрицу, одинаковые по содержимому
+// матрицы под разными именами хранятся в одном экземпляре
+class MatrixStore {
+public:
+    // Сохранение матрицы под именем name (прежняя матрица с этим именем заменяется)
+    std::shared_ptr<const StoredMatrix> put(const std::string& name, BatchMatrix matrix) {
+        std::uint64_t hash = contentHash(matrix.view());
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<const StoredMatrix> stored = intern(hash, std::move(matrix));
+        names_[name] = stored;
+        return stored;
+    }
+
+    // Замена матрицы под именем name, только если имя всё ещё ссылается на экземпляр expectedId
+    // (сравнение с обменом); nullptr, если за это время имя перезагружено или удалено
+    std::shared_ptr<const StoredMatrix> replace(const std::string& name, std::uint64_t expectedId, BatchMatrix matrix) {
+        std::uint64_t hash = contentHash(matrix.view());
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = names_.find(name);
+        if (found == names_.end() || found->second->id != expectedId) {
+            return nullptr;
+        }
+        found->second = intern(hash, std::move(matrix));
+        return found->second;
+    }
+
+    std::shared_ptr<const StoredMatrix> get(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = names_.find(name);
+        if (found == names_.end()) {
+            throw std::invalid_argument("Нет матрицы с именем " + name);
+        }
+        return found->second;
+    }
+
+    // Удаление имени; матрица освобождается, когда на неё не ссылаются другие имена и запросы
+    bool drop(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (names_.erase(name) == 0) {
+            return false;
+        }
+        for (auto it = contents_.begin(); it != contents_.end();) {
+            it = it->second.expired() ? contents_.erase(it) : std::next(it);
+        }
+        return true;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return names_.size();
+    }
+
+private:
+    // Экземпляр с содержимым matrix: существующий, если такая матрица уже хранится, иначе новый (под mutex_)
+    std::shared_ptr<const StoredMatrix> intern(std::uint64_t hash, BatchMatrix matrix) {
+        auto found = contents_.find(hash);
+        if (found != contents_.end()) {
+            std::shared_ptr<const StoredMatrix> stored = found->second.lock();
+            if (stored && sameContent(stored->matrix.view(), matrix.view())) {
+                return stored;
+            }
+        }
+        auto created = std::make_shared<StoredMatrix>();
+        created->matrix = std::move(matrix);
+        created->hash = hash;
+        created->id = nextId_++;
+        contents_[hash] = created;
+        return created;
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const StoredMatrix>> names_;
+    std::unordered_map<std::uint64_t, std::weak_ptr<const StoredMatrix>> contents_;
+    std::uint64_t nextId_ = 1;
+};
+
+// Ключ кэша производных результатов: операция (или LU-разложение) и номера экземпляров операндов в хранилище.
+// Не хеши: хеш можно подобрать так, чтобы он совпал у разных матриц, а экземпляр хранилища однозначно
+// задаёт содержимое (одинаковые матрицы хранятся в одном экземпляре, совпадение проверяется sameContent)
+struct ResultKey {
+    std::uint64_t first = 0;
+    std::uint64_t second = 0;
+    BatchOperation operation = BatchOperation::Rank;
+    bool factorization = false; // LU-разложение первого операнда, общее для определителя и обратной
+
+    bool operator==(const ResultKey& other) const {
+        return first == other.first && second == other.second && operation == other.operation && factorization == other.factorization;
+    }
+};
+
+struct ResultKeyHash {
+    std::size_t operator()(const ResultKey& key) const {
+        std::uint64_t hash = key.first * 0x9E3779B97F4A7C15ull ^ key.second;
+        hash = (hash ^ (static_cast<std::uint64_t>(key.operation) << 1 | (key.factorization ? 1 : 0))) * 0xBF58476D1CE4E5B9ull;
+        return static_cast<std::size_t>(hash ^ (hash >> 31));
+    }
+};
+
+// Производный результат: число (ранг, определитель, след, равенство), матрица или LU-разложение
+struct CachedResult {
+    double scalar = 0.0;
+    bool singular = false;
+    Matrix matrix;
+    LUDecomposition factors;
+
+    std::size_t bytes() const {
+        return sizeof(CachedResult) + (matrix.size() + factors.lu.size()) * sizeof(double) + factors.permutation.size() * sizeof(int);
+    }
+};
+
+// Кэш производных результатов с вытеснением давно не использованных (LRU) при превышении бюджета памяти.
+// Результаты отдаются через shared_ptr, поэтому вытеснение не мешает запросам, которые их ещё выводят
+class ResultCache {
+public:
+    explicit ResultCache(std::size_t budget) : budget_(budget) {}
+
+    std::shared_ptr<const CachedResult> find(const ResultKey& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(key);
+        if (found == index_.end()) {
+            misses_++;
+            return nullptr;
+        }
+        hits_++;
+        order_.splice(order_.begin(), order_, found->second);
+        return found->second->second;
+    }
+
+    // Добавление результата; результат больше всего бюджета не кэшируется
+    void insert(const ResultKey& key, std::shared_ptr<const CachedResult> result) {
+        std::size_t size = result->bytes();
+        if (size > budget_) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(key) != 0) {
+            return; // Результат уже посчитан параллельным запросом
+        }
+        while (bytes_ + size > budget_ && !order_.empty()) {
+            bytes_ -= order_.back().second->bytes();
+            index_.erase(order_.back().first);
+            order_.pop_back();
+        }
+        order_.emplace_front(key, std::move(result));
+        index_[key] = order_.begin();
+        bytes_ += size;
+    }
+
+    // Сводка: число записей, занятая память, попадания и промахи
+    void appendStats(std::string& text) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        text.append("\"cache_entries\":");
+        appendNumber(text, index_.size());
+        text.append(",\"cache_bytes\":");
+        appendNumber(text, bytes_);
+        text.append(",\"cache_budget\":");
+        appendNumber(text, budget_);
+        text.append(",\"hits\":");
+        appendNumber(text, hits_);
+        text.append(",\"misses\":");
+        appendNumber(text, misses_);
+    }
+
+private:
+    using Entry = std::pair<ResultKey, std::shared_ptr<const CachedResult>>;
+
+    mutable std::mutex mutex_;
+    std::size_t budget_;
+    std::size_t bytes_ = 0;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+    std::list<Entry> order_; // В начале - недавно использованные
+    std::unordered_map<ResultKey, std::list<Entry>::iterator, ResultKeyHash> index_;
+};
+
+// Параметры режима сервера
+struct ServerOptions {
+    std::string socketPath; // Пусто - запросы со стандартного ввода, ответы в стандартный вывод
+    std::size_t cacheBytes = std::size_t(256) << 20;
+    int clients = 4; // Число потоков обслуживания клиентов сокета
+    int threads = 0;
+};
+
+// Обработчик запросов сервера. Запрос - объект JSON с полем "op":
+//   load   - загрузка матрицы "name" из "data" (массив строк) или файла "path" (текст или двоичный формат)
+//   drop   - удаление имени "name";  stats - состояние хранилища и кэша;  shutdown - остановка сервера
+//   rank, transpose, det, trace, inverse - над матрицей "a";  equal, add, multiply - над "a" и "b".
+//   Матричный результат возвращается в ответе или, если задано поле "store", сохраняется под этим именем.
+// Ответ - одна строка JSON: {"id": ..., "ok": true, ...} или {"id": ..., "ok": false, "error": "..."}.
+class MatrixServer {
+public:
+    explicit MatrixServer(const ServerOptions& options) : cache_(options.cacheBytes) {}
+
+    bool stopping() const { return stopping_.load(std::memory_order_relaxed); }
+
+    // Обработка одной строки запроса; ответ записывается в response без перевода строки
+    void handle(const std::string& line, std::string& response) {
+        ProfileScope profile("server request");
+        auto start = std::chrono::steady_clock::now();
+        response.clear();
+        response.push_back('{');
+        std::size_t bodyStart = 0;
+        try {
+            JsonValue request = JsonParser(line).parse();
+            if (request.kind != JsonValue::Kind::Object) {
+                throw std::invalid_argument("Запрос должен быть объектом JSON");
+            }
+            if (const JsonValue* id = request.find("id")) {
+                response.append("\"id\":");
+                appendScalar(response, *id);
+                response.push_back(',');
+            }
+            bodyStart = response.size();
+            response.append("\"ok\":true");
+            execute(request, response);
+        }
+        catch (const std::exception& e) {
+            response.resize(bodyStart == 0 ? 1 : bodyStart);
+            response.append("\"ok\":false,\"error\":");
+            appendJsonString(response, e.what());
+        }
+        response.append(",\"time_us\":");
+        appendNumber(response, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        response.push_back('}');
+    }
+
+private:
+    // Идентификатор запроса возвращается как есть (число, строка, логическое значение или null)
+    static void appendScalar(std::string& text, const JsonValue& value) {
+        switch (value.kind) {
+        case JsonValue::Kind::Number: appendJsonNumber(text, value.number); break;
+        case JsonValue::Kind::String: appendJsonString(text, value.text); break;
+        case JsonValue::Kind::Boolean: text.append(value.boolean ? "true" : "false"); break;
+        default: text.append("null"); break;
+        }
+    }
+
+    static std::string stringField(const JsonValue& request, const char* key) {
+        const JsonValue* value = request.find(key);
+        if (value == nullptr || value->kind != JsonValue::Kind::String || value->text.empty()) {
+            throw std::invalid_argument(std::string("Не задано строковое поле \"") + key + "\"");
+        }
+        return value->text;
+    }
+
+    void execute(const JsonValue& request, std::string& response) {
+        std::string op = stringField(request, "op");
+        if (op == "load") {
+            std::string name = stringField(request, "name");
+            dropFactorization(name);
+            std::shared_ptr<const StoredMatrix> stored = store_.put(name, loadMatrix(request));
+            appendMatrixInfo(response, name, *stored);
+            return;
+        }
+        if (op == "drop") {
+            std::string name = stringField(request, "name");
+            dropFactorization(name);
+            response.append(store_.drop(name) ? ",\"dropped\":true" : ",\"dropped\":false");
+            return;
+        }
+        if (op == "set" || op == "set_row" || op == "set_column" || op == "update") {
+            executeUpdate(op, request, response);
+            return;
+        }
+        if (op == "stats") {
+            response.append(",\"matrices\":");
+            appendNumber(response, store_.size());
+            response.push_back(',');
+            cache_.appendStats(response);
+            return;
+        }
+        if (op == "shutdown") {
+            stopping_.store(true, std::memory_order_relaxed);
+            return;
+        }
+
+        BatchOperation operation = parseOperation(op);
+        std::string firstName = stringField(request, "a");
+        std::shared_ptr<const StoredMatrix> first = store_.get(firstName);
+        std::shared_ptr<const StoredMatrix> second = isBinaryOperation(operation) ? store_.get(stringField(request, "b")) : nullptr;
+        if (operation == BatchOperation::Equal && respondEqual(request, *first, *second, response)) {
+            return;
+        }
+
+        // Имя, изменённое запросами set/set_row/set_column/update, отвечает из своего обновляемого разложения
+        std::shared_ptr<const CachedResult> result = second ? nullptr : factorizedResult(operation, firstName, *first);
+        bool incremental = result != nullptr;
+        bool cached = false;
+        if (!incremental) {
+            ResultKey key;
+            key.first = first->id;
+            key.second = second ? second->id : 0;
+            key.operation = operation;
+            result = cache_.find(key);
+            cached = result != nullptr;
+            if (!cached) {
+                WorkspaceScope scope(threadWorkspace());
+                result = compute(operation, *first, second.get());
+                cache_.insert(key, result);
+            }
+        }
+
+        response.append(",\"cached\":");
+        response.append(cached ? "true" : "false");
+        if (incremental) {
+            response.append(",\"incremental\":true");
+        }
+        switch (operation) {
+        case BatchOperation::Transpose:
+        case BatchOperation::Inverse:
+        case BatchOperation::Add:
+        case BatchOperation::Multiply:
+            if (result->singular) {
+                response.append(",\"singular\":true,\"result\":null");
+            }
+            else if (const JsonValue* target = request.find("store")) {
+                if (target->kind != JsonValue::Kind::String || target->text.empty()) {
+                    throw std::invalid_argument("Поле \"store\" должно быть непустой строкой");
+                }
+                BatchMatrix copy;
+                copy.storage = result->matrix;
+                std::shared_ptr<const StoredMatrix> stored = store_.put(target->text, std::move(copy));
+                appendMatrixInfo(response, target->text, *stored);
+            }
+            else {
+                response.append(",\"result\":");
+                appendJsonMatrix(response, result->matrix);
+            }
+            break;
+        case BatchOperation::Equal:
+            response.append(result->scalar != 0.0 ? ",\"result\":true" : ",\"result\":false");
+            break;
+        default:
+            response.append(",\"result\":");
+            appendJsonNumber(response, result->scalar);
+            break;
+        }
+    }
+
+    // Сравнение с допуском из полей "tolerance" (exact, abs:x, rel:x, ulp:n) и "nan_equal". Точное сравнение
+    // матриц с разными отпечатками отвечается сразу по хешам; сравнение с допуском выполняется без кэша.
+    // false - ответ не дан, точное сравнение идёт обычным путём через кэш результатов.
+    static bool respondEqual(const JsonValue& request, const StoredMatrix& first, const StoredMatrix& second, std::string& response) {
+        EqualityTolerance tolerance;
+        if (const JsonValue* text = request.find("tolerance")) {
+            if (text->kind != JsonValue::Kind::String) {
+                throw std::invalid_argument("Поле \"tolerance\" должно быть строкой");
+            }
+            tolerance = parseEqualityTolerance(text->text);
+        }
+        if (const JsonValue* nanEqual = request.find("nan_equal")) {
+            if (nanEqual->kind != JsonValue::Kind::Boolean) {
+                throw std::invalid_argument("Поле \"nan_equal\" должно быть логическим");
+            }
+            tolerance.nanEqual = nanEqual->boolean;
+        }
+
+        if (tolerance.mode == EqualityMode::Exact && first.hash != second.hash) {
+            response.append(",\"cached\":false,\"fingerprint\":true,\"result\":false");
+            return true;
+        }
+        if (tolerance.isDefault()) {
+            return false;
+        }
+        bool equal = areMatricesEqual(first.matrix.view(), second.matrix.view(), tolerance);
+        response.append(equal ? ",\"cached\":false,\"result\":true" : ",\"cached\":false,\"result\":false");
+        return true;
+    }
+
+    static void appendMatrixInfo(std::string& response, const std::string& name, const StoredMatrix& stored) {
+        response.append(",\"name\":");
+        appendJsonString(response, name);
+        response.append(",\"hash\":\"");
+        response.append(hashText(stored.hash));
+        response.append("\",\"rows\":");
+        appendNumber(response, stored.matrix.view().rows());
+        response.append(",\"cols\":");
+        appendNumber(response, stored.matrix.view().cols());
+    }
+
+    // Матрица из непустого массива JSON, элементы которого - массивы чисел одной длины
+    static Matrix jsonRows(const JsonValue& data) {
+        int rows = static_cast<int>(data.items.size());
+        if (rows == 0) {
+            throw std::invalid_argument("Матрица должна быть непустым массивом строк");
+        }
+        int cols = static_cast<int>(data.items[0].numbers.size());
+        Matrix matrix(rows, cols);
+        for (int i = 0; i < rows; i++) {
+            const JsonValue& row = data.items[i];
+            if (row.kind != JsonValue::Kind::Array || !row.items.empty() || static_cast<int>(row.numbers.size()) != cols) {
+                throw std::invalid_argument("Строки матрицы должны быть массивами чисел одной длины");
+            }
+            std::copy(row.numbers.begin(), row.numbers.end(), matrix.rowData(i));
+        }
+        return matrix;
+    }
+
+    // Матрица запроса load: из поля "data" (массив строк или плоский массив с "rows" и "cols") или из файла "path"
+    static BatchMatrix loadMatrix(const JsonValue& request) {
+        BatchMatrix matrix;
+        if (const JsonValue* path = request.find("path")) {
+            if (path->kind != JsonValue::Kind::String) {
+                throw std::invalid_argument("Поле \"path\" должно быть строкой");
+            }
+            MatrixTextFormat format = MatrixTextFormat::Whitespace;
+            if (const JsonValue* name = request.find("format")) {
+                format = name->text == "csv" ? MatrixTextFormat::Csv : MatrixTextFormat::Whitespace;
+            }
+            MatrixStreamReader reader({ path->text }, format);
+            if (!reader.read(matrix)) {
+                throw std::invalid_argument("В файле " + path->text + " нет матрицы");
+            }
+            return matrix;
+        }
+
+        const JsonValue* data = request.find("data");
+        if (data == nullptr || !data->isArray()) {
+            throw std::invalid_argument("Не задано поле \"data\" или \"path\"");
+        }
+        if (!data->items.empty()) {
+            matrix.storage = jsonRows(*data);
+            return matrix;
+        }
+
+        // Размеры - целые числа до INT_MAX, поэтому их произведение точно помещается в 64 бита
+        int rows = indexField(request, "rows");
+        int cols = indexField(request, "cols");
+        if (static_cast<std::uint64_t>(rows) * static_cast<std::uint64_t>(cols) != data->numbers.size()) {
+            throw std::invalid_argument("Для плоского массива \"data\" нужны \"rows\" и \"cols\", согласованные с числом элементов");
+        }
+        matrix.storage = Matrix(rows, cols);
+        std::copy(data->numbers.begin(), data->numbers.end(), matrix.storage.data());
+        return matrix;
+    }
+
+    // LU-разложение матрицы из кэша или новое (результаты те же, что у determinant и inverseInto)
+    std::shared_ptr<const CachedResult> factorization(const StoredMatrix& stored) {
+        ResultKey key;
+        key.first = stored.id;
+        key.factorization = true;
+        std::shared_ptr<const CachedResult> result = cache_.find(key);
+        if (result) {
+            return result;
+        }
+        auto created = std::make_shared<CachedResult>();
+        created->factors = decomposeLU(stored.matrix.view());
+        cache_.insert(key, created);
+        return created;
+    }
+
+    // Вычисление результата операции с той же семантикой, что у пакетного режима
+    std::shared_ptr<const CachedResult> compute(BatchOperation operation, const StoredMatrix& first, const StoredMatrix* second) {
+        auto result = std::make_shared<CachedResult>();
+        ConstMatrixView a = first.matrix.view();
+        ConstMatrixView b = second != nullptr ? second->matrix.view() : ConstMatrixView();
+        bool square = isSquareMatrix(a);
+        int n = a.rows();
+        switch (operation) {
+        case BatchOperation::Rank:
+            result->scalar = findRank(a);
+            break;
+        case BatchOperation::Transpose:
+            result->matrix = transposeMatrix(a);
+            break;
+        case BatchOperation::Determinant:
+            if (!square) {
+                throw std::invalid_argument("матрица не квадратная");
+            }
+            if (n == 1) {
+                result->scalar = a(0, 0);
+            }
+            else if (determinantUsesLU(a)) {
+                result->scalar = factorization(first)->factors.determinant(); // Общее с обратной матрицей разложение
+            }
+            else {
+                result->scalar = determinant(a);
+            }
+            break;
+        case BatchOperation::Trace:
+            if (!square) {
+                throw std::invalid_argument("матрица не квадратная");
+            }
+            result->scalar = trace(a);
+            break;
+        case BatchOperation::Inverse:
+            if (!square) {
+                throw std::invalid_argument("матрица не квадратная");
+            }
+            if (inverseUsesLU(a)) {
+                std::shared_ptr<const CachedResult> lu = factorization(first);
+                result->singular = lu->factors.singular;
+                if (!result->singular) {
+                    result->matrix = lu->factors.inverse();
+                }
+            }
+            else {
+                result->matrix = Matrix(n, n);
+                result->singular = !inverseInto(a, result->matrix, threadWorkspace());
+            }
+            break;
+        case BatchOperation::Equal:
+            result->scalar = areMatricesEqual(a, b) ? 1.0 : 0.0;
+            break;
+        case BatchOperation::Add:
+            if (a.rows() != b.rows() || a.cols() != b.cols()) {
+                throw std::invalid_argument("размеры матриц не совпадают");
+            }
+            result->matrix = Matrix(a.rows(), a.cols());
+            addInto(a, b, result->matrix);
+            break;
+        case BatchOperation::Multiply:
+            if (a.cols() != b.rows()) {
+                throw std::invalid_argument("число столбцов A не равно числу строк B");
+            }
+            result->matrix = Matrix(a.rows(), b.cols());
+            multiplyInto(a, b, result->matrix);
+            break;
+        }
+        return result;
+    }
+
+    // Обновляемое разложение именованной матрицы; id - экземпляр хранилища, для которого оно верно.
+    // Его результаты зависят от истории обновлений и отличаются от полного пересчёта в последних разрядах,
+    // поэтому отдаются только запросам к этому имени и не попадают в общий кэш по содержимому
+    struct FactorizedEntry {
+        std::mutex mutex;
+        std::unique_ptr<FactorizedMatrix> matrix;
+        std::uint64_t id = 0;
+    };
+
+    std::shared_ptr<FactorizedEntry> factorizationEntry(const std::string& name) {
+        std::lock_guard<std::mutex> lock(factorizedMutex_);
+        std::shared_ptr<FactorizedEntry>& entry = factorized_[name];
+        if (!entry) {
+            entry = std::make_shared<FactorizedEntry>();
+        }
+        return entry;
+    }
+
+    void dropFactorization(const std::string& name) {
+        std::lock_guard<std::mutex> lock(factorizedMutex_);
+        factorized_.erase(name);
+    }
+
+    // Определитель, обратная или ранг матрицы name из её обновляемого разложения; nullptr, если имя
+    // не изменялось или с тех пор ссылается на другой экземпляр хранилища
+    std::shared_ptr<const CachedResult> factorizedResult(BatchOperation operation, const std::string& name, const StoredMatrix& stored) {
+        if (operation != BatchOperation::Determinant && operation != BatchOperation::Inverse && operation != BatchOperation::Rank) {
+            return nullptr;
+        }
+        std::shared_ptr<FactorizedEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(factorizedMutex_);
+            auto found = factorized_.find(name);
+            if (found == factorized_.end()) {
+                return nullptr;
+            }
+            entry = found->second;
+        }
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->matrix || entry->id != stored.id) {
+            return nullptr;
+        }
+
+        FactorizedMatrix& matrix = *entry->matrix;
+        auto result = std::make_shared<CachedResult>();
+        if (operation == BatchOperation::Determinant) {
+            result->scalar = matrix.determinant();
+        }
+        else if (operation == BatchOperation::Rank) {
+            result->scalar = matrix.rank();
+        }
+        else {
+            result->singular = matrix.isSingular();
+            if (!result->singular) {
+                result->matrix = matrix.inverse();
+            }
+        }
+        return result;
+    }
+
+    static int indexField(const JsonValue& request, const char* key) {
+        const JsonValue* value = request.find(key);
+        if (value == nullptr || value->kind != JsonValue::Kind::Number || value->number < 0.0
+            || value->number != std::floor(value->number) || value->number > std::numeric_limits<int>::max()) {
+            throw std::invalid_argument(std::string("Поле \"") + key + "\" должно быть неотрицательным целым числом");
+        }
+        return static_cast<int>(value->number);
+    }
+
+    static const JsonValue& arrayField(const JsonValue& request, const char* key) {
+        const JsonValue* value = request.find(key);
+        if (value == nullptr || value->kind != JsonValue::Kind::Array) {
+            throw std::invalid_argument(std::string("Поле \"") + key + "\" должно быть массивом");
+        }
+        return *value;
+    }
+
+    // Изменение именованной квадратной матрицы (set, set_row, set_column, update). Разложение имени
+    // переиспользуется, пока имя ссылается на тот же экземпляр хранилища; новая матрица сохраняется под тем же
+    // именем, а запросы det, inverse и rank к нему отвечаются из разложения (см. factorizedResult)
+    void executeUpdate(const std::string& op, const JsonValue& request, std::string& response) {
+        std::string name = stringField(request, "name");
+        std::shared_ptr<const StoredMatrix> stored = store_.get(name); // Неизвестное имя - ошибка до создания записи
+        std::shared_ptr<FactorizedEntry> entry = factorizationEntry(name);
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        stored = store_.get(name);
+        if (!entry->matrix || entry->id != stored->id) {
+            entry->matrix.reset(new FactorizedMatrix(stored->matrix.view()));
+        }
+        FactorizedMatrix& matrix = *entry->matrix;
+
+        if (op == "set") {
+            const JsonValue* value = request.find("value");
+            if (value == nullptr || value->kind != JsonValue::Kind::Number) {
+                throw std::invalid_argument("Поле \"value\" должно быть числом");
+            }
+            matrix.setElement(indexField(request, "row"), indexField(request, "col"), value->number);
+        }
+        else if (op == "set_row") {
+            matrix.replaceRow(indexField(request, "row"), arrayField(request, "values").numbers);
+        }
+        else if (op == "set_column") {
+            matrix.replaceColumn(indexField(request, "col"), arrayField(request, "values").numbers);
+        }
+        else {
+            Matrix u = jsonRows(arrayField(request, "u"));
+            Matrix v = jsonRows(arrayField(request, "v"));
+            matrix.update(u, v);
+        }
+
+        // Имя заменяется, только если его не перезагрузили и не удалили параллельным запросом: load и drop
+        // не берут мьютекс записи, поэтому безусловная запись вернула бы старую матрицу с обновлением
+        BatchMatrix copy;
+        copy.storage = Matrix(matrix.matrix());
+        std::shared_ptr<const StoredMatrix> updated = store_.replace(name, stored->id, std::move(copy));
+        if (!updated) {
+            entry->matrix.reset(); // Разложение уже изменено и больше не соответствует ни одному экземпляру
+            throw std::runtime_error("Матрица " + name + " изменена или удалена другим запросом");
+        }
+        entry->id = updated->id;
+
+        appendMatrixInfo(response, name, *updated);
+        response.append(",\"determinant\":");
+        appendJsonNumber(response, matrix.determinant());
+        response.append(matrix.isSingular() ? ",\"singular\":true" : ",\"singular\":false");
+        response.append(matrix.lastUpdateRefactorized() ? ",\"refactorized\":true" : ",\"refactorized\":false");
+    }
+
+    MatrixStore store_;
+    ResultCache cache_;
+    std::mutex factorizedMutex_;
+    std::unordered_map<std::string, std::shared_ptr<FactorizedEntry>> factorized_;
+    std::atomic<bool> stopping_{ false };
+};
+
+// Сервер на стандартном вводе: запросы обрабатываются по очереди, ответ на каждый сразу выводится
+int serveStandardInput(MatrixServer& server) {
+    std::string line;
+    std::string response;
+    while (!server.stopping() && std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        server.handle(line, response);
+        std::cout << response << '\n';
+        std::cout.flush();
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+// Запись всего буфера в сокет; false, если клиент отключился
+bool writeAll(int fd, const std::string& text) {
+    std::size_t written = 0;
+    while (written < text.size()) {
+#ifdef MSG_NOSIGNAL
+        ssize_t count = ::send(fd, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+#else
+        ssize_t count = ::write(fd, text.data() + written, text.size() - written);
+#endif
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        written += static_cast<std::size_t>(count);
+    }
+    return true;
+}
+
+// Обслуживание одного клиента сокета: запросы - строки JSON, ответы идут в порядке запросов
+void serveConnection(MatrixServer& server, int fd) {
+    std::string pending;
+    std::string response;
+    char buffer[1 << 16];
+    while (!server.stopping()) {
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        pending.append(buffer, static_cast<std::size_t>(count));
+        std::size_t start = 0;
+        std::size_t newline;
+        while ((newline = pending.find('\n', start)) != std::string::npos) {
+            std::string line = pending.substr(start, newline - start);
+            start = newline + 1;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            server.handle(line, response);
+            response.push_back('\n');
+            if (!writeAll(fd, response)) {
+                return;
+            }
+        }
+        pending.erase(0, start);
+    }
+}
+
+// Сервер на сокете Unix: поток приёма соединений передаёт клиентов отдельному пулу потоков
+// (вычисления внутри запросов по-прежнему идут на общем пуле). Запрос shutdown останавливает приём
+// и закрывает соединения оставшихся клиентов.
+int serveSocket(MatrixServer& server, const ServerOptions& options) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (options.socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Ошибка: слишком длинный путь сокета " << options.socketPath << '\n';
+        return 1;
+    }
+    std::memcpy(address.sun_path, options.socketPath.c_str(), options.socketPath.size() + 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Ошибка: не удалось создать сокет\n";
+        return 1;
+    }
+    ::unlink(options.socketPath.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 64) != 0) {
+        std::cerr << "Ошибка: не удалось открыть сокет " << options.socketPath << '\n';
+        ::close(listener);
+        return 1;
+    }
+    std::cerr << "Сервер ожидает запросы на " << options.socketPath << '\n';
+
+    std::mutex connectionsMutex;
+    std::vector<int> connections;
+    {
+        // Поток приёма сам задачи не выполняет, поэтому пулу нужен ещё один поток сверх числа клиентов
+        ThreadPool clients((std::max)(options.clients, 1) + 1);
+        while (!server.stopping()) {
+            pollfd poller = { listener, POLLIN, 0 };
+            if (::poll(&poller, 1, 200) <= 0) {
+                continue; // Периодическая проверка запроса остановки
+            }
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                connections.push_back(fd);
+            }
+            clients.submit([&server, &connectionsMutex, &connections, fd] {
+                serveConnection(server, fd);
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                connections.erase(std::find(connections.begin(), connections.end(), fd));
+                ::close(fd);
+            });
+        }
+
+        // Незавершённые чтения оставшихся клиентов прерываются, после чего пул дожидается их задач
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (int fd : connections) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+    ::close(listener);
+    ::unlink(options.socketPath.c_str());
+    return 0;
+}
+#endif
+
+void printServerUsage(std::ostream& out) {
+    out << "Использование: P2V1 --serve [--socket путь] [--cache-mb N] [--clients N] [--threads N]\n"
+        << "  --socket    сокет Unix для запросов (без него - запросы со стандартного ввода)\n"
+        << "  --cache-mb  бюджет памяти кэша производных результатов в МБ (по умолчанию 256)\n"
+        << "  --clients   число потоков обслуживания клиентов сокета (по умолчанию 4)\n"
+        << "  --threads   число потоков вычислений (по умолчанию по числу аппаратных потоков)\n"
+        << "Запрос - объект JSON в одной строке, например:\n"
+        << "  {\"id\": 1, \"op\": \"load\", \"name\": \"A\", \"data\": [[1, 2], [3, 4]]}\n"
+        << "  {\"id\": 2, \"op\": \"det\", \"a\": \"A\"}\n"
+        << "  {\"id\": 3, \"op\": \"multiply\", \"a\": \"A\", \"b\": \"A\", \"store\": \"C\"}\n"
+        << "  {\"id\": 4, \"op\": \"equal\", \"a\": \"A\", \"b\": \"C\", \"tolerance\": \"rel:1e-12\", \"nan_equal\": true}\n"
+        << "  {\"id\": 5, \"op\": \"set\", \"name\": \"A\", \"row\": 0, \"col\": 1, \"value\": 5}\n"
+        << "Операции: load, drop, stats, shutdown, rank, transpose, det, trace, inverse, equal, add, multiply,\n"
+        << "  set (row, col, value), set_row (row, values), set_column (col, values), update (u, v: A += U * V^T)\n"
+        << "Изменения квадратной матрицы обновляют её обратную и определитель за O(n^2); запросы det, inverse и rank\n"
+        << "  к изменённому имени отвечаются из обновлённого разложения (в ответе \"incremental\": true)\n";
+}
+
+// Функция разбора аргументов режима сервера
+ServerOptions parseServerOptions(int argc, char* argv[]) {
+    ServerOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Не указано значение параметра " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--serve") {
+            continue;
+        }
+        else if (arg == "--socket") {
+            options.socketPath = value();
+        }
+        else if (arg == "--cache-mb") {
+            options.cacheBytes = static_cast<std::size_t>(std::stoull(value())) << 20;
+        }
+        else if (arg == "--clients") {
+            options.clients = std::stoi(value());
+        }
+        else if (arg == "--threads") {
+            options.threads = std::stoi(value());
+        }
+        else {
+            throw std::invalid_argument("Неизвестный параметр " + arg);
+        }
+    }
+    return options;
+}
+
+// Режим сервера
+int runServer(int argc, char* argv[]) {
+    ServerOptions options;
+    try {
+        options = parseServerOptions(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        printServerUsage(std::cerr);
+        return 1;
+    }
+
+    if (options.threads > 0) {
+        setThreadCount(options.threads);
+    }
+
+    MatrixServer server(options);
+    if (options.socketPath.empty()) {
+        return serveStandardInput(server);
+    }
+#ifdef _WIN32
+    std::cerr << "Ошибка: сокеты Unix на этой платформе не поддерживаются, используйте стандартный ввод\n";
+    return 1;
+#else
+    return serveSocket(server, options);
+#endif
+}
+
+// Режим вычислений вне памяти: умножение и транспонирование матриц из двоичных файлов,
+// не помещающихся в оперативную память, по квадратным плиткам с жёстким пределом памяти
+
+// Параметры режима вне памяти
+struct OutOfCoreOptions {
+    std::string operation;
+    std::vector<std::string> paths;
+    std::size_t memoryLimit = static_cast<std::size_t>(512) << 20;
+    int tileSize = 0; // 0 - подбирается по пределу памяти
+    int threads = 0;
+};
+
+// Функция разбора размера в байтах с необязательным суффиксом K, M или G (степени 1024)
+std::size_t parseByteSize(const std::string& text) {
+    std::size_t end = 0;
+    unsigned long long value = std::stoull(text, &end);
+    std::string suffix = text.substr(end);
+    if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    }
+    else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    }
+    else if (suffix == "G" || suffix == "g") {
+        value <<= 30;
+    }
+    else if (!suffix.empty()) {
+        throw std::invalid_argument("Неизвестный суффикс размера " + suffix + " (K, M или G)");
+    }
+    return static_cast<std::size_t>(value);
+}
+
+// Кэш плиток с фиксированным числом заранее выделенных слотов: память не растёт после создания,
+// поэтому предел соблюдается жёстко. Чтение входных плиток (в том числе упреждающее) и запись
+// готовых плиток результата выполняет отдельный поток ввода-вывода, пока потоки пула считают.
+class TileCache {
+public:
+    TileCache(int slots, int tileSize) : tileSize_(tileSize) {
+        slots_.resize(slots);
+        for (Slot& slot : slots_) {
+            slot.data = allocateAligned(static_cast<std::size_t>(tileSize) * tileSize);
+        }
+        worker_ = std::thread([this] { serve(); });
+    }
+
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    ~TileCache() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        worker_.join();
+        for (Slot& slot : slots_) {
+            freeAligned(slot.data);
+        }
+    }
+
+    // Регистрация входного файла; возвращает номер источника для acquire/prefetch
+    int addSource(MatrixFileStream& stream) {
+        sources_.push_back(&stream);
+        return static_cast<int>(sources_.size()) - 1;
+    }
+
+    // Плитка (tileRow, tileCol) источника source, закреплённая до release; при промахе поток ждёт чтения
+    ConstMatrixView acquire(int source, int tileRow, int tileCol) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            rethrowError();
+            int index = find(source, tileRow, tileCol);
+            if (index >= 0 && slots_[index].state == SlotState::Ready) {
+                Slot& slot = slots_[index];
+                slot.pins++;
+                slot.lastUse = ++clock_;
+                hits_++;
+                return ConstMatrixView(slot.data, slot.rows, slot.cols, slot.cols);
+            }
+            if (index < 0) {
+                int victim = evictable();
+                if (victim >= 0) {
+                    startLoad(victim, source, tileRow, tileCol, true);
+                    misses_++;
+                }
+            }
+            // Ожидание чтения своей плитки или освобождения слота; время ожидания учитывается в статистике
+            auto start = std::chrono::steady_clock::now();
+            changed_.wait(lock);
+            waitSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    // Снятие закрепления плитки, полученной из acquire
+    void release(ConstMatrixView tile) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (Slot& slot : slots_) {
+            if (slot.data == tile.data()) {
+                slot.pins--;
+                break;
+            }
+        }
+        changed_.notify_all();
+    }
+
+    // Упреждающее чтение плитки в свободный или давно не используемый слот; без ожидания
+    void prefetch(int source, int tileRow, int tileCol) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (find(source, tileRow, tileCol) >= 0) {
+            return;
+        }
+        int victim = evictable();
+        if (victim >= 0) {
+            startLoad(victim, source, tileRow, tileCol, false);
+            prefetches_++;
+        }
+    }
+
+    // Слот под плитку результата rows x cols, заполненный нулями; при нехватке слотов ждёт завершения записи
+    MatrixView acquireOutput(int rows, int cols) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            rethrowError();
+            int index = evictable();
+            if (index >= 0) {
+                Slot& slot = slots_[index];
+                slot.state = SlotState::Output;
+                slot.source = -1;
+                slot.rows = rows;
+                slot.cols = cols;
+                lock.unlock();
+                std::fill(slot.data, slot.data + static_cast<std::size_t>(rows) * cols, 0.0);
+                return MatrixView(slot.data, rows, cols, cols);
+            }
+            auto start = std::chrono::steady_clock::now();
+            changed_.wait(lock);
+            waitSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    // Постановка готовой плитки результата в очередь записи с позиции (row, col) файла target;
+    // после записи слот освобождается
+    void writeOutput(MatrixView tile, MatrixFileStream& target, int row, int col) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int index = 0; index < static_cast<int>(slots_.size()); index++) {
+            Slot& slot = slots_[index];
+            if (slot.data == tile.data()) {
+                slot.state = SlotState::Writing;
+                slot.target = &target;
+                slot.row = row;
+                slot.col = col;
+                queue_.push_back(index);
+                break;
+            }
+        }
+        changed_.notify_all();
+    }
+
+    // Ожидание записи всех плиток результата; ошибка потока ввода-вывода пробрасывается вызывающему
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] {
+            if (error_) {
+                return true;
+            }
+            for (const Slot& slot : slots_) {
+                if (slot.state == SlotState::Writing || slot.state == SlotState::Loading) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        rethrowError();
+    }
+
+    int tileSize() const { return tileSize_; }
+    int slotCount() const { return static_cast<int>(slots_.size()); }
+    std::size_t bytesRead() const { return bytesRead_; }
+    std::size_t bytesWritten() const { return bytesWritten_; }
+    std::size_t hits() const { return hits_; }
+    std::size_t misses() const { return misses_; }
+    std::size_t prefetches() const { return prefetches_; }
+    double waitSeconds() const { return waitSeconds_; }
+
+private:
+    enum class SlotState { Free, Loading, Ready, Output, Writing };
+
+    struct Slot {
+        double* data = nullptr;
+        SlotState state = SlotState::Free;
+        int source = -1; // для входных плиток: источник и номер плитки
+        int tileRow = 0;
+        int tileCol = 0;
+        int rows = 0;
+        int cols = 0;
+        int pins = 0;
+        std::uint64_t lastUse = 0;
+        MatrixFileStream* target = nullptr; // для плиток результата: файл и позиция записи
+        int row = 0;
+        int col = 0;
+    };
+
+    int find(int source, int tileRow, int tileCol) const {
+        for (int index = 0; index < static_cast<int>(slots_.size()); index++) {
+            const Slot& slot = slots_[index];
+            if (slot.source == source && slot.tileRow == tileRow && slot.tileCol == tileCol
+                && (slot.state == SlotState::Loading || slot.state == SlotState::Ready)) {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    // Свободный слот, а при его отсутствии - незакреплённая готовая плитка, дольше всех не использовавшаяся
+    int evictable() const {
+        int victim = -1;
+        for (int index = 0; index < static_cast<int>(slots_.size()); index++) {
+            const Slot& slot = slots_[index];
+            if (slot.state == SlotState::Free) {
+                return index;
+            }
+            if (slot.state == SlotState::Ready && slot.pins == 0 && (victim < 0 || slot.lastUse < slots_[victim].lastUse)) {
+                victim = index;
+            }
+        }
+        return victim;
+    }
+
+    // Занятие слота под чтение плитки; запросы с ожиданием идут в очередь раньше упреждающих
+    void startLoad(int index, int source, int tileRow, int tileCol, bool urgent) {
+        Slot& slot = slots_[index];
+        const MatrixFileStream& stream = *sources_[source];
+        slot.state = SlotState::Loading;
+        slot.source = source;
+        slot.tileRow = tileRow;
+        slot.tileCol = tileCol;
+        slot.rows = (std::min)(tileSize_, stream.rows() - tileRow * tileSize_);
+        slot.cols = (std::min)(tileSize_, stream.cols() - tileCol * tileSize_);
+        slot.pins = 0;
+        slot.lastUse = ++clock_;
+        if (urgent) {
+            queue_.push_front(index);
+        }
+        else {
+            queue_.push_back(index);
+        }
+        changed_.notify_all();
+    }
+
+    void rethrowError() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // Цикл потока ввода-вывода: слот в состоянии Loading или Writing принадлежит этому потоку до смены состояния
+    void serve() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            changed_.wait(lock, [this] { return stopping_ || (!queue_.empty() && !error_); });
+            if (stopping_) {
+                return;
+            }
+            int index = queue_.front();
+            queue_.pop_front();
+            Slot& slot = slots_[index];
+            bool reading = slot.state == SlotState::Loading;
+            lock.unlock();
+            std::exception_ptr failure;
+            try {
+                MatrixView tile(slot.data, slot.rows, slot.cols, slot.cols);
+                if (reading) {
+                    sources_[slot.source]->readTile(slot.tileRow * tileSize_, slot.tileCol * tileSize_, tile);
+                }
+                else {
+                    slot.target->writeTile(slot.row, slot.col, tile);
+                }
+            }
+            catch (...) {
+                failure = std::current_exception();
+            }
+            lock.lock();
+            std::size_t bytes = static_cast<std::size_t>(slot.rows) * slot.cols * sizeof(double);
+            if (failure) {
+                error_ = failure;
+                slot.state = SlotState::Free;
+                slot.source = -1;
+            }
+            else if (reading) {
+                bytesRead_ += bytes;
+                slot.state = SlotState::Ready;
+            }
+            else {
+                bytesWritten_ += bytes;
+                slot.state = SlotState::Free;
+            }
+            changed_.notify_all();
+        }
+    }
+
+    int tileSize_;
+    std::vector<Slot> slots_;
+    std::vector<MatrixFileStream*> sources_;
+    std::deque<int> queue_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::thread worker_;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::uint64_t clock_ = 0;
+    std::size_t bytesRead_ = 0;
+    std::size_t bytesWritten_ = 0;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+    std::size_t prefetches_ = 0;
+    double waitSeconds_ = 0.0;
+};
+
+// Память вне плиток, которую резервирует режим: буфер упаковки B и буферы упаковки A каждого потока умножения
+std::size_t outOfCoreReserveBytes() {
+    std::size_t packB = static_cast<std::size_t>(GemmNC + 16) * GemmKC;
+    std::size_t packA = static_cast<std::size_t>(GemmMC + 16) * GemmKC * static_cast<std::size_t>(threadPool().size());
+    return (packB + packA) * sizeof(double) + (static_cast<std::size_t>(1) << 20);
+}
+
+// Подбор размера плитки и числа слотов под предел памяти. Плитка, кратная GemmKC, сохраняет порядок
+// суммирования блочного умножения, и результат совпадает с умножением в памяти бит в бит.
+// Для умножения нужно не меньше 4 слотов (A, B, C и запись), желательно 8 - для упреждения и повторного использования.
+std::pair<int, int> planTiles(const OutOfCoreOptions& options, int largestDimension) {
+    std::size_t reserve = outOfCoreReserveBytes();
+    if (options.memoryLimit <= reserve) {
+        throw std::invalid_argument("Предел памяти меньше необходимого резерва " + std::to_string(reserve >> 10) + " КБ");
+    }
+    std::size_t budget = options.memoryLimit - reserve;
+    auto slotsFor = [&](int tile) {
+        std::size_t tileBytes = static_cast<std::size_t>(tile) * tile * sizeof(double);
+        return static_cast<int>((std::min)(budget / tileBytes, static_cast<std::size_t>(1) << 16));
+    };
+
+    int tile = options.tileSize;
+    if (tile <= 0) {
+        // Наибольшая плитка, дающая 8 слотов: сначала среди кратных GemmKC, затем среди кратных 64
+        int cap = (std::max)(64, (largestDimension + 63) / 64 * 64);
+        tile = 0;
+        for (int step : { GemmKC, 64 }) {
+            for (int candidate = cap / step * step; candidate >= step && tile == 0; candidate -= step) {
+                if (slotsFor(candidate) >= 8) {
+                    tile = candidate;
+                }
+            }
+            if (tile > 0) {
+                break;
+            }
+        }
+        if (tile == 0) {
+            tile = 64;
+        }
+        tile = (std::min)(tile, (std::max)(1, largestDimension));
+    }
+    int slots = slotsFor(tile);
+    if (slots < 4) {
+        throw std::invalid_argument("Предел памяти вмещает только " + std::to_string(slots)
+            + " плиток размера " + std::to_string(tile) + ", нужно не меньше 4");
+    }
+    return { tile, slots };
+}
+
+// Сводка выполнения режима вне памяти в поток ошибок
+void reportOutOfCore(const char* title, const TileCache& cache, const OutOfCoreOptions& options, double seconds) {
+    std::size_t tileBytes = static_cast<std::size_t>(cache.tileSize()) * cache.tileSize() * sizeof(double);
+    std::size_t used = tileBytes * static_cast<std::size_t>(cache.slotCount()) + outOfCoreReserveBytes();
+    std::cerr << std::fixed << std::setprecision(3)
+        << title << ": плитка " << cache.tileSize() << ", слотов " << cache.slotCount()
+        << ", память " << (used >> 20) << " МБ из " << (options.memoryLimit >> 20) << " МБ\n"
+        << "  прочитано " << (cache.bytesRead() >> 20) << " МБ, записано " << (cache.bytesWritten() >> 20) << " МБ"
+        << ", попаданий " << cache.hits() << ", промахов " << cache.misses() << ", упреждающих чтений " << cache.prefetches() << '\n'
+        << "  ожидание ввода-вывода " << cache.waitSeconds() << " с, всего " << seconds << " с\n";
+    std::cerr.unsetf(std::ios::floatfield);
+}
+
+// Функция умножения матриц из файлов: C[ti][tj] = сумма по tk A[ti][tk] * B[tk][tj]. Пока пул считает
+// текущую пару плиток, поток ввода-вывода читает следующую, а готовые плитки C записываются в фоне.
+// outputCreated становится true, как только файл результата создан (прежнее содержимое уже потеряно).
+void multiplyOutOfCore(const OutOfCoreOptions& options, bool& outputCreated) {
+    ProfileScope profile("out-of-core multiply");
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<MatrixFileStream> a = MatrixFileStream::open(options.paths[0]);
+    std::unique_ptr<MatrixFileStream> b = MatrixFileStream::open(options.paths[1]);
+    if (a->cols() != b->rows()) {
+        throw std::invalid_argument("Число столбцов левого множителя не равно числу строк правого");
+    }
+    std::unique_ptr<MatrixFileStream> c = MatrixFileStream::create(options.paths[2], a->rows(), b->cols());
+    outputCreated = true;
+
+    std::pair<int, int> plan = planTiles(options, (std::max)({ a->rows(), a->cols(), b->cols() }));
+    int tile = plan.first;
+    int tileRows = (a->rows() + tile - 1) / tile;
+    int tileInner = (a->cols() + tile - 1) / tile;
+    int tileCols = (b->cols() + tile - 1) / tile;
+
+    TileCache cache(plan.second, tile);
+    int sourceA = cache.addSource(*a);
+    int sourceB = cache.addSource(*b);
+    for (int ti = 0; ti < tileRows; ti++) {
+        for (int tj = 0; tj < tileCols; tj++) {
+            int rows = (std::min)(tile, a->rows() - ti * tile);
+            int cols = (std::min)(tile, b->cols() - tj * tile);
+            MatrixView result = cache.acquireOutput(rows, cols);
+            for (int tk = 0; tk < tileInner; tk++) {
+                ConstMatrixView left = cache.acquire(sourceA, ti, tk);
+                ConstMatrixView right = cache.acquire(sourceB, tk, tj);
+
+                // Упреждение следующей пары плиток в порядке обхода
+                if (tk + 1 < tileInner) {
+                    cache.prefetch(sourceA, ti, tk + 1);
+                    cache.prefetch(sourceB, tk + 1, tj);
+                }
+                else if (tj + 1 < tileCols) {
+                    cache.prefetch(sourceA, ti, 0);
+                    cache.prefetch(sourceB, 0, tj + 1);
+                }
+                else if (ti + 1 < tileRows) {
+                    cache.prefetch(sourceA, ti + 1, 0);
+                    cache.prefetch(sourceB, 0, 0);
+                }
+
+                gemmAccumulate(left, right, result);
+                cache.release(left);
+                cache.release(right);
+            }
+            for (int i = 0; i < rows; i++) {
+                std::size_t j = findNonFinite(result.rowData(i), static_cast<std::size_t>(cols));
+                if (j < static_cast<std::size_t>(cols)) {
+                    throwOverflow("Переполнение при умножении матриц", ti * tile + i, tj * tile + static_cast<int>(j));
+                }
+            }
+            cache.writeOutput(result, *c, ti * tile, tj * tile);
+        }
+    }
+    cache.finish();
+    c->sync();
+    reportOutOfCore("Умножение вне памяти", cache, options,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Функция транспонирования матрицы из файла: плитка (ti, tj) источника транспонируется в слот результата
+// и записывается на место (tj, ti), пока читается следующая плитка
+void transposeOutOfCore(const OutOfCoreOptions& options, bool& outputCreated) {
+    ProfileScope profile("out-of-core transpose");
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<MatrixFileStream> a = MatrixFileStream::open(options.paths[0]);
+    std::unique_ptr<MatrixFileStream> at = MatrixFileStream::create(options.paths[1], a->cols(), a->rows());
+    outputCreated = true;
+
+    std::pair<int, int> plan = planTiles(options, (std::max)(a->rows(), a->cols()));
+    int tile = plan.first;
+    int tileRows = (a->rows() + tile - 1) / tile;
+    int tileCols = (a->cols() + tile - 1) / tile;
+
+    TileCache cache(plan.second, tile);
+    int source = cache.addSource(*a);
+    for (int ti = 0; ti < tileRows; ti++) {
+        for (int tj = 0; tj < tileCols; tj++) {
+            ConstMatrixView block = cache.acquire(source, ti, tj);
+            if (tj + 1 < tileCols) {
+                cache.prefetch(source, ti, tj + 1);
+            }
+            else if (ti + 1 < tileRows) {
+                cache.prefetch(source, ti + 1, 0);
+            }
+            MatrixView result = cache.acquireOutput(block.cols(), block.rows());
+            transposeInto(block, result);
+            cache.release(block);
+            cache.writeOutput(result, *at, tj * tile, ti * tile);
+        }
+    }
+    cache.finish();
+    at->sync();
+    reportOutOfCore("Транспонирование вне памяти", cache, options,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void printOutOfCoreUsage(std::ostream& out) {
+    out << "Использование: P2V1 --out-of-core multiply A B C [параметры]\n"
+        << "               P2V1 --out-of-core transpose A AT [параметры]\n"
+        << "  A, B        двоичные файлы матриц (формат --binary-dir пакетного режима)\n"
+        << "  C, AT       файл результата (не один из исходных), записывается по мере готовности плиток\n"
+        << "  --mem-limit предел памяти под плитки и буферы, например 512M или 2G (по умолчанию 512M)\n"
+        << "  --tile N    размер стороны плитки (по умолчанию подбирается по пределу памяти)\n"
+        << "  --threads N число потоков вычислений (по умолчанию по числу аппаратных потоков)\n";
+}
+
+// Функция проверки, что два пути указывают на один файл: существующие файлы сравниваются
+// по устройству и индексу (ссылки, другие написания пути), остальные - по нормализованному пути
+bool sameFile(const std::string& first, const std::string& second) {
+    std::error_code error;
+    if (std::filesystem::equivalent(first, second, error)) {
+        return true;
+    }
+    std::filesystem::path left = std::filesystem::absolute(first, error).lexically_normal();
+    std::filesystem::path right = std::filesystem::absolute(second, error).lexically_normal();
+    return !error && left == right;
+}
+
+// Функция разбора аргументов режима вне памяти
+OutOfCoreOptions parseOutOfCoreOptions(int argc, char* argv[]) {
+    OutOfCoreOptions options;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Не указано значение параметра " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--mem-limit") {
+            options.memoryLimit = parseByteSize(value());
+        }
+        else if (arg == "--tile") {
+            options.tileSize = std::stoi(value());
+            if (options.tileSize <= 0) {
+                throw std::invalid_argument("Размер плитки должен быть положительным");
+            }
+        }
+        else if (arg == "--threads") {
+            options.threads = std::stoi(value());
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            throw std::invalid_argument("Неизвестный параметр " + arg);
+        }
+        else if (options.operation.empty()) {
+            options.operation = arg;
+        }
+        else {
+            options.paths.push_back(arg);
+        }
+    }
+
+    std::size_t expected = options.operation == "multiply" ? 3 : options.operation == "transpose" ? 2 : 0;
+    if (expected == 0) {
+        throw std::invalid_argument("Неизвестная операция вне памяти " + options.operation + " (multiply или transpose)");
+    }
+    if (options.paths.size() != expected) {
+        throw std::invalid_argument("Операции " + options.operation + " нужно файлов: " + std::to_string(expected));
+    }
+    // Файл результата создаётся заново, поэтому он не может быть одним из исходных
+    for (std::size_t i = 0; i + 1 < options.paths.size(); i++) {
+        if (sameFile(options.paths[i], options.paths.back())) {
+            throw std::invalid_argument("Файл результата " + options.paths.back() + " совпадает с исходным " + options.paths[i]);
+        }
+    }
+    return options;
+}
+
+// Режим вычислений вне памяти
+int runOutOfCore(int argc, char* argv[]) {
+    OutOfCoreOptions options;
+    try {
+        options = parseOutOfCoreOptions(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        printOutOfCoreUsage(std::cerr);
+        return 1;
+    }
+
+    if (options.threads > 0) {
+        setThreadCount(options.threads);
+    }
+
+    bool outputCreated = false;
+    try {
+        if (options.operation == "multiply") {
+            multiplyOutOfCore(options, outputCreated);
+        }
+        else {
+            transposeOutOfCore(options, outputCreated);
+        }
+    }
+    catch (const std::exception& e) {
+        // Недописанный результат удаляется, чтобы его нельзя было принять за готовый. Если ошибка
+        // случилась до создания файла, существующий файл с этим именем не трогается
+        if (outputCreated) {
+            std::remove(options.paths.back().c_str());
+        }
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Режим замеров производительности: перебор операций, форм и размеров матриц с проверкой
+// результатов по эталонной (наивной) реализации и выводом в JSON
+
+// Операции, форма и вид входных данных одного замера
+enum class BenchShape {
+    Square,
+    TallSkinny, // 4n x n/4
+    ShortFat // n/4 x 4n
+};
+
+enum class BenchInput {
+    Random, // Равномерно распределённые значения из [-1, 1]
+    Structured // Целочисленные матрицы с известным результатом: малый ранг, единичный определитель и т.п.
+};
+
+const char* benchShapeName(BenchShape shape) {
+    switch (shape) {
+    case BenchShape::Square: return "square";
+    case BenchShape::TallSkinny: return "tall-skinny";
+    case BenchShape::ShortFat: return "short-fat";
+    }
+    return "";
+}
+
+// Параметры режима замеров
+struct BenchOptions {
+    std::vector<BatchOperation> operations; // Пусто - все операции
+    int maxSize = 1024; // Наибольший размер n
+    double memoryLimitMB = 1024.0; // Случаи, которым нужно больше памяти, пропускаются
+    double minTime = 0.1; // Минимальное суммарное время повторов одного замера (с)
+    double checkWork = 1 << 27; // Наибольшая трудоёмкость эталонной проверки (операций)
+    std::string output; // Пусто или "-" - стандартный вывод
+    int threads = 0;
+};
+
+// Результат одного замера
+struct BenchResult {
+    BatchOperation operation;
+    BenchShape shape;
+    BenchInput input;
+    int rows = 0;
+    int cols = 0;
+    int inner = 0; // Для умножения - общий размер A и B
+    int repetitions = 0;
+    double medianNs = 0.0;
+    double minNs = 0.0;
+    double flops = 0.0; // Операций с плавающей точкой за вызов
+    double bytes = 0.0; // Минимальный объём чтения и записи за вызов
+    double allocations = 0.0; // Выделений памяти за вызов
+    double allocatedBytes = 0.0;
+    std::string check; // "ok", "failed" или "skipped"
+    double error = 0.0; // Отклонение от эталона (для приближённых результатов)
+};
+
+// Генератор псевдослучайных чисел для входных данных (воспроизводимый между запусками)
+class BenchRandom {
+public:
+    explicit BenchRandom(std::uint64_t seed) : state_(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    std::uint64_t next() {
+        state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+        std::uint64_t x = state_;
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    double uniform() { return static_cast<double>(next() >> 11) * (2.0 / 9007199254740992.0) - 1.0; }
+    int integer(int low, int high) { return low + static_cast<int>(next() % static_cast<std::uint64_t>(high - low + 1)); }
+
+private:
+    std::uint64_t state_;
+};
+
+Matrix benchRandomMatrix(int rows, int cols, BenchRandom& random) {
+    Matrix result(rows, cols);
+    for (std::size_t i = 0; i < result.size(); i++) {
+        result.data()[i] = random.uniform();
+    }
+    return result;
+}
+
+Matrix benchIntegerMatrix(int rows, int cols, BenchRandom& random) {
+    Matrix result(rows, cols);
+    for (std::size_t i = 0; i < result.size(); i++) {
+        result.data()[i] = random.integer(-3, 3);
+    }
+    return result;
+}
+
+// Целочисленная матрица ранга rank: произведение (rows x rank) * (rank x cols), вычисленное точно.
+// Верхний блок левого множителя и левый блок правого - единичные, поэтому ранг равен rank в точности.
+Matrix benchLowRankMatrix(int rows, int cols, int rank, BenchRandom& random) {
+    Matrix left = benchIntegerMatrix(rows, rank, random);
+    Matrix right = benchIntegerMatrix(rank, cols, random);
+    for (int i = 0; i < rank; i++) {
+        for (int j = 0; j < rank; j++) {
+            left(i, j) = i == j ? 1.0 : 0.0;
+            right(i, j) = i == j ? 1.0 : 0.0;
+        }
+    }
+    Matrix result(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int p = 0; p < rank; p++) {
+            for (int j = 0; j < cols; j++) {
+                result(i, j) += left(i, p) * right(p, j);
+            }
+        }
+    }
+    return result;
+}
+
+// Целочисленная матрица L * U с единичными диагоналями: определитель равен 1
+Matrix benchUnitDeterminantMatrix(int n, BenchRandom& random) {
+    Matrix lower = Matrix::identity(n);
+    Matrix upper = Matrix::identity(n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < i; j++) {
+            lower(i, j) = random.integer(-1, 1) * (random.integer(0, 7) == 0 ? 1 : 0);
+            upper(j, i) = random.integer(-1, 1) * (random.integer(0, 7) == 0 ? 1 : 0);
+        }
+    }
+    Matrix result(n, n);
+    for (int i = 0; i < n; i++) {
+        for (int p = 0; p <= i; p++) {
+            for (int j = p; j < n; j++) {
+                result(i, j) += lower(i, p) * upper(p, j);
+            }
+        }
+    }
+    return result;
+}
+
+// Эталонные реализации: прямые формулы без блочности, векторизации и потоков
+
+Matrix referenceMultiply(ConstMatrixView a, ConstMatrixView b) {
+    Matrix result(a.rows(), b.cols());
+    for (int i = 0; i < a.rows(); i++) {
+        for (int j = 0; j < b.cols(); j++) {
+            long double sum = 0.0L;
+            for (int p = 0; p < a.cols(); p++) {
+                sum += static_cast<long double>(a(i, p)) * b(p, j);
+            }
+            result(i, j) = static_cast<double>(sum);
+        }
+    }
+    return result;
+}
+
+// Определитель исключением Гаусса в long double
+long double referenceDeterminant(ConstMatrixView matrix) {
+    int n = matrix.rows();
+    std::vector<long double> a(static_cast<std::size_t>(n) * n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            a[static_cast<std::size_t>(i) * n + j] = matrix(i, j);
+        }
+    }
+    long double det = 1.0L;
+    for (int k = 0; k < n; k++) {
+        int pivot = k;
+        for (int i = k + 1; i < n; i++) {
+            if (std::fabs(a[static_cast<std::size_t>(i) * n + k]) > std::fabs(a[static_cast<std::size_t>(pivot) * n + k])) {
+                pivot = i;
+            }
+        }
+        if (a[static_cast<std::size_t>(pivot) * n + k] == 0.0L) {
+            return 0.0L;
+        }
+        if (pivot != k) {
+            std::swap_ranges(a.begin() + static_cast<std::ptrdiff_t>(k) * n, a.begin() + static_cast<std::ptrdiff_t>(k + 1) * n, a.begin() + static_cast<std::ptrdiff_t>(pivot) * n);
+            det = -det;
+        }
+        long double diagonal = a[static_cast<std::size_t>(k) * n + k];
+        det *= diagonal;
+        for (int i = k + 1; i < n; i++) {
+            long double factor = a[static_cast<std::size_t>(i) * n + k] / diagonal;
+            for (int j = k + 1; j < n; j++) {
+                a[static_cast<std::size_t>(i) * n + j] -= factor * a[static_cast<std::size_t>(k) * n + j];
+            }
+        }
+    }
+    return det;
+}
+
+// Наибольший модуль элемента
+double maxAbs(ConstMatrixView matrix) {
+    double result = 0.0;
+    for (int i = 0; i < matrix.rows(); i++) {
+        for (int j = 0; j < matrix.cols(); j++) {
+            result = (std::max)(result, std::fabs(matrix(i, j)));
+        }
+    }
+    return result;
+}
+
+// Наибольшее отклонение двух матриц одного размера
+double maxDifference(ConstMatrixView a, ConstMatrixView b) {
+    double result = 0.0;
+    for (int i = 0; i < a.rows(); i++) {
+        for (int j = 0; j < a.cols(); j++) {
+            double difference = std::fabs(a(i, j) - b(i, j));
+            result = (std::max)(result, std::isnan(difference) ? std::numeric_limits<double>::infinity() : difference);
+        }
+    }
+    return result;
+}
+
+// Функция замера одного случая: вызовы повторяются до набора minTime, фиксируются медиана и минимум
+template <typename Operation>
+void measureBench(BenchResult& result, const BenchOptions& options, Operation&& operation) {
+    operation(); // Прогрев: кэши, пул потоков и рабочие области
+
+    AllocationCounters& counters = allocationCounters();
+    std::uint64_t allocationsBefore = counters.count.load(std::memory_order_relaxed);
+    std::uint64_t bytesBefore = counters.bytes.load(std::memory_order_relaxed);
+
+    std::vector<double> times;
+    double total = 0.0;
+    while ((total < options.minTime || times.size() < 3) && times.size() < 1000000) {
+        auto start = std::chrono::steady_clock::now();
+        operation();
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        times.push_back(elapsed);
+        total += elapsed * 1e-9;
+    }
+
+    double count = static_cast<double>(times.size());
+    result.repetitions = static_cast<int>(times.size());
+    result.allocations = (counters.count.load(std::memory_order_relaxed) - allocationsBefore) / count;
+    result.allocatedBytes = (counters.bytes.load(std::memory_order_relaxed) - bytesBefore) / count;
+    std::sort(times.begin(), times.end());
+    result.minNs = times.front();
+    result.medianNs = times[times.size() / 2];
+}
+
+// Функция замера одной операции для формы и вида входных данных. false - случай не применим
+// (операция требует квадратной матрицы или не хватает памяти)
+bool runBenchCase(BatchOperation operation, BenchShape shape, BenchInput input, int n, const BenchOptions& options, BenchResult& result) {
+    int rows = n;
+    int cols = n;
+    if (shape == BenchShape::TallSkinny) {
+        rows = 4 * n;
+        cols = (std::max)(1, n / 4);
+    }
+    else if (shape == BenchShape::ShortFat) {
+        rows = (std::max)(1, n / 4);
+        cols = 4 * n;
+    }
+    bool squareOnly = operation == BatchOperation::Determinant || operation == BatchOperation::Inverse || operation == BatchOperation::Trace;
+    if (squareOnly && shape != BenchShape::Square) {
+        return false;
+    }
+
+    // Для умножения форма задаёт A (rows x cols), B имеет размер cols x min(rows, cols)
+    int inner = cols;
+    int resultCols = operation == BatchOperation::Multiply ? (std::min)(rows, cols) : cols;
+    double elements = static_cast<double>(rows) * cols;
+    double footprint = (3.0 * elements + static_cast<double>(inner) * resultCols + static_cast<double>(rows) * resultCols) * sizeof(double);
+    if (footprint > options.memoryLimitMB * 1024.0 * 1024.0) {
+        return false;
+    }
+
+    result.operation = operation;
+    result.shape = shape;
+    result.input = input;
+    result.rows = rows;
+    result.cols = cols;
+    result.inner = operation == BatchOperation::Multiply ? inner : 0;
+    result.check = "skipped";
+
+    BenchRandom random(static_cast<std::uint64_t>(n) * 131 + static_cast<int>(operation) * 7 + static_cast<int>(shape) * 3 + static_cast<int>(input));
+    bool structured = input == BenchInput::Structured;
+    int lowRank = (std::max)(1, (std::min)(rows, cols) / 2);
+    Matrix a;
+    if (operation == BatchOperation::Rank && structured) {
+        a = benchLowRankMatrix(rows, cols, lowRank, random);
+    }
+    else if ((operation == BatchOperation::Determinant || operation == BatchOperation::Inverse) && structured) {
+        a = benchUnitDeterminantMatrix(n, random);
+    }
+    else {
+        a = structured ? benchIntegerMatrix(rows, cols, random) : benchRandomMatrix(rows, cols, random);
+    }
+    Matrix b;
+    if (operation == BatchOperation::Multiply) {
+        b = structured ? benchIntegerMatrix(inner, resultCols, random) : benchRandomMatrix(inner, resultCols, random);
+    }
+    else if (operation == BatchOperation::Add) {
+        b = structured ? benchIntegerMatrix(rows, cols, random) : benchRandomMatrix(rows, cols, random);
+    }
+    else if (operation == BatchOperation::Equal) {
+        b = a;
+    }
+
+    double work = 0.0; // Трудоёмкость эталонной проверки
+    double tolerance = 0.0;
+    bool checkable = true;
+    double mn = elements;
+    double small = (std::min)(rows, cols);
+    switch (operation) {
+    case BatchOperation::Multiply: {
+        Matrix c;
+        measureBench(result, options, [&]() { c = multiplyMatrices(a, b); });
+        result.flops = 2.0 * rows * inner * resultCols;
+        result.bytes = (mn + static_cast<double>(inner) * resultCols + static_cast<double>(rows) * resultCols) * sizeof(double);
+        work = result.flops;
+        if (work <= options.checkWork) {
+            result.error = maxDifference(c, referenceMultiply(a, b));
+            tolerance = 4.0 * inner * DBL_EPSILON * maxAbs(a) * maxAbs(b);
+        }
+        else {
+            checkable = false;
+        }
+        break;
+    }
+    case BatchOperation::Add: {
+        Matrix c;
+        measureBench(result, options, [&]() { c = addMatrices(a, b); });
+        result.flops = mn;
+        result.bytes = 3.0 * mn * sizeof(double);
+        Matrix reference(rows, cols);
+        for (std::size_t i = 0; i < reference.size(); i++) {
+            reference.data()[i] = a.data()[i] + b.data()[i];
+        }
+        result.error = maxDifference(c, reference);
+        break;
+    }
+    case BatchOperation::Transpose: {
+        Matrix c;
+        measureBench(result, options, [&]() { c = transposeMatrix(a); });
+        result.bytes = 2.0 * mn * sizeof(double);
+        result.error = maxDifference(c, a.transposed());
+        break;
+    }
+    case BatchOperation::Equal: {
+        bool equal = false;
+        measureBench(result, options, [&]() { equal = areMatricesEqual(a, b); });
+        result.bytes = 2.0 * mn * sizeof(double);
+        result.error = equal ? 0.0 : 1.0;
+        break;
+    }
+    case BatchOperation::Trace: {
+        double value = 0.0;
+        measureBench(result, options, [&]() { value = trace(a); });
+        result.flops = n;
+        result.bytes = n * sizeof(double);
+        long double reference = 0.0L;
+        double magnitude = 0.0;
+        for (int i = 0; i < n; i++) {
+            reference += a(i, i);
+            magnitude += std::fabs(a(i, i));
+        }
+        result.error = std::fabs(value - static_cast<double>(reference));
+        tolerance = n * DBL_EPSILON * magnitude;
+        break;
+    }
+    case BatchOperation::Rank: {
+        int rank = 0;
+        measureBench(result, options, [&]() { rank = findRank(a); });
+        result.flops = 2.0 * mn * small - 2.0 / 3.0 * small * small * small;
+        result.bytes = mn * sizeof(double);
+        // Эталон - ранг по построению: случайная матрица полного ранга, структурированная - ранга lowRank
+        int expected = structured ? lowRank : static_cast<int>(small);
+        result.error = std::abs(rank - expected);
+        break;
+    }
+    case BatchOperation::Determinant: {
+        double value = 0.0;
+        measureBench(result, options, [&]() { value = determinant(a); });
+        result.flops = 2.0 / 3.0 * n * n * n;
+        result.bytes = mn * sizeof(double);
+        work = result.flops;
+        if (work <= options.checkWork) {
+            long double reference = structured ? 1.0L : referenceDeterminant(a);
+            double scale = static_cast<double>(std::fabs(reference));
+            if (std::isfinite(scale) && scale > (std::numeric_limits<double>::min)()) {
+                result.error = std::fabs(static_cast<double>((value - reference) / reference));
+                tolerance = 1e-8 * n;
+            }
+            else {
+                checkable = false; // Определитель не представим в double
+            }
+        }
+        else {
+            checkable = false;
+        }
+        break;
+    }
+    case BatchOperation::Inverse: {
+        Matrix c;
+        measureBench(result, options, [&]() { c = inverseMatrix(a); });
+        result.flops = 2.0 * n * n * n;
+        result.bytes = 2.0 * mn * sizeof(double);
+        // Проверка по невязке: ||A * X - I|| относительно ||A|| * ||X|| * n * eps
+        Matrix product = multiplyMatrices(a, c);
+        result.error = maxDifference(product, Matrix::identity(n)) / (maxAbs(a) * maxAbs(c) * n);
+        tolerance = 1e3 * DBL_EPSILON;
+        break;
+    }
+    }
+
+    if (checkable) {
+        result.check = result.error <= tolerance ? "ok" : "failed";
+    }
+    return true;
+}
+
+// Запись результатов замеров в JSON
+void writeBenchJson(TextOutput& out, const std::vector<BenchResult>& results) {
+    const CpuFeatures& features = cpuFeatures();
+    out << "{\n  \"threads\": " << threadPool().size()
+        << ",\n  \"simd\": \"" << (features.avx512f ? "avx512" : features.avx2 && features.fma ? "avx2" : "scalar")
+        << "\",\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        double seconds = r.medianNs * 1e-9;
+        out << "    {\"operation\": \"" << operationName(r.operation)
+            << "\", \"shape\": \"" << benchShapeName(r.shape)
+            << "\", \"input\": \"" << (r.input == BenchInput::Random ? "random" : "structured")
+            << "\", \"rows\": " << r.rows << ", \"cols\": " << r.cols << ", \"inner\": " << r.inner
+            << ", \"repetitions\": " << r.repetitions
+            << ", \"ns_per_op\": " << r.medianNs << ", \"min_ns\": " << r.minNs
+            << ", \"gflops\": " << (r.flops > 0.0 ? r.flops / seconds * 1e-9 : 0.0)
+            << ", \"gbps\": " << r.bytes / seconds * 1e-9
+            << ", \"allocations_per_op\": " << r.allocations
+            << ", \"allocated_bytes_per_op\": " << r.allocatedBytes
+            << ", \"check\": \"" << r.check << "\", \"error\": " << r.error << '}'
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void printBenchUsage(std::ostream& out) {
+    out << "Использование: P2V1 --bench [--ops список] [--max-size N] [--max-memory МБ] [--min-time с]\n"
+        << "                [--check-work N] [--output файл] [--threads N]\n"
+        << "  --ops         операции через запятую (по умолчанию все)\n"
+        << "  --max-size    наибольший размер n; размеры перебираются степенями двойки от 2 (по умолчанию 1024)\n"
+        << "  --max-memory  случаи, которым нужно больше памяти, пропускаются (по умолчанию 1024 МБ)\n"
+        << "  --min-time    минимальное время повторов одного замера (по умолчанию 0.1 с)\n"
+        << "  --check-work  наибольшая трудоёмкость эталонной проверки (по умолчанию 2^27 операций)\n"
+        << "  --output      файл JSON (по умолчанию стандартный вывод); сводка пишется в стандартный поток ошибок\n"
+        << "  --threads     число потоков\n";
+}
+
+// Функция разбора аргументов режима замеров
+BenchOptions parseBenchOptions(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Не указано значение параметра " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--bench") {
+            continue;
+        }
+        else if (arg == "--ops") {
+            options.operations = parseOperationList(value());
+        }
+        else if (arg == "--max-size") {
+            options.maxSize = std::stoi(value());
+        }
+        else if (arg == "--max-memory") {
+            options.memoryLimitMB = std::stod(value());
+        }
+        else if (arg == "--min-time") {
+            options.minTime = std::stod(value());
+        }
+        else if (arg == "--check-work") {
+            options.checkWork = std::stod(value());
+        }
+        else if (arg == "--output") {
+            options.output = value();
+        }
+        else if (arg == "--threads") {
+            options.threads = std::stoi(value());
+        }
+        else {
+            throw std::invalid_argument("Неизвестный параметр " + arg);
         }
     }
 
-    return rank; // Возвращение ранга матрицы
+    if (options.operations.empty()) {
+        options.operations = {
+            BatchOperation::Multiply, BatchOperation::Add, BatchOperation::Transpose, BatchOperation::Equal,
+            BatchOperation::Trace, BatchOperation::Rank, BatchOperation::Determinant, BatchOperation::Inverse
+        };
+    }
+    return options;
 }
 
-// Функция для транспонирования матрицы
-std::vector<std::vector<double>> transposeMatrix(const std::vector<std::vector<double>>& matrix) {
-    int rows = static_cast<int>(matrix.size()); // Получение количества строк в матрице с помощью static_cast
-    int cols = static_cast<int>(matrix[0].size()); // Получение количества столбцов в матрице с помощью static_cast
+// Режим замеров: результаты в JSON, краткая сводка и итог проверок - в стандартный поток ошибок
+int runBenchmark(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        options = parseBenchOptions(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        printBenchUsage(std::cerr);
+        return 1;
+    }
 
-    // Создание новой матрицы для результата транспонирования
-    std::vector<std::vector<double>> transposed(cols, std::vector<double>(rows, 0.0));
+    if (options.threads > 0) {
+        setThreadCount(options.threads);
+    }
 
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            transposed[j][i] = matrix[i][j]; // Запись элементов транспонированной матрицы
+    std::vector<BenchResult> results;
+    int failed = 0;
+    const BenchShape shapes[] = { BenchShape::Square, BenchShape::TallSkinny, BenchShape::ShortFat };
+    const BenchInput inputs[] = { BenchInput::Random, BenchInput::Structured };
+    std::cerr << std::left << std::setw(10) << "operation" << std::setw(13) << "shape" << std::setw(12) << "input"
+        << std::setw(14) << "size" << std::setw(14) << "ns/op" << std::setw(10) << "GFLOP/s"
+        << std::setw(10) << "GB/s" << std::setw(10) << "allocs" << "check\n";
+
+    for (BatchOperation operation : options.operations) {
+        for (BenchShape shape : shapes) {
+            for (BenchInput input : inputs) {
+                for (int n = 2; n <= options.maxSize; n *= 2) {
+                    BenchResult result;
+                    if (!runBenchCase(operation, shape, input, n, options, result)) {
+                        continue;
+                    }
+                    if (result.check == "failed") {
+                        failed++;
+                    }
+                    double seconds = result.medianNs * 1e-9;
+                    std::cerr << std::setw(10) << operationName(operation) << std::setw(13) << benchShapeName(shape)
+                        << std::setw(12) << (input == BenchInput::Random ? "random" : "structured")
+                        << std::setw(14) << (std::to_string(result.rows) + "x" + std::to_string(result.cols))
+                        << std::setw(14) << std::setprecision(4) << result.medianNs
+                        << std::setw(10) << (result.flops > 0.0 ? result.flops / seconds * 1e-9 : 0.0)
+                        << std::setw(10) << result.bytes / seconds * 1e-9
+                        << std::setw(10) << result.allocations << result.check << '\n';
+                    results.push_back(result);
+                }
+            }
         }
     }
 
-    return transposed;
+    std::ofstream file;
+    if (!options.output.empty() && options.output != "-") {
+        file.open(options.output, std::ios::binary);
+        if (!file) {
+            std::cerr << "Ошибка: не удалось открыть файл " << options.output << '\n';
+            return 1;
+        }
+    }
+    {
+        TextOutput out(file.is_open() ? static_cast<std::ostream&>(file) : std::cout);
+        writeBenchJson(out, results);
+    }
+
+    std::cerr << "Замеров: " << results.size() << ", не прошли проверку: " << failed << '\n';
+    return failed == 0 ? 0 : 2;
 }
 
-// Функция проверяет, является ли матрица квадратной (одинаковое количество строк и столбцов)
-bool isSquareMatrix(const std::vector<std::vector<double>>& matrix) {
-    return matrix.size() == 0 ? false : matrix.size() == matrix[0].size();
+// Самопроверка: короткие регрессионные проверки разбора входных данных и согласованности путей вычислений.
+// Каждая проверка бросает исключение при расхождении; режим --self-test запускает их все или отобранные --filter
+struct SelfTestCase {
+    const char* name;
+    std::function<void()> run;
+};
+
+void selfTestExpect(bool condition, const std::string& message) {
+    if (!condition) {
+        throw std::runtime_error(message);
+    }
 }
 
-// Функция для вычисления следа матрицы (суммы элементов на главной диагонали матрицы)
-double trace(const std::vector<std::vector<double>>& matrix) {
-    double sum = 0.0;
-    for (size_t i = 0; i < matrix.size(); i++) {
-        // Проверяем, что индекс не превышает размерность матрицы
-        if (i >= matrix[i].size()) {
-            throw std::out_of_range("Индекс главной диагонали превышает размер матрицы");
+// Проверка, что действие отвергает вход исключением std::exception
+template <typename Action>
+void selfTestExpectRejected(Action&& action, const std::string& message) {
+    try {
+        action();
+    }
+    catch (const std::exception&) {
+        return;
+    }
+    throw std::runtime_error("не отвергнуто: " + message);
+}
+
+// Временный файл самопроверки, удаляемый при выходе из области видимости
+class SelfTestFile {
+public:
+    explicit SelfTestFile(const std::string& name) {
+        path_ = (std::filesystem::temp_directory_path() / ("p2v1_selftest_" + std::to_string(
+#ifdef _WIN32
+            GetCurrentProcessId()
+#else
+            getpid()
+#endif
+        ) + "_" + name)).string();
+    }
+    SelfTestFile(const SelfTestFile&) = delete;
+    SelfTestFile& operator=(const SelfTestFile&) = delete;
+    ~SelfTestFile() {
+        std::error_code error;
+        std::filesystem::remove(path_, error);
+    }
+
+    const std::string& path() const { return path_; }
+
+    void write(const void* data, std::size_t size) const {
+        std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!file) {
+            throw std::runtime_error("Не удалось записать файл " + path_);
         }
-        sum += matrix[i][i];
     }
 
-    if (sum > DBL_MAX) {
-        throw std::overflow_error("Сумма элементов на главной диагонали больше максимального значения диапазона double");
+private:
+    std::string path_;
+};
+
+// Файл с заголовком header и payloadBytes нулевых байтов данных за ним
+void writeSelfTestMatrixFile(const SelfTestFile& file, const MatrixFileHeader& header, std::size_t payloadBytes) {
+    std::vector<char> bytes(sizeof(MatrixFileHeader) + payloadBytes, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    file.write(bytes.data(), bytes.size());
+}
+
+// Запуск режима вне памяти с аргументами args; сообщения об ошибках не выводятся
+int selfTestRunOutOfCore(std::vector<std::string> args) {
+    args.insert(args.begin(), { "P2V1", "--out-of-core" });
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(&arg[0]);
     }
+    std::ostringstream messages;
+    std::streambuf* previous = std::cerr.rdbuf(messages.rdbuf());
+    int status = runOutOfCore(static_cast<int>(argv.size()), argv.data());
+    std::cerr.rdbuf(previous);
+    return status;
+}
 
-    return sum;
+// Ответ сервера на одну строку запроса
+std::string selfTestServerResponse(MatrixServer& server, const std::string& request) {
+    std::string response;
+    server.handle(request, response);
+    return response;
 }
 
-// Функция для нахождения определителя матрицы
-double determinant(const std::vector<std::vector<double>>& matrix) {
-    int n = static_cast<int>(matrix.size());
+bool selfTestServerOk(MatrixServer& server, const std::string& request) {
+    return selfTestServerResponse(server, request).find("\"ok\":true") != std::string::npos;
+}
 
-    // Проверка на квадратную матрицу и размерность больше 1
-    if (!isSquareMatrix(matrix) || n < 2) {
-        return 0.0;
+// Разобранный ответ сервера; запрос обязан выполниться успешно
+JsonValue selfTestServerCall(MatrixServer& server, const std::string& request) {
+    std::string response = selfTestServerResponse(server, request);
+    JsonValue result = JsonParser(response).parse();
+    const JsonValue* ok = result.find("ok");
+    if (ok == nullptr || ok->kind != JsonValue::Kind::Boolean || !ok->boolean) {
+        throw std::runtime_error("запрос " + request.substr(0, 80) + " не выполнен: " + response);
     }
+    return result;
+}
 
-    // Рекурсивная функция для вычисления определителя
-    if (n == 2) {
-        return matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0];
-    }
-    else {
-        double det = 0;
-        int sign = 1;
-
-        for (int i = 0; i < n; ++i) {
-            std::vector<std::vector<double>> submatrix;
-            for (int j = 1; j < n; ++j) {
-                std::vector<double> row;
-                for (int k = 0; k < n; ++k) {
-                    if (k != i) {
-                        row.push_back(matrix[j][k]);
-                    }
-                }
-                submatrix.push_back(row);
+// Матрица или вектор в виде массива JSON для запросов к серверу
+std::string selfTestJson(ConstMatrixView matrix) {
+    std::string text = "[";
+    for (int i = 0; i < matrix.rows(); i++) {
+        text.append(i == 0 ? "[" : ",[");
+        for (int j = 0; j < matrix.cols(); j++) {
+            if (j > 0) {
+                text.push_back(',');
             }
-            det += sign * matrix[0][i] * determinant(submatrix);
-            sign = -sign;
+            appendJsonNumber(text, matrix(i, j));
         }
-
-        return det;
+        text.push_back(']');
     }
+    text.push_back(']');
+    return text;
 }
 
-// Функция для вычисления обратной матрицы
-std::vector<std::vector<double>> inverseMatrix(const std::vector<std::vector<double>>& matrix) {
-    int n = static_cast<int>(matrix.size());
+std::string selfTestJson(const std::vector<double>& values) {
+    std::string text = selfTestJson(ConstMatrixView(values.data(), 1, static_cast<int>(values.size()), static_cast<std::ptrdiff_t>(values.size())));
+    return text.substr(1, text.size() - 2);
+}
 
-    // Создание матрицы для хранения обратной матрицы
-    std::vector<std::vector<double>> inverse(n, std::vector<double>(n));
+std::vector<SelfTestCase> selfTestCases() {
+    std::vector<SelfTestCase> cases;
 
-    // Вычисление определителя исходной матрицы
-    double det = determinant(matrix);
+    cases.push_back({ "binary header: overflowing size", [] {
+        // rows * cols * 8 переполняет 64 бита и даёт 64 - ровно размер данных файла
+        MatrixFileHeader header = makeMatrixFileHeader(1, 1);
+        header.rows = 2147352580u;
+        header.cols = 1073807362u;
+        SelfTestFile file("overflow.p2vm");
+        writeSelfTestMatrixFile(file, header, 64);
+        selfTestExpectRejected([&] { MappedMatrixFile::open(file.path()); }, "отображение файла с переполненным размером");
+        selfTestExpectRejected([&] { MatrixFileStream::open(file.path()); }, "чтение файла с переполненным размером");
+        ServerOptions options;
+        MatrixServer server(options);
+        selfTestExpect(!selfTestServerOk(server, "{\"op\":\"load\",\"name\":\"A\",\"path\":\"" + file.path() + "\"}"),
+            "сервер загрузил файл с переполненным размером");
+    } });
 
-    // Проверка на вырожденность матрицы
-    if (det == 0) {
-        std::cout << "Матрица вырожденная, обратной матрицы не существует." << std::endl;
-        return inverse;
-    }
+    cases.push_back({ "binary header: truncated payload", [] {
+        SelfTestFile file("truncated.p2vm");
+        writeSelfTestMatrixFile(file, makeMatrixFileHeader(3, 3), 8 * sizeof(double));
+        selfTestExpectRejected([&] { MappedMatrixFile::open(file.path()); }, "отображение усечённого файла");
+        selfTestExpectRejected([&] { MatrixFileStream::open(file.path()); }, "чтение усечённого файла");
+        MatrixFileHeader header = makeMatrixFileHeader(3, 3);
+        file.write(&header, sizeof(header) / 2);
+        selfTestExpectRejected([&] { MappedMatrixFile::open(file.path()); }, "файл короче заголовка");
+    } });
 
-    if (n == 2) {
-        double invDet = 1.0 / det;
-        inverse[0][0] = matrix[1][1] * invDet;
-        inverse[0][1] = -matrix[0][1] * invDet;
-        inverse[1][0] = -matrix[1][0] * invDet;
-        inverse[1][1] = matrix[0][0] * invDet;
-    }
-    else {
-        for (int i = 0; i < n; ++i) {
-            for (int j = 0; j < n; ++j) {
-                // Получение минора для текущего элемента
-                std::vector<std::vector<double>> minorMatrix;
-                for (int k = 0; k < n; ++k) {
-                    if (k == i) continue;
-                    std::vector<double> row;
-                    for (int l = 0; l < n; ++l) {
-                        if (l == j) continue;
-                        row.push_back(matrix[k][l]);
+    cases.push_back({ "binary header: dimensions above INT_MAX", [] {
+        MatrixFileHeader header = makeMatrixFileHeader(1, 1);
+        header.rows = static_cast<std::uint64_t>((std::numeric_limits<int>::max)()) + 1;
+        header.cols = 0;
+        SelfTestFile file("huge.p2vm");
+        writeSelfTestMatrixFile(file, header, 0);
+        selfTestExpectRejected([&] { MappedMatrixFile::open(file.path()); }, "число строк больше INT_MAX");
+    } });
+
+    cases.push_back({ "fixed size: agrees with LU", [] {
+        BenchRandom random(14);
+        for (int n = 2; n <= FixedMaxSize; n++) {
+            for (int kind = 0; kind < 3; kind++) {
+                Matrix a = benchRandomMatrix(n, n, random);
+                if (kind > 0) {
+                    // Последняя строка - сумма двух первых: вырожденная (kind 1) или почти вырожденная (kind 2)
+                    for (int j = 0; j < n; j++) {
+                        a(n - 1, j) = a(0, j) + a(1 % (n - 1), j) + (kind == 2 ? 1e-6 * random.uniform() : 0.0);
+                    }
+                }
+                std::string where = " (n = " + std::to_string(n) + ", вид " + std::to_string(kind) + ")";
+                LUDecomposition factors = decomposeLU(a);
+                double expected = factors.determinant();
+                double actual = fixedDeterminant(a.view());
+                double maxElement = 0.0;
+                for (int i = 0; i < n; i++) {
+                    for (int j = 0; j < n; j++) {
+                        maxElement = (std::max)(maxElement, std::fabs(a(i, j)));
                     }
-                    minorMatrix.push_back(row);
                 }
+                double roundoff = 64.0 * n * std::numeric_limits<double>::epsilon() * std::pow(maxElement, n);
+                selfTestExpect(std::fabs(actual - expected) <= 1e-10 * std::fabs(expected) + roundoff,
+                    "определитель отличается от LU" + where);
+
+                Matrix inverse(n, n);
+                bool invertible = fixedInverse(a.view(), inverse.view());
+                selfTestExpect(invertible == !factors.singular, "вырожденность отличается от LU" + where);
+                if (invertible && kind != 1) {
+                    EqualityTolerance tolerance;
+                    tolerance.mode = EqualityMode::Relative;
+                    tolerance.tolerance = kind == 2 ? 1e-4 : 1e-9;
+                    selfTestExpect(areMatricesEqual(inverse.view(), factors.inverse().view(), tolerance), "обратная отличается от LU" + where);
+                }
+            }
+        }
+    } });
 
-                // Вычисление подматрицы и определения знака
-                double minorDet = determinant(minorMatrix);
+    cases.push_back({ "text codec: malformed input rejected", [] {
+        const char* text[] = {
+            "2 2 1 2 3",
+            "2 2 1 2 x 4",
+            "2.5 2 1 2 3 4 5",
+            "-1 2",
+            "2147483648 1 0",
+            "1 x 0",
+            "1 1 1e400",
+            "1 1 0x10",
+            "1 2 1 +-2",
+            "1 2 1 ++2",
+            "1 1 1.5.2",
+        };
+        for (const char* input : text) {
+            std::istringstream in(input);
+            TextNumberReader reader(in);
+            Matrix matrix;
+            selfTestExpectRejected([&] { readMatrixText(reader, matrix); }, std::string("текст ") + input);
+        }
+        const char* csv[] = {
+            "1,2\n3\n",
+            "1,2\n3,x\n",
+            "1,2,+-3\n",
+        };
+        for (const char* input : csv) {
+            std::istringstream in(input);
+            TextNumberReader reader(in);
+            Matrix matrix;
+            std::vector<double> values;
+            selfTestExpectRejected([&] { readMatrixCsv(reader, matrix, values); }, std::string("CSV ") + input);
+        }
+    } });
 
-                double sign = ((i + j) % 2 == 0) ? 1 : -1;
-                inverse[j][i] = sign * minorDet / det;
+    cases.push_back({ "text codec: round trip", [] {
+        BenchRandom random(10);
+        Matrix a = benchRandomMatrix(7, 5, random);
+        a(0, 0) = -0.0;
+        a(1, 1) = 1e-300;
+        a(2, 2) = -1.7976931348623157e308;
+        a(3, 3) = 0.1;
+        for (MatrixTextFormat format : { MatrixTextFormat::Whitespace, MatrixTextFormat::Csv }) {
+            std::string text = "# комментарий\n";
+            {
+                TextOutput out(text);
+                writeMatrixText(out, a.view(), format);
+                writeMatrixText(out, a.view(), format);
+            }
+            // Маленький буфер: числа разрезаются границей буфера и дочитываются
+            std::istringstream in(text);
+            TextNumberReader reader(in, 8);
+            std::vector<double> values;
+            for (int copy = 0; copy < 2; copy++) {
+                Matrix b;
+                bool read = format == MatrixTextFormat::Csv ? readMatrixCsv(reader, b, values) : readMatrixText(reader, b);
+                selfTestExpect(read && b.rows() == a.rows() && b.cols() == a.cols(), "матрица не прочитана");
+                selfTestExpect(std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0, "текст не восстанавливает значения точно");
             }
+            Matrix rest;
+            bool more = format == MatrixTextFormat::Csv ? readMatrixCsv(reader, rest, values) : readMatrixText(reader, rest);
+            selfTestExpect(!more, "после двух матриц прочитаны лишние данные");
         }
-    }
+    } });
 
-    return inverse;
-}
+    cases.push_back({ "sparse: agrees with dense", [] {
+        BenchRandom random(16);
+        EqualityTolerance tolerance;
+        tolerance.mode = EqualityMode::Relative;
+        tolerance.tolerance = 1e-12;
+        for (int n : { 6, 40, 150 }) {
+            // Около 5% ненулевых элементов и диагональ: матрица невырожденная, заполнение небольшое
+            Matrix a(n, n);
+            Matrix b(n, n);
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < n; j++) {
+                    a(i, j) = i == j ? 4.0 + random.uniform() : random.integer(0, 19) == 0 ? random.uniform() : 0.0;
+                    b(i, j) = random.integer(0, 19) == 0 ? random.uniform() : 0.0;
+                }
+            }
+            Matrix singular = a;
+            for (int j = 0; j < n; j++) {
+                singular(n - 1, j) = 2.0 * a(0, j);
+            }
+            std::string where = " (n = " + std::to_string(n) + ")";
+            for (SparseFormat format : { SparseFormat::Csr, SparseFormat::Csc }) {
+                SparseMatrix sa = SparseMatrix::fromDense(a.view(), format);
+                SparseMatrix sb = SparseMatrix::fromDense(b.view(), format);
+                double expected = decomposeLU(a).determinant();
+                selfTestExpect(std::fabs(determinant(sa) - expected) <= 1e-10 * std::fabs(expected), "определитель отличается" + where);
+                selfTestExpect(std::fabs(determinant(SparseMatrix::fromDense(singular.view(), format))) <= 1e-10 * std::fabs(expected),
+                    "определитель вырожденной матрицы не мал" + where);
+                selfTestExpect(findRank(sa) == n && findRank(SparseMatrix::fromDense(singular.view(), format)) == n - 1, "ранг отличается" + where);
 
-// Функция для проверки на равенство двух матриц (2 матрицы равны по размерам и значениям внутри них)
-bool areMatricesEqual(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
-    if (matrix1.size() != matrix2.size() || matrix1[0].size() != matrix2[0].size()) {
-        return false; // Матрицы разных размеров
-    }
+                selfTestExpect(areMatricesEqual(multiplySparse(sa, sb).toDense().view(), multiplyMatrices(a.view(), b.view()).view(), tolerance),
+                    "произведение отличается" + where);
+                selfTestExpect(areMatricesEqual(addSparse(sa, sb).toDense().view(), addMatrices(a.view(), b.view()).view(), tolerance),
+                    "сумма отличается" + where);
+                selfTestExpect(areMatricesEqual(transposeSparse(sa).toDense().view(), transposeMatrix(a.view()).view()),
+                    "транспонирование отличается" + where);
 
-    for (int i = 0; i < matrix1.size(); i++) {
-        for (int j = 0; j < matrix1[0].size(); j++) {
-            if (matrix1[i][j] != matrix2[i][j]) {
-                return false; // Найдены различающиеся элементы
+                std::vector<double> x(n);
+                for (double& value : x) {
+                    value = random.uniform();
+                }
+                std::vector<double> y = multiplySparseVector(sa, x);
+                Matrix expectedY = multiplyMatrices(a.view(), ConstMatrixView(x.data(), n, 1, 1));
+                selfTestExpect(areMatricesEqual(ConstMatrixView(y.data(), n, 1, 1), expectedY.view(), tolerance),
+                    "произведение на вектор отличается" + where);
             }
         }
-    }
+    } });
 
-    return true; // Матрицы равны
-}
+    cases.push_back({ "batch: agrees with single matrices", [] {
+        BenchRandom random(15);
+        EqualityTolerance tolerance;
+        tolerance.mode = EqualityMode::Relative;
+        tolerance.tolerance = 1e-9;
+        for (int n : { 2, 3, 4, 5, 8, 12 }) {
+            int count = 2 * MatrixBatchLanes + 3; // Неполный последний блок
+            MatrixBatch a(count, n, n);
+            MatrixBatch b(count, n, n);
+            std::vector<Matrix> matricesA;
+            std::vector<Matrix> matricesB;
+            for (int m = 0; m < count; m++) {
+                matricesA.push_back(benchRandomMatrix(n, n, random));
+                matricesB.push_back(benchRandomMatrix(n, n, random));
+                if (m % 5 == 4) {
+                    for (int j = 0; j < n; j++) {
+                        matricesA[m](n - 1, j) = matricesA[m](0, j); // Вырожденная матрица в середине блока
+                    }
+                }
+                a.set(m, matricesA[m].view());
+                b.set(m, matricesB[m].view());
+            }
 
-// Функция сложения двух матриц
-std::vector<std::vector<double>> addMatrices(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
-    int rows = static_cast<int>(matrix1.size()); // Получение количества строк в матрице с помощью static_cast
-    int cols = static_cast<int>(matrix1[0].size()); // Получение количества столбцов в матрице с помощью static_cast
+            std::vector<double> determinants = batchDeterminant(a);
+            std::vector<double> traces = batchTrace(a);
+            std::vector<std::uint8_t> singular;
+            MatrixBatch inverses = batchInverse(a, singular);
+            MatrixBatch products = batchMultiply(a, b);
+            for (int m = 0; m < count; m++) {
+                const Matrix& matrix = matricesA[m];
+                std::string where = " (n = " + std::to_string(n) + ", матрица " + std::to_string(m) + ")";
+                double expected = determinant(matrix.view());
+                selfTestExpect(std::fabs(determinants[m] - expected) <= 1e-10 * std::fabs(expected) + 1e-14,
+                    "определитель отличается" + where);
+                selfTestExpect(std::fabs(traces[m] - trace(matrix.view())) <= 1e-14, "след отличается" + where);
+                Matrix inverse(n, n);
+                bool invertible = inverseInto(matrix.view(), inverse.view(), threadWorkspace());
+                selfTestExpect(singular[m] == (invertible ? 0 : 1), "вырожденность отличается" + where);
+                if (invertible) {
+                    selfTestExpect(areMatricesEqual(inverses.get(m).view(), inverse.view(), tolerance), "обратная отличается" + where);
+                }
+                selfTestExpect(areMatricesEqual(products.get(m).view(), multiplyMatrices(matrix.view(), matricesB[m].view()).view(), tolerance),
+                    "произведение отличается" + where);
+            }
+        }
+    } });
 
-    // Проверка, что обе матрицы имеют одинаковое количество строк и столбцов
-    if (matrix1.size() != matrix2.size() || matrix1[0].size() != matrix2[0].size()) {
-        std::cerr << "Матрицы должны иметь одинаковое количество строк и столбцов." << std::endl;
-        return std::vector<std::vector<double>>(); // Возвращаем пустую матрицу
-    }
+    cases.push_back({ "binary header: round trip", [] {
+        Matrix matrix(3, 5);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 5; j++) {
+                matrix(i, j) = i * 5 + j - 0.5;
+            }
+        }
+        SelfTestFile file("roundtrip.p2vm");
+        writeMatrixFile(file.path(), matrix.view());
+        std::unique_ptr<MappedMatrixFile> mapped = MappedMatrixFile::open(file.path());
+        selfTestExpect(areMatricesEqual(mapped->view(), matrix.view()), "прочитанная матрица отличается от записанной");
+    } });
 
-    std::vector<std::vector<double>> result(rows, std::vector<double>(cols, 0.0));
+    cases.push_back({ "out-of-core: output file protected", [] {
+        Matrix a(3, 4);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                a(i, j) = i - 2.0 * j;
+            }
+        }
+        SelfTestFile input("ooc_a.p2vm");
+        SelfTestFile output("ooc_c.p2vm");
+        SelfTestFile missing("ooc_missing.p2vm");
+        writeMatrixFile(input.path(), a.view());
+        const char existing[] = "не матрица";
+        output.write(existing, sizeof(existing));
+        auto outputKept = [&] {
+            std::ifstream file(output.path(), std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            return content == std::string(existing, sizeof(existing));
+        };
 
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            if ((std::numeric_limits<double>::max)() - matrix1[i][j] < matrix2[i][j]) {
-                throw std::overflow_error("Переполнение при сложении элементов матриц");
+        // Ошибка до создания результата не удаляет существующий файл
+        selfTestExpect(selfTestRunOutOfCore({ "transpose", missing.path(), output.path() }) != 0, "транспонирование отсутствующего файла");
+        selfTestExpect(outputKept(), "файл результата удалён из-за отсутствующего исходного");
+        selfTestExpect(selfTestRunOutOfCore({ "multiply", input.path(), input.path(), output.path() }) != 0, "умножение 3x4 на 3x4");
+        selfTestExpect(outputKept(), "файл результата удалён из-за несогласованных размеров");
+
+        // Результат поверх исходного файла отвергается, исходный файл не меняется
+        std::filesystem::path alias = std::filesystem::path(input.path()).parent_path() / "." / std::filesystem::path(input.path()).filename();
+        selfTestExpect(selfTestRunOutOfCore({ "transpose", input.path(), input.path() }) != 0, "транспонирование в исходный файл");
+        selfTestExpect(selfTestRunOutOfCore({ "multiply", input.path(), output.path(), alias.string() }) != 0, "умножение в исходный файл");
+        selfTestExpect(areMatricesEqual(MappedMatrixFile::open(input.path())->view(), a.view()), "исходный файл изменён");
+
+        selfTestExpect(selfTestRunOutOfCore({ "transpose", input.path(), output.path() }) == 0, "транспонирование не выполнено");
+        selfTestExpect(areMatricesEqual(MappedMatrixFile::open(output.path())->view(), transposeMatrix(a.view()).view()),
+            "неверный результат транспонирования");
+    } });
+
+    cases.push_back({ "server: malformed requests rejected", [] {
+        ServerOptions options;
+        MatrixServer server(options);
+        const char* rejected[] = {
+            "{\"op\":\"load\"",
+            "[1,2]",
+            "{\"op\":\"load\",\"name\":\"A\"} x",
+            "{\"op\":\"frobnicate\",\"a\":\"A\"}",
+            "{\"name\":\"A\"}",
+            "{\"op\":\"load\",\"name\":\"A\",\"rows\":1.5,\"cols\":4,\"data\":[1,2,3,4,5,6]}",
+            "{\"op\":\"load\",\"name\":\"A\",\"rows\":-2,\"cols\":-3,\"data\":[1,2,3,4,5,6]}",
+            "{\"op\":\"load\",\"name\":\"A\",\"rows\":1e300,\"cols\":0,\"data\":[]}",
+            "{\"op\":\"load\",\"name\":\"A\",\"rows\":65536,\"cols\":65536,\"data\":[1]}",
+            "{\"op\":\"load\",\"name\":\"A\",\"rows\":\"2\",\"cols\":3,\"data\":[1,2,3,4,5,6]}",
+            "{\"op\":\"load\",\"name\":\"A\",\"data\":[[1,2],[3]]}",
+            "{\"op\":\"load\",\"name\":\"A\",\"data\":[[1,2],\"x\"]}",
+            "{\"op\":\"rank\",\"a\":\"missing\"}",
+        };
+        for (const char* request : rejected) {
+            selfTestExpect(!selfTestServerOk(server, request), std::string("принят запрос ") + request);
+        }
+        selfTestExpect(selfTestServerOk(server, "{\"op\":\"load\",\"name\":\"A\",\"rows\":2,\"cols\":3,\"data\":[1,2,3,4,5,6]}"),
+            "не принят плоский массив 2x3");
+        selfTestExpect(selfTestServerResponse(server, "{\"op\":\"trace\",\"a\":\"A\"}").find("\"ok\":false") != std::string::npos,
+            "след неквадратной матрицы");
+        selfTestExpect(selfTestServerOk(server, "{\"op\":\"load\",\"name\":\"S\",\"data\":[[2,1],[1,3]]}"),
+            "не загружена квадратная матрица");
+        const char* rejectedUpdates[] = {
+            "{\"op\":\"set\",\"name\":\"S\",\"row\":2,\"col\":0,\"value\":1}",
+            "{\"op\":\"set\",\"name\":\"S\",\"row\":0.5,\"col\":0,\"value\":1}",
+            "{\"op\":\"set\",\"name\":\"S\",\"row\":0,\"col\":0,\"value\":\"1\"}",
+            "{\"op\":\"set_row\",\"name\":\"S\",\"row\":0,\"values\":[1,2,3]}",
+            "{\"op\":\"set_column\",\"name\":\"S\",\"col\":1,\"values\":1}",
+            "{\"op\":\"update\",\"name\":\"S\",\"u\":[[1],[2]],\"v\":[[1,2]]}",
+            "{\"op\":\"set\",\"name\":\"missing\",\"row\":0,\"col\":0,\"value\":1}",
+        };
+        for (const char* request : rejectedUpdates) {
+            selfTestExpect(!selfTestServerOk(server, request), std::string("принят запрос ") + request);
+        }
+    } });
+
+    cases.push_back({ "rank: tiny row agrees with LU", [] {
+        // Последняя строка уменьшена в 1e-12 раз: ранг и проверка вырожденности LU должны согласоваться
+        BenchRandom random(7);
+        for (int trial = 0; trial < 6; trial++) {
+            int n = trial % 2 == 0 ? 200 : 400;
+            Matrix a = benchRandomMatrix(n, n, random);
+            for (int j = 0; j < n; j++) {
+                a(n - 1, j) *= 1e-12;
             }
-            result[i][j] = matrix1[i][j] + matrix2[i][j];
+            bool singular = decomposeLU(a.view()).singular;
+            selfTestExpect(findRank(a.view()) == (singular ? n - 1 : n), "ранг не согласован с LU при n = " + std::to_string(n));
         }
-    }
+    } });
 
-    return result;
-}
+    cases.push_back({ "rank: random low-rank products", [] {
+        BenchRandom random(11);
+        RankOptions qr;
+        qr.method = RankMethod::HouseholderQR;
+        for (int trial = 0; trial < 40; trial++) {
+            int m = random.integer(10, 160);
+            int n = random.integer(10, 160);
+            int rank = random.integer(1, (std::min)(m, n));
+            Matrix left = benchRandomMatrix(m, rank, random);
+            if (trial % 2 == 1) {
+                for (int i = 0; i < m; i += 8) {
+                    for (int j = 0; j < rank; j++) {
+                        left(i, j) *= 1e3;
+                    }
+                }
+            }
+            Matrix a = multiplyMatrices(left, benchRandomMatrix(rank, n, random));
+            std::string shape = std::to_string(m) + "x" + std::to_string(n) + " ранга " + std::to_string(rank);
+            selfTestExpect(findRank(a.view()) == rank, "исключение: " + shape);
+            selfTestExpect(findRank(a.view(), qr) == rank, "QR: " + shape);
+        }
+    } });
 
-// Функция умножения двух матриц
-std::vector<std::vector<double>> multiplyMatrices(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
-    // Получаем количество строк и столбцов в матрицах
-    int rows1 = static_cast<int>(matrix1.size());
-    int cols1 = static_cast<int>(matrix1[0].size());
-    int cols2 = static_cast<int>(matrix2[0].size());
+    cases.push_back({ "rank: sparse agrees with dense", [] {
+        BenchRandom random(13);
+        RankOptions qr;
+        qr.method = RankMethod::HouseholderQR;
+        for (int trial = 0; trial < 20; trial++) {
+            // Диагональ с блоком block x block ранга block / 2 в левом верхнем углу
+            int n = random.integer(200, 320);
+            int block = random.integer(2, 20);
+            Matrix a(n, n);
+            for (int i = block; i < n; i++) {
+                a(i, i) = random.uniform() + 2.0;
+            }
+            Matrix product = multiplyMatrices(benchRandomMatrix(block, block / 2, random), benchRandomMatrix(block / 2, block, random));
+            for (int i = 0; i < block; i++) {
+                for (int j = 0; j < block; j++) {
+                    a(i, j) = product(i, j);
+                }
+            }
+            if (trial % 2 == 1) {
+                for (int j = 0; j < n; j++) {
+                    a(n - 1, j) *= 1e-12;
+                }
+            }
+            int expected = n - block + block / 2;
+            SparseMatrix sparse = SparseMatrix::fromDense(a.view());
+            std::string shape = std::to_string(n) + "x" + std::to_string(n) + ", блок " + std::to_string(block);
+            selfTestExpect(findRank(sparse) == expected, "разреженный путь: " + shape);
+            selfTestExpect(findRank(a.view(), qr) == expected, "QR: " + shape);
+        }
+    } });
 
-    // Проверка, что количество столбцов в первой матрице равно количеству строк во второй матрице
-    if (cols1 != matrix2.size()) {
-        std::cerr << "Количество столбцов в первой матрице должно быть равно количеству строк во второй матрице." << std::endl;
-        return std::vector<std::vector<double>>();
-    }
+    cases.push_back({ "element types: agree with double", [] {
+        BenchRandom random(17);
+        for (int trial = 0; trial < 10; trial++) {
+            int n = random.integer(2, 60);
+            Matrix a = benchRandomMatrix(n, n, random);
+            double expected = determinant(a.view());
+            double floatDeterminant = determinant(convertMatrix<float>(a));
+            long double longDeterminant = determinant(convertMatrix<long double>(a));
+            selfTestExpect(std::fabs(floatDeterminant - expected) <= 1e-2 * std::fabs(expected), "определитель float при n = " + std::to_string(n));
+            selfTestExpect(std::fabs(static_cast<double>(longDeterminant) - expected) <= 1e-9 * std::fabs(expected), "определитель long double при n = " + std::to_string(n));
+            selfTestExpect(findRank(convertMatrix<float>(a)) == n && findRank(convertMatrix<long double>(a)) == n, "ранг при n = " + std::to_string(n));
 
-    // Проверка, что количество элементов в каждой строке матрицы одинаковое
-    for (const auto& row : matrix1) {
-        if (row.size() != cols1) {
-            std::cerr << "Неравное количество элементов в строках первой матрицы." << std::endl;
-            return std::vector<std::vector<double>>();
+            Matrix inverse = inverseMatrix(a.view());
+            Matrix longInverse = toMatrix(inverseMatrix(convertMatrix<long double>(a)));
+            EqualityTolerance tolerance;
+            tolerance.mode = EqualityMode::Relative;
+            tolerance.tolerance = 1e-8;
+            selfTestExpect(areMatricesEqual(inverse.view(), longInverse.view(), tolerance), "обратная long double при n = " + std::to_string(n));
+
+            // Целочисленная матрица: точные ранг и определитель совпадают с округлёнными результатами double
+            Matrix integers = benchIntegerMatrix(n % 8 + 2, n % 8 + 2, random);
+            IntegerMatrix exact = convertMatrix<std::int64_t>(integers);
+            selfTestExpect(static_cast<double>(determinant(exact)) == std::round(determinant(integers.view())), "целочисленный определитель");
+            selfTestExpect(findRank(exact) == findRank(integers.view()), "целочисленный ранг");
         }
-    }
+    } });
 
-    for (const auto& row : matrix2) {
-        if (row.size() != cols2) {
-            std::cerr << "Неравное количество элементов в строках второй матрицы." << std::endl;
-            return std::vector<std::vector<double>>();
+    cases.push_back({ "element types: rank matches LU and low-rank products", [] {
+        BenchRandom random(19);
+        for (int trial = 0; trial < 4; trial++) {
+            // Строка, уменьшенная в 1e-3 раз (для long double - в 1e-12 раз), не делает матрицу вырожденной
+            Matrix a = benchRandomMatrix(100, 100, random);
+            FloatMatrix single = convertMatrix<float>(a);
+            LongDoubleMatrix extended = convertMatrix<long double>(a);
+            for (int j = 0; j < 100; j++) {
+                single(99, j) *= 1e-3f;
+                extended(99, j) *= 1e-12L;
+            }
+            selfTestExpect(findRank(single) == 100, "ранг float со строкой 1e-3");
+            inverseMatrix(single);
+            selfTestExpect(findRank(extended) == 100, "ранг long double со строкой 1e-12");
+            inverseMatrix(extended);
         }
-    }
+        for (int trial = 0; trial < 30; trial++) {
+            int m = random.integer(10, 120);
+            int n = random.integer(10, 120);
+            int rank = random.integer(1, (std::min)(m, n));
+            Matrix left = benchRandomMatrix(m, rank, random);
+            Matrix right = benchRandomMatrix(rank, n, random);
+            std::string shape = std::to_string(m) + "x" + std::to_string(n) + " ранга " + std::to_string(rank);
+            selfTestExpect(findRank(multiplyMatrices(convertMatrix<float>(left), convertMatrix<float>(right))) == rank, "float: " + shape);
+            selfTestExpect(findRank(multiplyMatrices(convertMatrix<long double>(left), convertMatrix<long double>(right))) == rank, "long double: " + shape);
+        }
+    } });
 
-    // Создаем результирующую матрицу с нулевыми значениями
-    std::vector<std::vector<double>> result(rows1, std::vector<double>(cols2, 0.0));
+    cases.push_back({ "server: update does not overwrite a reloaded or dropped name", [] {
+        auto matrixOf = [](double value) {
+            BatchMatrix matrix;
+            matrix.storage = Matrix(2, 2, value);
+            return matrix;
+        };
+        MatrixStore store;
+        std::uint64_t first = store.put("A", matrixOf(1.0))->id;
+        std::shared_ptr<const StoredMatrix> updated = store.replace("A", first, matrixOf(2.0));
+        selfTestExpect(updated && updated->id != first, "замена по актуальному номеру экземпляра не выполнена");
+        selfTestExpect(!store.replace("A", first, matrixOf(3.0)), "замена по устаревшему номеру экземпляра выполнена");
+        selfTestExpect(store.get("A")->matrix.view()(0, 0) == 2.0, "устаревшая замена изменила матрицу");
+        std::uint64_t current = store.get("A")->id;
+        store.drop("A");
+        selfTestExpect(!store.replace("A", current, matrixOf(4.0)), "замена вернула удалённое имя");
+        selfTestExpect(store.size() == 0, "удалённое имя восстановлено");
+    } });
 
-    // Умножение матриц
-    for (int i = 0; i < rows1; i++) {
-        for (int j = 0; j < cols2; j++) {
-            for (int k = 0; k < cols1; k++) {
-                if (result[i][j] + matrix1[i][k] * matrix2[k][j] < result[i][j]) {
-                    throw std::overflow_error("Переполнение при умножении матриц.");
+    cases.push_back({ "server: incremental results agree with fresh computation", [] {
+        BenchRandom random(23);
+        for (int n : { 6, 40, 200 }) {
+            ServerOptions options;
+            MatrixServer server(options);
+            Matrix current = benchRandomMatrix(n, n, random);
+            selfTestServerCall(server, "{\"op\":\"load\",\"name\":\"A\",\"data\":" + selfTestJson(current.view()) + "}");
+            for (int step = 0; step < 7; step++) {
+                std::string request;
+                int row = random.integer(0, n - 1);
+                int col = random.integer(0, n - 1);
+                std::vector<double> values(n);
+                for (double& value : values) {
+                    value = random.uniform();
                 }
-                result[i][j] += matrix1[i][k] * matrix2[k][j];
+                if (step == 0) {
+                    double value = random.uniform();
+                    current(row, col) = value;
+                    request = "{\"op\":\"set\",\"name\":\"A\",\"row\":" + std::to_string(row) + ",\"col\":" + std::to_string(col) + ",\"value\":";
+                    appendJsonNumber(request, value);
+                    request.push_back('}');
+                }
+                else if (step == 1 || step == 4 || step == 5) {
+                    if (step == 4) {
+                        for (double& value : values) {
+                            value *= 1e-12; // Строка на грани порога: ранг должен совпасть с findRank
+                        }
+                    }
+                    if (step == 5) {
+                        const double* other = current.rowData((row + 1) % n);
+                        for (int j = 0; j < n; j++) {
+                            values[j] = other[j] + 1e-14 * values[j]; // LU проходит, а численный ранг на единицу меньше
+                        }
+                    }
+                    std::copy(values.begin(), values.end(), current.rowData(row));
+                    request = "{\"op\":\"set_row\",\"name\":\"A\",\"row\":" + std::to_string(row) + ",\"values\":" + selfTestJson(values) + "}";
+                }
+                else if (step == 2) {
+                    for (int i = 0; i < n; i++) {
+                        current(i, col) = values[i];
+                    }
+                    request = "{\"op\":\"set_column\",\"name\":\"A\",\"col\":" + std::to_string(col) + ",\"values\":" + selfTestJson(values) + "}";
+                }
+                else {
+                    int k = step == 3 ? 1 : 3;
+                    Matrix u = benchRandomMatrix(n, k, random);
+                    Matrix v = benchRandomMatrix(n, k, random);
+                    gemmAccumulate(u.view(), v.view().transposed(), current.view());
+                    request = "{\"op\":\"update\",\"name\":\"A\",\"u\":" + selfTestJson(u.view()) + ",\"v\":" + selfTestJson(v.view()) + "}";
+                }
+                selfTestServerCall(server, request);
+                selfTestServerCall(server, "{\"op\":\"load\",\"name\":\"B\",\"data\":" + selfTestJson(current.view()) + "}");
+
+                std::string where = " (n = " + std::to_string(n) + ", шаг " + std::to_string(step) + ")";
+                JsonValue rankA = selfTestServerCall(server, "{\"op\":\"rank\",\"a\":\"A\"}");
+                JsonValue rankB = selfTestServerCall(server, "{\"op\":\"rank\",\"a\":\"B\"}");
+                selfTestExpect(rankA.find("incremental") != nullptr, "ранг не из обновляемого разложения" + where);
+                selfTestExpect(rankA.find("result")->number == rankB.find("result")->number, "ранги различаются" + where);
+                selfTestExpect(rankB.find("result")->number == findRank(current.view()), "ранг сервера не совпал с findRank" + where);
+
+                double detA = selfTestServerCall(server, "{\"op\":\"det\",\"a\":\"A\"}").find("result")->number;
+                double detB = selfTestServerCall(server, "{\"op\":\"det\",\"a\":\"B\"}").find("result")->number;
+                selfTestExpect(std::fabs(detA - detB) <= 1e-6 * (std::max)(std::fabs(detA), std::fabs(detB)) + 1e-300,
+                    "определители различаются" + where);
             }
         }
-    }
+    } });
 
-    return result;
+    return cases;
 }
 
-// Главная функция
-int main() {
-    SetConsoleCP(1251); // Установка кодовой страницы win-cp 1251 в поток ввода
-    SetConsoleOutputCP(1251); // Установка кодовой страницы win-cp 1251 в поток вывода
+void printSelfTestUsage(std::ostream& out) {
+    out << "Использование: P2V1 --self-test [--filter подстрока]\n"
+        << "  --filter  запускать только проверки, в названии которых есть подстрока\n";
+}
+
+// Режим самопроверки: итог каждой проверки - в стандартный поток ошибок, код 2 при хотя бы одном расхождении
+int runSelfTest(int argc, char* argv[]) {
+    std::string filter;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else {
+            std::cerr << "Ошибка: неизвестный параметр " << arg << '\n';
+            printSelfTestUsage(std::cerr);
+            return 1;
+        }
+    }
+
+    int run = 0;
+    int failed = 0;
+    for (const SelfTestCase& test : selfTestCases()) {
+        if (!filter.empty() && std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        run++;
+        try {
+            test.run();
+            std::cerr << "ok      " << test.name << '\n';
+        }
+        catch (const std::exception& e) {
+            failed++;
+            std::cerr << "FAILED  " << test.name << ": " << e.what() << '\n';
+        }
+    }
+    std::cerr << "Проверок: " << run << ", не прошли: " << failed << '\n';
+    return failed == 0 ? 0 : 2;
+}
 
+// Интерактивный режим: ввод двух матриц с клавиатуры и вывод результатов всех операций
+int runInteractive() {
     int m, n, m2, n2;
     std::string input;
 
@@ -318,10 +10530,8 @@ int main() {
     }
 
     // Ввод элементов для первой матрицы
-    std::vector<std::vector<double>> matrix1(m, std::vector<double>(n));
-    std::vector<std::vector<double>> originalMatrix1(m, std::vector<double>(n)); // Новая переменная для хранения исходной матрицы 1
-    std::vector<std::vector<double>> taskThree(m, std::vector<double>(n)); // Перемменая для выполнения 3 Задания
-    std::vector<std::vector<double>> taskFour(m, std::vector<double>(n)); // Перемменая для выполнения 3 Задания
+    // Операции не изменяют свои аргументы, поэтому одна копия матрицы служит всем заданиям
+    Matrix matrix1(m, n);
     std::cout << "Введите элементы для первой матрицы 1:\n";
     for (int i = 0; i < m; i++) {
         for (int j = 0; j < n; j++) {
@@ -335,10 +10545,7 @@ int main() {
                 } else if (num <= 0) {
                     throw std::invalid_argument("Число должно быть больше 0");
                 }
-                matrix1[i][j] = num;
-                originalMatrix1[i][j] = matrix1[i][j];
-                taskThree[i][j] = matrix1[i][j];
-                taskFour[i][j] = matrix1[i][j];
+                matrix1(i, j) = num;
             }
             catch (const std::invalid_argument& e) {
                 std::cin.clear();
@@ -414,10 +10621,7 @@ int main() {
     }
 
     // Ввод элементов для второй матрицы
-    std::vector<std::vector<double>> matrix2(m2, std::vector<double>(n2));
-    std::vector<std::vector<double>> originalMatrix2(m2, std::vector<double>(n2)); // Новая переменная для хранения исходной матрицы 2 (выполнение 2 задания)
-    std::vector<std::vector<double>> taskThree2(m2, std::vector<double>(n2)); // Перемменая для выполнения 3 Задания
-    std::vector<std::vector<double>> taskFour2(m2, std::vector<double>(n2)); // Перемменая для выполнения 4 Задания
+    Matrix matrix2(m2, n2);
     std::cout << "Введите элементы для первой матрицы 2:\n";
     for (int i = 0; i < m2; i++) {
         for (int j = 0; j < n2; j++) {
@@ -431,10 +10635,7 @@ int main() {
                 } else if (num <= 0) {
                     throw std::invalid_argument("Число должно быть больше 0");
                 }
-                matrix2[i][j] = num;
-                originalMatrix2[i][j] = matrix2[i][j];
-                taskThree2[i][j] = matrix2[i][j];
-                taskFour2[i][j] = matrix2[i][j];
+                matrix2(i, j) = num;
             }
             catch (const std::invalid_argument& e) {
                 std::cin.clear();
@@ -445,173 +10646,257 @@ int main() {
         }
     }
 
-    // Нахождение рангов матриц
-    int rank1 = findRank(matrix1);
-    int rank2 = findRank(matrix2);
-
-    // Вывод рангов
-    std::cout << std::endl;
-    std::cout << "Ранг первой матрицы: " << rank1 << std::endl;
-    std::cout << "Ранг второй матрицы: " << rank2 << std::endl;
+    // Операции над матрицами выполняются графом задач: независимые операции - параллельно, а определитель
+    // и обратная матрица квадратной матрицы - по одному общему LU-разложению вместо двух. Результаты
+    // выводятся после выполнения графа в прежнем порядке.
+    struct SquareResults {
+        bool available = false; // Матрица квадратная и размерности больше 1
+        LUDecomposition factors;
+        bool factored = false;
+        double det = 0.0;
+        double tr = 0.0;
+        std::string traceError;
+        Matrix inverse;
+        bool singular = false;
+    };
+    const Matrix* matrices[] = { &matrix1, &matrix2 };
+    int ranks[2] = { 0, 0 };
+    Matrix transposed[2];
+    SquareResults square[2];
+    bool equal = false;
+    Matrix sum;
+    Matrix product;
+    std::string addError;
+    std::string multiplyError;
 
-    // Вызов функции для транспонирования матрицы 1
-    std::vector<std::vector<double>> transposedMatrix = transposeMatrix(originalMatrix1);
+    TaskGraph graph;
+    for (int k = 0; k < 2; k++) {
+        const Matrix& matrix = *matrices[k];
+        SquareResults& results = square[k];
+        graph.add(k == 0 ? "rank 1" : "rank 2", [&ranks, &matrix, k] { ranks[k] = findRank(matrix); });
+        graph.add(k == 0 ? "transpose 1" : "transpose 2", [&transposed, &matrix, k] { transposed[k] = transposeMatrix(matrix); });
 
-    // Вывод транспонированной матрицы 1
-    std::cout << "\nТранспонированная первая матрица:" << std::endl;
-    for (const auto& row : transposedMatrix) {
-        for (double elem : row) {
-            std::cout << elem << " ";
+        results.available = isSquareMatrix(matrix) && matrix.rows() > 1;
+        if (!results.available) {
+            continue;
         }
-        std::cout << std::endl;
+        int factorNode = graph.add(k == 0 ? "lu 1" : "lu 2", [&results, &matrix] {
+            if (determinantUsesLU(matrix) || inverseUsesLU(matrix)) {
+                results.factors = decomposeLU(matrix);
+                results.factored = true;
+            }
+        });
+        graph.add(k == 0 ? "det 1" : "det 2", [&results, &matrix] {
+            results.det = results.factored && determinantUsesLU(matrix) ? results.factors.determinant() : determinant(matrix);
+        }, { factorNode });
+        graph.add(k == 0 ? "trace 1" : "trace 2", [&results, &matrix] {
+            try {
+                results.tr = trace(matrix);
+            }
+            catch (const std::out_of_range& e) {
+                results.traceError = e.what();
+            }
+            catch (const std::overflow_error& e) {
+                results.traceError = e.what();
+            }
+        });
+        graph.add(k == 0 ? "inverse 1" : "inverse 2", [&results, &matrix] {
+            int n = matrix.rows();
+            results.inverse = Matrix(n, n);
+            if (results.factored && inverseUsesLU(matrix)) {
+                results.singular = results.factors.singular;
+                if (!results.singular) {
+                    inverseFromLU<double>(results.factors.lu, results.factors.permutation.data(), results.inverse);
+                }
+            }
+            else {
+                results.singular = !inverseInto(matrix, results.inverse, threadWorkspace());
+            }
+            if (results.singular) {
+                results.inverse = Matrix(n, n);
+            }
+        }, { factorNode });
     }
-    std::cout << std::endl;
-
-    // Вызов функции для транспонирования матрицы 2
-    std::vector<std::vector<double>> transposedMatrix2 = transposeMatrix(originalMatrix2);
-
-    // Вывод транспонированной матрицы 2
-    std::cout << "\nТранспонированная вторая матрица:" << std::endl;
-    for (const auto& row : transposedMatrix2) {
-        for (double elem : row) {
-            std::cout << elem << " ";
+    graph.add("equal", [&] { equal = areMatricesEqual(matrix1, matrix2); });
+    graph.add("add", [&] {
+        if (matrix1.rows() != matrix2.rows() || matrix1.cols() != matrix2.cols()) {
+            return;
         }
-        std::cout << std::endl;
-    }
-    std::cout << std::endl;
-
-    // Проверка являются ли данные матрицы квадратными. В случае квадратных матриц найти их определители
-    //  (determinant) и следы (trace), а также если возможно вычислить обратные матрицы.
-    if (isSquareMatrix(taskThree) && taskThree.size() > 1) {
-        double det = determinant(taskThree);
-        double tr = 0.0;
         try {
-            tr = trace(taskThree);
-        }
-        catch (const std::out_of_range& e) {
-            std::cout << "Ошибка: " << e.what() << std::endl;
+            sum = Matrix(matrix1.rows(), matrix1.cols());
+            addInto(matrix1, matrix2, sum);
         }
         catch (const std::overflow_error& e) {
-            std::cout << "Ошибка: " << e.what() << std::endl;
-        }
-        std::vector<std::vector<double>> invMatrix = inverseMatrix(taskThree);
-
-        std::cout << "Первая матрица квадратная" << std::endl;
-        std::cout << "Определитель первой матрицы: " << det << std::endl;
-        std::cout << "Следы первой матрицы: " << tr << std::endl;
-
-
-        if (det != 0) {
-            std::cout << "Обратная первая матрица:\n";
-            for (const auto& row : invMatrix) {
-                for (double elem : row) {
-                    std::cout << elem << " ";
-                }
-                std::cout << std::endl;
-            }
-            std::cout << std::endl;
+            addError = e.what();
         }
-    }
-    else {
-        if (!isSquareMatrix(taskThree)) {
-            std::cout << "Первая матрица не квадратная. ";
-        }
-        else {
-            std::cout << "Размерность первой матрицы должна быть больше 1. ";
+    });
+    graph.add("multiply", [&] {
+        if (matrix1.cols() != matrix2.rows()) {
+            return;
         }
-        std::cout << "Невозможно найти определитель, следы и обратную матрицу МАТРИЦЫ 1." << std::endl;
-        std::cout << std::endl;
-    }
-
-    // Проверка являются ли данные матрицы квадратными. В случае квадратных матриц найти их определители
-    //  (determinant) и следы (trace), а также если возможно вычислить обратные матрицы.
-    if (isSquareMatrix(taskThree2) && taskThree2.size() > 1) {
-        double det = determinant(taskThree2);
-        double tr = 0.0;
         try {
-            tr = trace(taskThree2);
-        }
-        catch (const std::out_of_range& e) {
-            std::cout << "Ошибка: " << e.what() << std::endl;
+            product = Matrix(matrix1.rows(), matrix2.cols());
+            multiplyInto(matrix1, matrix2, product);
         }
         catch (const std::overflow_error& e) {
-            std::cout << "Ошибка: " << e.what() << std::endl;
+            multiplyError = e.what();
         }
-        std::vector<std::vector<double>> invMatrix2 = inverseMatrix(taskThree2);
+    });
+    graph.run(threadPool());
 
-        std::cout << "Вторая матрица квадратная" << std::endl;
-        // Добавьте вывод определителя, следов и обратной матрицы
-        std::cout << "Определитель второй матрицы: " << det << std::endl;
-        std::cout << "Следы второй матрицы: " << tr << std::endl;
+    // Вывод рангов
+    std::cout << '\n';
+    std::cout << "Ранг первой матрицы: " << ranks[0] << '\n';
+    std::cout << "Ранг второй матрицы: " << ranks[1] << '\n';
 
-        if (det != 0)
-        {
-            std::cout << "Обратная вторая матрица:\n";
-            for (const auto& row : invMatrix2) {
-                for (double elem : row) {
-                    std::cout << elem << " ";
-                }
-                std::cout << std::endl;
+    // Вывод транспонированной матрицы 1
+    std::cout << "\nТранспонированная первая матрица:" << '\n';
+    printMatrix(std::cout, transposed[0]);
+    std::cout << '\n';
+
+    // Вывод транспонированной матрицы 2
+    std::cout << "\nТранспонированная вторая матрица:" << '\n';
+    printMatrix(std::cout, transposed[1]);
+    std::cout << '\n';
+
+    // Для квадратных матриц - определители (determinant), следы (trace) и, если возможно, обратные матрицы
+    const char* ordinals[] = { "Первая", "Вторая" };
+    const char* nominatives[] = { "первая", "вторая" };
+    const char* genitives[] = { "первой", "второй" };
+    for (int k = 0; k < 2; k++) {
+        const SquareResults& results = square[k];
+        if (results.available) {
+            if (!results.traceError.empty()) {
+                std::cout << "Ошибка: " << results.traceError << '\n';
+            }
+            if (results.singular) {
+                std::cout << "Матрица вырожденная, обратной матрицы не существует." << std::endl;
+            }
+            std::cout << ordinals[k] << " матрица квадратная" << '\n';
+            std::cout << "Определитель " << genitives[k] << " матрицы: " << results.det << '\n';
+            std::cout << "Следы " << genitives[k] << " матрицы: " << results.tr << '\n';
+
+            if (results.det != 0) {
+                std::cout << "Обратная " << nominatives[k] << " матрица:\n";
+                printMatrix(std::cout, results.inverse);
+                std::cout << '\n';
             }
-            std::cout << std::endl;
-        }  
-    }
-    else {
-        if (!isSquareMatrix(taskThree2)) {
-            std::cout << "Вторая матрица не квадратная. ";
         }
         else {
-            std::cout << "Размерность второй матрицы должна быть больше 1. ";
+            if (!isSquareMatrix(*matrices[k])) {
+                std::cout << ordinals[k] << " матрица не квадратная. ";
+            }
+            else {
+                std::cout << "Размерность " << genitives[k] << " матрицы должна быть больше 1. ";
+            }
+            std::cout << "Невозможно найти определитель, следы и обратную матрицу МАТРИЦЫ " << k + 1 << "." << '\n';
+            std::cout << '\n';
         }
-        std::cout << "Невозможно найти определитель, следы и обратную матрицу МАТРИЦЫ 2." << std::endl;
-        std::cout << std::endl;
     }
 
-    // Вызов функции areMatricesEqual (нахождение равенства матриц)
-    bool resultAreMatricesEqual = areMatricesEqual(taskFour, taskFour2);
-    if (resultAreMatricesEqual) {
-        std::cout << "\nМатрицы равны." << std::endl;
+    // Равенство матриц (areMatricesEqual)
+    if (equal) {
+        std::cout << "\nМатрицы равны." << '\n';
     }
     else {
-        std::cout << "\nМатрицы не равны." << std::endl;
+        std::cout << "\nМатрицы не равны." << '\n';
     }
 
-    try {
-        // Вызов функции addMatrices
-        std::vector<std::vector<double>> result = addMatrices(taskFour, taskFour2);
-
-        // Проверка на пустоту результирующей матрицы и вывод или пропуск вывода
-        if (!result.empty()) {
-            std::cout << "\nРезультат сложения матриц:" << std::endl;
-            for (const auto& row : result) {
-                for (const auto& elem : row) {
-                    std::cout << elem << " ";
-                }
-                std::cout << std::endl;
-            }
+    // Сумма и произведение; при переполнении в сумме произведение, как и прежде, не выводится
+    if (!addError.empty()) {
+        std::cout.flush();
+        std::cerr << "Произошло переполнение: " << addError << '\n';
+    }
+    else {
+        if (!sum.empty()) {
+            std::cout << "\nРезультат сложения матриц:" << '\n';
+            printMatrix(std::cout, sum);
         }
         else {
-            std::cout << "\nРезультирующая матрица пустая. Пустые матрицы не могут быть сложены." << std::endl;
+            if (matrix1.rows() != matrix2.rows() || matrix1.cols() != matrix2.cols()) {
+                std::cerr << "Матрицы должны иметь одинаковое количество строк и столбцов." << std::endl;
+            }
+            std::cout << "\nРезультирующая матрица пустая. Пустые матрицы не могут быть сложены." << '\n';
+        }
+
+        if (!multiplyError.empty()) {
+            std::cout.flush();
+            std::cerr << "Произошло переполнение: " << multiplyError << '\n';
         }
+        else if (matrix1.cols() != matrix2.rows()) {
+            std::cerr << "Количество столбцов в первой матрице должно быть равно количеству строк во второй матрице." << std::endl;
+        }
+        else if (!product.empty()) {
+            std::cout << "\nРезультат умножения матриц:" << '\n';
+            printMatrix(std::cout, product);
+        }
+    }
 
-        // Вызов функции addMatrices
-        std::vector<std::vector<double>> resultmultiplyMatrices = multiplyMatrices(taskFour, taskFour2);
+    reportTaskGraph(graph, "Операции над введёнными матрицами");
+    return 0;
+}
 
-        // Проверка на пустоту результирующей матрицы и вывод или пропуск вывода
-        if (!resultmultiplyMatrices.empty()) {
-            std::cout << "\nРезультат умножения матриц:" << std::endl;
-            // Вывод результирующей матрицы
-            for (const auto& row : resultmultiplyMatrices) {
-                for (const auto& elem : row) {
-                    std::cout << elem << " ";
-                }
-                std::cout << std::endl;
+// Главная функция
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    SetConsoleCP(1251); // Установка кодовой страницы win-cp 1251 в поток ввода
+    SetConsoleOutputCP(1251); // Установка кодовой страницы win-cp 1251 в поток вывода
+#endif
+
+    // Параметры профилирования действуют в любом режиме и убираются из списка аргументов
+    std::vector<char*> args(argv, argv + argc);
+    ProfileOutput profileOutput = ProfileOutput::Off;
+    std::string profilePath;
+    for (std::size_t i = 1; i < args.size();) {
+        std::string arg = args[i];
+        if ((arg == "--profile" || arg == "--profile-output") && i + 1 < args.size()) {
+            std::string value = args[i + 1];
+            if (arg == "--profile-output") {
+                profilePath = value;
+            }
+            else if (value == "summary") {
+                profileOutput = ProfileOutput::Summary;
+            }
+            else if (value == "trace") {
+                profileOutput = ProfileOutput::Trace;
             }
+            else {
+                std::cerr << "Ошибка: неизвестный вид профиля " << value << " (summary или trace)\n";
+                return 1;
+            }
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        }
+        else {
+            i++;
         }
     }
-    catch (std::overflow_error& e) {
-        std::cerr << "Произошло переполнение: " << e.what() << std::endl;
+    if (profileOutput == ProfileOutput::Trace && profilePath.empty()) {
+        profilePath = "p2v1_trace.json";
     }
+    Profiler::instance().start(profileOutput, profilePath);
+    argc = static_cast<int>(args.size());
+    argv = args.data();
 
-    return 0;
-}
+    // С аргументами командной строки программа работает в пакетном режиме или режиме замеров без запросов ввода
+    int status = 0;
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        status = runBenchmark(argc, argv);
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--serve") {
+        status = runServer(argc, argv);
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--out-of-core") {
+        status = runOutOfCore(argc, argv);
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--self-test") {
+        status = runSelfTest(argc, argv);
+    }
+    else if (argc > 1) {
+        status = runBatch(argc, argv);
+    }
+    else {
+        status = runInteractive();
+    }
+    Profiler::instance().report();
+    return status;
+}
\ No newline at end of file